@@ -0,0 +1,38 @@
+#!/bin/sh
+# Writes a large program for timing the compiler: FUNCTIONS functions with
+# LITERALS distinct string literals each. Each function calls the next one
+# behind a condition that never holds, so all of them are reachable while
+# main stays small.
+#
+# usage: examples/bench/generate.sh FUNCTIONS [LITERALS, default 4] > large.wren
+
+functions=${1:?usage: $0 FUNCTIONS [LITERALS]}
+literals=${2:-4}
+awk -v functions="$functions" -v literals="$literals" 'BEGIN {
+    print "import \"ifj25\" for Ifj"
+    print ""
+    print "class Program {"
+    for (f = 0; f < functions; f++) {
+        printf "    static f%d(a, b) {\n", f
+        printf "        var c = a * 3.25 + b - %d\n", f
+        printf "        if (c < %d) {\n", f
+        for (l = 0; l < literals; l++) printf "            Ifj.write(\"function %d, literal %d #\\n\")\n", f, l
+        print "        } else {"
+        print "            Ifj.write(c)"
+        print "        }"
+        print "        while (a < b) {"
+        print "            a = a + 1.5"
+        print "        }"
+        if (f + 1 < functions) {
+            print "        if (a > 1000000) {"
+            printf "            c = f%d(a, b)\n", f + 1
+            print "        }"
+        }
+        print "        return c"
+        print "    }"
+    }
+    print "    static main() {"
+    print "        var r = f0(0, 2)"
+    print "    }"
+    print "}"
+}'
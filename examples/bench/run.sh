@@ -0,0 +1,111 @@
+#!/bin/sh
+# Regression programs and benchmarks of the compiler and of ic25int.
+#
+# NAME.wren is compiled by IFJcode25 and run on ic25int, NAME.ifjcode is run
+# on ic25int as it is, both with NAME.in as the input if there is one. The
+# output followed by "[exit N]" (or "[compile N]" when the compiler fails)
+# has to match NAME.out. Each "// flags: OPTIONS" line of a .wren file
+# compiles and runs it once more with those options, which must not change
+# the output.
+#
+# The executed instruction counts of all runs are printed and compared with
+# counts.txt, so any change in the generated code shows up as a diff there.
+# --record rewrites counts.txt instead.
+#
+# --large=N also compiles a program of N functions from generate.sh with
+# --stream, by default and with --jobs=4, and prints the compile time and
+# peak memory from --stats. The --jobs=4 output has to match the default's.
+#
+# usage: examples/bench/run.sh [--record] [--large=N] [build directory, default build]
+
+set -u
+here=$(cd "$(dirname "$0")" && pwd)
+record=false
+large=0
+build=build
+for argument in "$@"; do
+    case $argument in
+        --record) record=true ;;
+        --large=*) large=${argument#--large=} ;;
+        -*)
+            echo "usage: $0 [--record] [--large=N] [build directory]" >&2
+            exit 2
+            ;;
+        *) build=$argument ;;
+    esac
+done
+compiler=$build/IFJcode25
+interpreter=$build/ic25int
+for binary in "$compiler" "$interpreter"; do
+    if [ ! -x "$binary" ]; then
+        echo "$binary not found, build the project first" >&2
+        exit 2
+    fi
+done
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+failed=0
+
+# check NAME SOURCE [FLAGS]: compiles SOURCE if needed, runs it and compares the output with NAME.out
+check() {
+    input=/dev/null
+    [ -f "$here/$1.in" ] && input=$here/$1.in
+    program=$2
+    count=-
+    status=0
+    if [ "${2%.wren}" != "$2" ]; then
+        program=$work/program.ifjcode
+        # the flags are split into separate options on purpose
+        # shellcheck disable=SC2086
+        "$compiler" ${3:-} "$2" > "$program" 2> /dev/null
+        status=$?
+        [ $status -ne 0 ] && printf '[compile %d]\n' $status > "$work/result"
+    fi
+    if [ $status -eq 0 ]; then
+        "$interpreter" --stats "$program" < "$input" > "$work/result" 2> "$work/stats"
+        printf '\n[exit %d]\n' $? >> "$work/result"
+        count=$(sed -n 's/^instructions: \([0-9]*\) .*/\1/p' "$work/stats")
+        [ -n "$count" ] || count=-
+    fi
+    if ! cmp -s "$work/result" "$here/$1.out"; then
+        echo "FAIL $1 ${3:-}"
+        diff "$here/$1.out" "$work/result" | head -10
+        failed=1
+    fi
+    printf '%s\t%s\t%s\n' "$1" "${3:-default}" "$count" >> "$work/counts.txt"
+}
+
+: > "$work/counts.txt"
+for source in "$here"/*.wren "$here"/*.ifjcode; do
+    [ -f "$source" ] || continue
+    name=$(basename "$source")
+    name=${name%.*}
+    check "$name" "$source"
+    sed -n 's|^// flags: *||p' "$source" > "$work/flags"
+    while read -r flags; do
+        check "$name" "$source" "$flags"
+    done < "$work/flags"
+done
+
+cat "$work/counts.txt"
+if [ "$large" -gt 0 ]; then
+    "$here/generate.sh" "$large" > "$work/large.wren"
+    for flags in --stream "" --jobs=4; do
+        # shellcheck disable=SC2086
+        "$compiler" --stats $flags "$work/large.wren" > "$work/large${flags}.ifjcode" 2> "$work/stats"
+        printf '%s functions, %s: %s\n' "$large" "${flags:-default}" "$(sed -n 's/^total: //p' "$work/stats")"
+    done
+    if ! cmp -s "$work/large.ifjcode" "$work/large--jobs=4.ifjcode"; then
+        echo "FAIL --large=$large --jobs=4 output differs from the default's"
+        failed=1
+    fi
+fi
+if $record; then
+    cp "$work/counts.txt" "$here/counts.txt"
+elif ! diff "$here/counts.txt" "$work/counts.txt" > "$work/counts.diff"; then
+    echo "executed instructions differ from counts.txt (<) now (>), see --record:"
+    cat "$work/counts.diff"
+    failed=1
+fi
+exit $failed
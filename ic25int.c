@@ -0,0 +1,64 @@
+﻿#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "src/vm.h"
+
+static double now(void) {
+    struct timespec time;
+    if (timespec_get(&time, TIME_UTC) == 0) return 0.0;
+    return (double) time.tv_sec + (double) time.tv_nsec / 1e9;
+}
+
+int main(const int argc, char **argv) {
+    bool stats = false;
+    bool counts = false;
+    const char *path = nullptr;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--stats") == 0) {
+            stats = true;
+        } else if (strcmp(argv[i], "--counts") == 0) {
+            counts = true;
+        } else if (path == nullptr && argv[i][0] != '-') {
+            path = argv[i];
+        } else {
+            path = nullptr;
+            break;
+        }
+    }
+    if (path == nullptr) {
+        fprintf(stderr, "Usage: %s [--stats] [--counts] program.ifjcode < input\n", argv[0]);
+        return VM_ERROR_USAGE;
+    }
+
+    FILE *program = fopen(path, "r");
+    if (program == nullptr) {
+        perror(path);
+        return VM_ERROR_USAGE;
+    }
+    Vm *vm = nullptr;
+    size_t line;
+    const VmStatus status = Vm_Load(&vm, program, &line);
+    fclose(program);
+    if (status != VM_OK) {
+        fprintf(stderr, "%s:%zu: error %d\n", path, line, status);
+        return status;
+    }
+
+    // output is written in big pieces, READ flushes it before waiting for input
+    static char buffer[1 << 16];
+    setvbuf(stdout, buffer, _IOFBF, sizeof buffer);
+    const double start = now();
+    const int code = Vm_Run(vm, stdin, stdout, &line);
+    const double seconds = now() - start;
+    if (line != 0) fprintf(stderr, "%s:%zu: error %d\n", path, line, code);
+
+    if (stats) {
+        fprintf(stderr, "instructions: %llu in %.3f ms\n", Vm_Executed(vm), seconds * 1e3);
+        Vm_PrintOpcodes(vm, stderr);
+    }
+    if (counts) Vm_PrintInstructions(vm, stderr);
+    Vm_dtor(vm);
+    return code;
+}
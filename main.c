@@ -1,7 +1,22 @@
 ﻿#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
 
+#include "src/accessor.h"
+#include "src/codegen.h"
+#include "src/dce.h"
 #include "src/error.h"
+#include "src/fold.h"
+#include "src/inline.h"
 #include "src/lexer.h"
+#include "src/parallel.h"
+#include "src/parser.h"
+#include "src/prescan.h"
+#include "src/semantic.h"
+#include "src/symtable.h"
+#include "src/typeinfer.h"
 
 void PrintToken(const TokenType tokenType, const Token *token) {
     switch (tokenType) {
@@ -20,6 +35,9 @@ void PrintToken(const TokenType tokenType, const Token *token) {
                 case INBUILT_READNUM:
                     printf(" READ_NUM\n");
                     break;
+                case INBUILT_FLOOR:
+                    printf(" FLOOR\n");
+                    break;
                 default:
                     break;
             }
@@ -139,20 +157,223 @@ void PrintToken(const TokenType tokenType, const Token *token) {
     }
 }
 
-int main(void) {
-    printf("Starting lexical analysis!\n");
-    FILE *testfile = fopen("../examples/ex1-faktorial-iterativne.wren", "r");
+static ErrorType printTokens(FILE *source) {
     for (;;) {
-        const ErrorOrToken errorOrToken = GetNextToken(testfile);
-        if (errorOrToken.isError == false && errorOrToken.token.type == TKTYPE_EOF) {
-            puts("Reached EOF");
-            break;
+        const ErrorOrToken errorOrToken = GetNextToken(source);
+        if (errorOrToken.isError) return errorOrToken.errorType;
+        PrintToken(errorOrToken.token.type, &errorOrToken.token);
+        if (errorOrToken.token.type == TKTYPE_EOF) return ERROR_OK;
+        Token token = errorOrToken.token;
+        FreeToken(&token);
+    }
+}
+
+typedef struct Options {
+    bool stream;
+    bool tokens;
+    bool stats;
+    bool accumulate;
+    OptimizeMode optimize;
+    unsigned inlineThreshold;
+    unsigned jobs; // threads generating code, whole programs only
+} Options;
+
+static void printStats(const Codegen *gen) {
+    const unsigned long total = gen->typeChecks + gen->typeChecksElided;
+    fprintf(stderr, "type checks: %lu of %lu elided (%.1f%%)\n", gen->typeChecksElided, total,
+            total ? 100.0 * (double) gen->typeChecksElided / (double) total : 0.0);
+    fprintf(stderr, "frame variables: %lu for %lu locals\n", gen->frameSlots, gen->frameLocals);
+    fprintf(stderr, "unreachable blocks: %lu instructions removed\n", gen->unreachableRemoved);
+    fprintf(stderr, "three-address form: %lu instructions saved\n", gen->stackSaved);
+    fprintf(stderr, "value numbering: %lu computations reused\n", gen->valuesReused);
+    fprintf(stderr, "tail calls: %lu turned into jumps, %lu functions accumulated\n", gen->tailCalls,
+            gen->accumulated);
+    fprintf(stderr, "loop versions: %lu int copies behind type guards\n", gen->loopsVersioned);
+    fprintf(stderr, "string literals: %zu encoded, %lu reused, %lu joined in concatenations\n",
+            gen->strings->count + gen->strings->cleared, gen->strings->reused, gen->literalsJoined);
+    fprintf(stderr, "runtime helpers: %lu call sites\n", gen->helperCalls);
+    fprintf(stderr, "accessors: %lu uses turned into global accesses\n", gen->accessorsDirect);
+    fprintf(stderr, "built-ins: %lu calls lowered, %lu constant writes merged\n", gen->inbuiltsLowered,
+            gen->writesMerged);
+    fprintf(stderr, "output: %zu bytes in %.3f ms (%.1f MB/s)\n", gen->bytesWritten, gen->seconds * 1e3,
+            gen->seconds > 0.0 ? (double) gen->bytesWritten / 1e6 / gen->seconds : 0.0);
+    fprintf(stderr, "layout: %lu cold blocks moved, %lu error exits shared\n", gen->layout.moved,
+            gen->layout.shared);
+    for (PeepholeRule rule = 0; rule < PEEPHOLE_RULE_COUNT; rule++) {
+        fprintf(stderr, "peephole %s: %lu removed\n", Peephole_RuleName(rule), gen->peephole.removed[rule]);
+    }
+}
+
+static double now(void) {
+    struct timespec time;
+    if (timespec_get(&time, TIME_UTC) == 0) return 0.0;
+    return (double) time.tv_sec + (double) time.tv_nsec / 1e9;
+}
+
+// The whole run and the peak resident memory of the process, ru_maxrss is in KB on Linux
+static void printTotals(const double seconds) {
+    struct rusage usage;
+    const long peak = getrusage(RUSAGE_SELF, &usage) == 0 ? usage.ru_maxrss : 0;
+    fprintf(stderr, "total: %.3f ms, peak memory %ld KB\n", seconds * 1e3, peak);
+}
+
+// Parses the whole program first, then checks and generates it
+static ErrorType compileProgram(FILE *source, const Options *options) {
+    ErrorType error;
+    ASTNode *root = parse(source, &error);
+    if (root == nullptr) return error;
+
+    FunctionTable *functions = FunctionTable_ctor(ASTNode_childCount(root));
+    Symtable *locals = Symtable_ctor(0);
+    error = functions && locals ? ERROR_OK : ERROR_OTHER;
+    for (size_t i = 0; i < ASTNode_childCount(root) && error == ERROR_OK; i++) {
+        error = Semantic_DefineFunction(functions, ASTNode_child(root, i));
+    }
+    if (error == ERROR_OK && FunctionTable_CheckCall(functions, "main", FNKIND_FUNCTION, 0) != ERROR_OK) {
+        error = ERROR_SEMANTIC_USEOFUNDEFINED;
+    }
+    for (size_t i = 0; i < ASTNode_childCount(root) && error == ERROR_OK; i++) {
+        Symtable_Clear(locals);
+        error = Semantic_CheckFunction(ASTNode_child(root, i), functions, locals);
+        if (error == ERROR_OK) error = Fold_Function(ASTNode_child(root, i));
+        if (error == ERROR_OK) error = Dce_Function(ASTNode_child(root, i));
+        if (error == ERROR_OK) error = TypeInfer_Function(ASTNode_child(root, i));
+    }
+    unsigned long accessors = 0;
+    if (error == ERROR_OK) error = Accessor_Program(root, &accessors);
+    if (error == ERROR_OK) error = Inline_Program(root, options->inlineThreshold);
+    if (error == ERROR_OK) error = Dce_Program(root);
+
+    Codegen *gen = nullptr;
+    if (error == ERROR_OK && (gen = Codegen_ctor(stdout)) == nullptr) error = ERROR_OTHER;
+    if (gen != nullptr) {
+        gen->accumulate = options->accumulate;
+        gen->optimize = options->optimize;
+        gen->accessorsDirect = accessors;
+    }
+    if (error == ERROR_OK && options->jobs > 1) error = Parallel_Codegen(gen, root, options->jobs);
+    for (size_t i = 0; i < ASTNode_childCount(root) && error == ERROR_OK && options->jobs <= 1; i++) {
+        error = Codegen_Function(gen, ASTNode_child(root, i));
+    }
+    if (error == ERROR_OK) {
+        error = Codegen_Finish(gen);
+        if (options->stats) printStats(gen);
+    }
+
+    Codegen_dtor(gen);
+    Symtable_dtor(locals);
+    FunctionTable_dtor(functions);
+    ASTNode_dtor(root);
+    return error;
+}
+
+/*
+ * Compiles one function at a time: parse, check, emit and free it before the
+ * next one is read, so memory stays bounded by the largest function. Headers
+ * come from Prescan, which needs a second pass over the input, so source has
+ * to be seekable. Unreachable functions are still emitted and nothing is
+ * inlined, both need every body at once.
+ */
+static ErrorType compileStreaming(FILE *source, const Options *options) {
+    if (fseek(source, 0, SEEK_SET) != 0) {
+        fprintf(stderr, "--stream needs a seekable input file\n");
+        return ERROR_OTHER;
+    }
+
+    FunctionTable *functions = FunctionTable_ctor(0);
+    Symtable *locals = Symtable_ctor(0);
+    if (functions == nullptr || locals == nullptr) {
+        Symtable_dtor(locals);
+        FunctionTable_dtor(functions);
+        return ERROR_OTHER;
+    }
+    ErrorType error = Prescan(source, functions);
+    Codegen *gen = nullptr;
+    if (error == ERROR_OK) {
+        rewind(source);
+        gen = Codegen_ctor(stdout);
+        if (gen == nullptr) {
+            error = ERROR_OTHER;
+        } else {
+            gen->streaming = true;
+            gen->accumulate = options->accumulate;
+            gen->optimize = options->optimize;
         }
-        if (errorOrToken.isError) {
-            perror("Lexer Error");
-            break;
+    }
+
+    if (error == ERROR_OK) {
+        Parser parser;
+        error = Parser_Begin(&parser, source);
+        while (error == ERROR_OK) {
+            ASTNode *function = nullptr;
+            error = Parser_NextFunction(&parser, &function);
+            if (error != ERROR_OK || function == nullptr) break;
+            Symtable_Clear(locals);
+            error = Semantic_CheckFunction(function, functions, locals);
+            if (error == ERROR_OK) error = Fold_Function(function);
+            if (error == ERROR_OK) error = Dce_Function(function);
+            if (error == ERROR_OK) error = TypeInfer_Function(function);
+            if (error == ERROR_OK) error = Codegen_Function(gen, function);
+            ASTNode_dtor(function);
+        }
+        Parser_End(&parser);
+        if (error == ERROR_OK) {
+            error = Codegen_Finish(gen);
+            if (options->stats) printStats(gen);
         }
-        PrintToken(errorOrToken.token.type, &errorOrToken.token);
     }
-    return 0;
+
+    Codegen_dtor(gen);
+    Symtable_dtor(locals);
+    FunctionTable_dtor(functions);
+    return error;
+}
+
+int main(const int argc, char **argv) {
+    Options options = {.inlineThreshold = INLINE_DEFAULT_THRESHOLD};
+    const char *path = nullptr;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--stream") == 0) {
+            options.stream = true;
+        } else if (strcmp(argv[i], "--tokens") == 0) {
+            options.tokens = true;
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            options.stats = true;
+        } else if (strcmp(argv[i], "--accumulate") == 0) {
+            options.accumulate = true;
+        } else if (strcmp(argv[i], "-O") == 0 && i + 1 < argc &&
+                   (strcmp(argv[i + 1], "size") == 0 || strcmp(argv[i + 1], "speed") == 0)) {
+            options.optimize = strcmp(argv[++i], "size") == 0 ? OPTIMIZE_SIZE : OPTIMIZE_SPEED;
+        } else if (strncmp(argv[i], "--inline=", 9) == 0) {
+            options.inlineThreshold = (unsigned) strtoul(argv[i] + 9, nullptr, 10);
+        } else if (strncmp(argv[i], "--jobs=", 7) == 0) {
+            options.jobs = (unsigned) strtoul(argv[i] + 7, nullptr, 10);
+        } else if (path == nullptr && argv[i][0] != '-') {
+            path = argv[i];
+        } else {
+            fprintf(stderr, "Usage: %s [--stream | --tokens] [--stats] [--inline=N] [--accumulate] [-O size|speed] [--jobs=N] [source.wren]\n", argv[0]);
+            return ERROR_OTHER;
+        }
+    }
+
+    FILE *source = stdin;
+    if (path != nullptr && (source = fopen(path, "r")) == nullptr) {
+        perror(path);
+        return ERROR_OTHER;
+    }
+
+    const double start = now();
+    ErrorType error;
+    if (options.tokens) {
+        error = printTokens(source);
+    } else if (options.stream) {
+        error = compileStreaming(source, &options);
+    } else {
+        error = compileProgram(source, &options);
+    }
+
+    if (source != stdin) fclose(source);
+    if (options.stats && !options.tokens) printTotals(now() - start);
+    if (error != ERROR_OK) fprintf(stderr, "Error %d\n", error);
+    return error;
 }
@@ -0,0 +1,82 @@
+﻿#include "accessor.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "callgraph.h"
+#include "semantic.h"
+
+static bool isGlobal(const ASTNode *node) {
+    return node->token.type == TKTYPE_VARIABLE && strncmp(node->token.identifier, "GF@", 3) == 0;
+}
+
+// The global a getter or setter only reads or writes, nullptr for any other function
+static const char *accessedGlobal(const ASTNode *function) {
+    unsigned arity;
+    const FunctionKind kind = Semantic_FunctionKind(function, &arity);
+    const ASTNode *body = ASTNode_child(function, ASTNode_childCount(function) - 1);
+    if (kind == FNKIND_FUNCTION || ASTNode_childCount(body) != 1) return nullptr;
+    const ASTNode *statement = ASTNode_child(body, 0);
+    const Token *token = &statement->token;
+
+    if (kind == FNKIND_GETTER) {
+        if (token->type != TKTYPE_KEYWORD || token->keyword_type != KWTYPE_RETURN) return nullptr;
+        if (ASTNode_childCount(statement) != 1 || !isGlobal(ASTNode_child(statement, 0))) return nullptr;
+        return ASTNode_child(statement, 0)->token.identifier;
+    }
+
+    if (token->type != TKTYPE_OPERATOR || token->operator_type != OPTYPE_ASSIGN) return nullptr;
+    const ASTNode *target = ASTNode_child(statement, 0);
+    const ASTNode *value = ASTNode_child(statement, 1);
+    const ASTNode *param = ASTNode_child(ASTNode_child(function, 1), 0);
+    if (!isGlobal(target) || value->token.type != TKTYPE_VARIABLE) return nullptr;
+    if (strcmp(value->token.identifier, param->token.identifier) != 0) return nullptr;
+    return target->token.identifier;
+}
+
+static ErrorType makeGlobal(ASTNode *node, const char *global) {
+    char *name = strdup(global);
+    if (name == nullptr) return ERROR_OTHER;
+    free((char *) node->token.identifier);
+    node->token.type = TKTYPE_VARIABLE;
+    node->token.identifier = name;
+    return ERROR_OK;
+}
+
+static ErrorType replaceUses(const CallGraph *graph, const char **globals, ASTNode *node, unsigned long *direct) {
+    ErrorType error = ERROR_OK;
+    size_t callee;
+    if (CallGraph_Reference(graph, node, &callee) && globals[callee] != nullptr) {
+        // a getter use is the node itself, a setter call is the target of the assignment
+        ASTNode *accessor = node->token.type == TKTYPE_IDENTIFIER ? node : ASTNode_child(node, 0);
+        error = makeGlobal(accessor, globals[callee]);
+        (*direct)++;
+    }
+    const size_t first = CallGraph_IsNamed(node) ? 1 : 0;
+    for (size_t i = first; i < ASTNode_childCount(node) && error == ERROR_OK; i++) {
+        error = replaceUses(graph, globals, ASTNode_child(node, i), direct);
+    }
+    return error;
+}
+
+ErrorType Accessor_Program(ASTNode *root, unsigned long *direct) {
+    ErrorType error;
+    CallGraph *graph = CallGraph_ctor(root, &error);
+    if (graph == nullptr) return error;
+    const size_t count = ASTNode_childCount(root);
+    const char **globals = calloc(count ? count : 1, sizeof(char *));
+    if (globals == nullptr) {
+        CallGraph_dtor(graph);
+        return ERROR_OTHER;
+    }
+
+    for (size_t i = 0; i < count; i++) globals[i] = accessedGlobal(ASTNode_child(root, i));
+    for (size_t i = 0; i < count && error == ERROR_OK; i++) {
+        ASTNode *function = ASTNode_child(root, i);
+        error = replaceUses(graph, globals, ASTNode_child(function, ASTNode_childCount(function) - 1), direct);
+    }
+
+    free(globals);
+    CallGraph_dtor(graph);
+    return error;
+}
@@ -0,0 +1,15 @@
+﻿#ifndef IFJCODE25_ACCESSOR_H
+#define IFJCODE25_ACCESSOR_H
+
+#include "error.h"
+#include "parser.h"
+
+/*
+ * Replaces every use of a trivial getter ({ return __x }) or setter
+ * ({ __x = value }) by a direct access of the global, GF@__x. Needs the whole
+ * checked program; the accessors nobody calls any more are left to
+ * Dce_Program. direct counts the replaced uses.
+ */
+ErrorType Accessor_Program(ASTNode *root, unsigned long *direct);
+
+#endif
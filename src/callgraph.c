@@ -0,0 +1,147 @@
+﻿#include "callgraph.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "format.h"
+#include "semantic.h"
+
+// Same shape as the code labels: name$arity, name$get, name$set
+static char *functionLabel(const char *name, const FunctionKind kind, const unsigned arity) {
+    if (kind == FNKIND_FUNCTION) return Format_Numbered(name, "$", arity);
+    const size_t length = strlen(name);
+    char *label = malloc(length + sizeof "$get");
+    if (label == nullptr) return nullptr;
+    memcpy(label, name, length);
+    memcpy(label + length, kind == FNKIND_GETTER ? "$get" : "$set", sizeof "$get");
+    return label;
+}
+
+bool CallGraph_Find(const CallGraph *graph, const char *name, const FunctionKind kind, const unsigned arity,
+                   size_t *index) {
+    char *label = functionLabel(name, kind, arity);
+    if (label == nullptr) return false;
+    unsigned id;
+    const ErrorType found = Symtable_Lookup(graph->labels, label, &id);
+    free(label);
+    if (found != ERROR_OK) return false;
+    *index = graph->functionOf[id - 1];
+    return true;
+}
+
+bool CallGraph_Reference(const CallGraph *graph, const ASTNode *node, size_t *index) {
+    const Token *token = &node->token;
+    if (token->type == TKTYPE_IDENTIFIER) {
+        return CallGraph_Find(graph, token->identifier, FNKIND_GETTER, 0, index);
+    }
+    if (token->type == TKTYPE_PUNCTUATION && token->punctuation_type == PTTYPE_OPENPARENTHESIS) {
+        const ASTNode *callee = ASTNode_child(node, 0);
+        if (callee->token.type != TKTYPE_IDENTIFIER) return false;
+        const unsigned arity = (unsigned) ASTNode_childCount(node) - 1;
+        return CallGraph_Find(graph, callee->token.identifier, FNKIND_FUNCTION, arity, index);
+    }
+    if (token->type == TKTYPE_OPERATOR && token->operator_type == OPTYPE_ASSIGN) {
+        const ASTNode *target = ASTNode_child(node, 0);
+        if (target->token.type != TKTYPE_IDENTIFIER) return false;
+        return CallGraph_Find(graph, target->token.identifier, FNKIND_SETTER, 0, index);
+    }
+    return false;
+}
+
+bool CallGraph_IsNamed(const ASTNode *node) {
+    const Token *token = &node->token;
+    return (token->type == TKTYPE_PUNCTUATION && token->punctuation_type == PTTYPE_OPENPARENTHESIS) ||
+           (token->type == TKTYPE_OPERATOR && token->operator_type == OPTYPE_ASSIGN) ||
+           (token->type == TKTYPE_KEYWORD && token->keyword_type == KWTYPE_STATIC);
+}
+
+static ErrorType addEdge(CallGraph *graph, const size_t caller, const size_t callee) {
+    if (graph->calleeCounts[caller] == graph->calleeCapacities[caller]) {
+        const size_t capacity = graph->calleeCapacities[caller] ? graph->calleeCapacities[caller] * 2 : 4;
+        size_t *callees = realloc(graph->callees[caller], capacity * sizeof(size_t));
+        if (callees == nullptr) return ERROR_OTHER;
+        graph->callees[caller] = callees;
+        graph->calleeCapacities[caller] = capacity;
+    }
+    graph->callees[caller][graph->calleeCounts[caller]++] = callee;
+    return ERROR_OK;
+}
+
+static ErrorType collectEdges(CallGraph *graph, const size_t caller, const ASTNode *node) {
+    ErrorType error = ERROR_OK;
+    size_t callee;
+    if (CallGraph_Reference(graph, node, &callee)) error = addEdge(graph, caller, callee);
+
+    const size_t first = CallGraph_IsNamed(node) ? 1 : 0;
+    for (size_t i = first; i < ASTNode_childCount(node) && error == ERROR_OK; i++) {
+        error = collectEdges(graph, caller, ASTNode_child(node, i));
+    }
+    return error;
+}
+
+CallGraph *CallGraph_ctor(const ASTNode *root, ErrorType *error) {
+    const size_t count = ASTNode_childCount(root);
+    const size_t slots = count ? count : 1;
+    CallGraph *graph = calloc(1, sizeof(CallGraph));
+    if (graph == nullptr) {
+        *error = ERROR_OTHER;
+        return nullptr;
+    }
+    graph->root = root;
+    graph->functionCount = count;
+    graph->labels = Symtable_ctor(count);
+    graph->functionOf = malloc(slots * sizeof(size_t));
+    graph->callees = calloc(slots, sizeof(size_t *));
+    graph->calleeCounts = calloc(slots, sizeof(size_t));
+    graph->calleeCapacities = calloc(slots, sizeof(size_t));
+    *error = graph->labels && graph->functionOf && graph->callees && graph->calleeCounts && graph->calleeCapacities
+                 ? ERROR_OK
+                 : ERROR_OTHER;
+
+    for (size_t i = 0; i < count && *error == ERROR_OK; i++) {
+        const ASTNode *function = ASTNode_child(root, i);
+        unsigned arity;
+        const FunctionKind kind = Semantic_FunctionKind(function, &arity);
+        char *label = functionLabel(ASTNode_child(function, 0)->token.identifier, kind, arity);
+        if (label == nullptr) {
+            *error = ERROR_OTHER;
+            break;
+        }
+        unsigned id;
+        *error = Symtable_Declare(graph->labels, label, &id);
+        free(label);
+        if (*error == ERROR_OK) graph->functionOf[id - 1] = i;
+    }
+    for (size_t i = 0; i < count && *error == ERROR_OK; i++) {
+        const ASTNode *function = ASTNode_child(root, i);
+        *error = collectEdges(graph, i, ASTNode_child(function, ASTNode_childCount(function) - 1));
+    }
+
+    if (*error != ERROR_OK) {
+        CallGraph_dtor(graph);
+        return nullptr;
+    }
+    return graph;
+}
+
+void CallGraph_Reach(const CallGraph *graph, const size_t start, bool *reached) {
+    for (size_t i = 0; i < graph->calleeCounts[start]; i++) {
+        const size_t callee = graph->callees[start][i];
+        if (reached[callee]) continue;
+        reached[callee] = true;
+        CallGraph_Reach(graph, callee, reached);
+    }
+}
+
+void CallGraph_dtor(CallGraph *graph) {
+    if (graph == nullptr) return;
+    if (graph->callees) {
+        for (size_t i = 0; i < graph->functionCount; i++) free(graph->callees[i]);
+    }
+    free(graph->callees);
+    free(graph->calleeCounts);
+    free(graph->calleeCapacities);
+    free(graph->functionOf);
+    Symtable_dtor(graph->labels);
+    free(graph);
+}
@@ -0,0 +1,48 @@
+﻿#ifndef IFJCODE25_CALLGRAPH_H
+#define IFJCODE25_CALLGRAPH_H
+
+#include <stddef.h>
+
+#include "error.h"
+#include "parser.h"
+#include "symtable.h"
+
+/*
+ * Static call graph of a checked program. Functions are identified by their
+ * index among the children of the program node; an edge is a call, a getter
+ * use or a setter assignment in the caller's body.
+ */
+typedef struct CallGraph {
+    const ASTNode *root;
+    size_t functionCount;
+    Symtable *labels;   // name$arity | name$get | name$set -> id
+    size_t *functionOf; // id - 1 -> function index
+
+    size_t **callees; // function index -> indices it references, with repeats
+    size_t *calleeCounts;
+    size_t *calleeCapacities;
+} CallGraph;
+
+CallGraph *CallGraph_ctor(const ASTNode *root, ErrorType *error);
+
+bool CallGraph_Find(const CallGraph *graph, const char *name, FunctionKind kind, unsigned arity, size_t *index);
+
+/*
+ * Finds the user function referenced by a call, getter use (IDENTIFIER) or
+ * setter assignment node. Returns false for anything else, builtins included.
+ */
+bool CallGraph_Reference(const CallGraph *graph, const ASTNode *node, size_t *index);
+
+/*
+ * Whether the first child of node names something instead of being an
+ * expression: the callee of a call, the target of an assignment or the
+ * parameters of an inlined call.
+ */
+bool CallGraph_IsNamed(const ASTNode *node);
+
+// Marks every function reachable from start (start itself only through a cycle)
+void CallGraph_Reach(const CallGraph *graph, size_t start, bool *reached);
+
+void CallGraph_dtor(CallGraph *graph);
+
+#endif
@@ -0,0 +1,126 @@
+﻿#include "cfg.h"
+
+#include <stdlib.h>
+
+static bool reserve(void **data, size_t *capacity, const size_t count, const size_t size) {
+    if (count < *capacity) return true;
+    const size_t newCapacity = *capacity ? *capacity * 2 : 16;
+    void *grown = realloc(*data, newCapacity * size);
+    if (grown == nullptr) return false;
+    *data = grown;
+    *capacity = newCapacity;
+    return true;
+}
+
+Cfg *Cfg_ctor(void) {
+    Cfg *cfg = calloc(1, sizeof(Cfg));
+    if (cfg == nullptr) return nullptr;
+    cfg->labels = Symtable_ctor(0);
+    if (cfg->labels == nullptr) {
+        free(cfg);
+        return nullptr;
+    }
+    return cfg;
+}
+
+static bool isJump(const Opcode opcode) {
+    return opcode == OP_JUMP || opcode == OP_JUMPIFEQ || opcode == OP_JUMPIFNEQ || opcode == OP_JUMPIFEQS ||
+           opcode == OP_JUMPIFNEQS;
+}
+
+static bool endsBlock(const Opcode opcode) {
+    return isJump(opcode) || opcode == OP_RETURN || opcode == OP_EXIT;
+}
+
+static ErrorType addBlock(Cfg *cfg, const size_t first) {
+    if (!reserve((void **) &cfg->blocks, &cfg->blockCapacity, cfg->blockCount, sizeof(BasicBlock))) {
+        return ERROR_OTHER;
+    }
+    cfg->blocks[cfg->blockCount++] = (BasicBlock){
+        .first = first,
+        .next = CFG_NO_BLOCK,
+        .target = CFG_NO_BLOCK,
+    };
+    return ERROR_OK;
+}
+
+static ErrorType addLabel(Cfg *cfg, const char *label) {
+    unsigned id;
+    const ErrorType error = Symtable_Declare(cfg->labels, label, &id);
+    // the interpreter rejects a repeated label anyway
+    if (error == ERROR_SEMANTIC_REDEFINITION) return ERROR_OK;
+    if (error != ERROR_OK) return error;
+    if (!reserve((void **) &cfg->labelBlocks, &cfg->labelCapacity, id - 1, sizeof(size_t))) return ERROR_OTHER;
+    cfg->labelBlocks[id - 1] = cfg->blockCount - 1;
+    return ERROR_OK;
+}
+
+ErrorType Cfg_Build(Cfg *cfg, const InstrList *code) {
+    cfg->blockCount = 0;
+    Symtable_Clear(cfg->labels);
+
+    ErrorType error;
+    for (size_t i = 0; i < code->count; i++) {
+        const Instr *instr = &code->items[i];
+        const bool leader = i == 0 || endsBlock(code->items[i - 1].opcode) ||
+                            (instr->opcode == OP_LABEL && cfg->blocks[cfg->blockCount - 1].count > 0);
+        if (leader && (error = addBlock(cfg, i)) != ERROR_OK) return error;
+        if (instr->opcode == OP_LABEL && (error = addLabel(cfg, instr->operands[0])) != ERROR_OK) return error;
+        cfg->blocks[cfg->blockCount - 1].count++;
+    }
+
+    for (size_t b = 0; b < cfg->blockCount; b++) {
+        BasicBlock *block = &cfg->blocks[b];
+        const Instr *last = &code->items[block->first + block->count - 1];
+        if (!endsBlock(last->opcode) || (last->opcode != OP_JUMP && isJump(last->opcode))) {
+            if (b + 1 < cfg->blockCount) block->next = b + 1;
+        }
+        unsigned id;
+        if (isJump(last->opcode) && Symtable_Lookup(cfg->labels, last->operands[0], &id) == ERROR_OK) {
+            block->target = cfg->labelBlocks[id - 1];
+        }
+    }
+    return ERROR_OK;
+}
+
+size_t Cfg_RemoveUnreachable(const Cfg *cfg, InstrList *code) {
+    if (cfg->blockCount == 0) return 0;
+    size_t *stack = malloc(cfg->blockCount * sizeof(size_t));
+    // without the memory for the walk every block is kept
+    if (stack == nullptr) return 0;
+
+    for (size_t b = 0; b < cfg->blockCount; b++) cfg->blocks[b].reachable = false;
+    size_t depth = 0;
+    cfg->blocks[0].reachable = true;
+    stack[depth++] = 0;
+    while (depth > 0) {
+        const BasicBlock *block = &cfg->blocks[stack[--depth]];
+        const size_t successors[] = {block->next, block->target};
+        for (size_t s = 0; s < 2; s++) {
+            if (successors[s] == CFG_NO_BLOCK || cfg->blocks[successors[s]].reachable) continue;
+            cfg->blocks[successors[s]].reachable = true;
+            stack[depth++] = successors[s];
+        }
+    }
+    free(stack);
+
+    size_t removed = 0;
+    for (size_t b = 0; b < cfg->blockCount; b++) {
+        const BasicBlock *block = &cfg->blocks[b];
+        if (block->reachable) continue;
+        for (size_t i = block->first; i < block->first + block->count; i++) {
+            // without operands nothing is allocated, so this cannot fail
+            InstrList_Set(code, i, OP_NOP, nullptr, nullptr);
+            removed++;
+        }
+    }
+    return removed;
+}
+
+void Cfg_dtor(Cfg *cfg) {
+    if (cfg == nullptr) return;
+    Symtable_dtor(cfg->labels);
+    free(cfg->labelBlocks);
+    free(cfg->blocks);
+    free(cfg);
+}
@@ -0,0 +1,47 @@
+﻿#ifndef IFJCODE25_CFG_H
+#define IFJCODE25_CFG_H
+
+#include <stddef.h>
+
+#include "error.h"
+#include "instr.h"
+#include "symtable.h"
+
+/*
+ * Basic blocks and control-flow graph of one function's instructions. A block
+ * starts at a LABEL or after a jump, RETURN or EXIT and is a range of the
+ * instruction list, so the passes keep working on the linear array. CALL does
+ * not end a block, control comes back to the next instruction.
+ */
+
+#define CFG_NO_BLOCK ((size_t) -1)
+
+typedef struct BasicBlock {
+    size_t first; // index of its first instruction
+    size_t count;
+    size_t next;   // block control falls through to, CFG_NO_BLOCK if none
+    size_t target; // block a jump at its end goes to, CFG_NO_BLOCK if none
+    bool reachable;
+} BasicBlock;
+
+typedef struct Cfg {
+    BasicBlock *blocks;
+    size_t blockCount;
+    size_t blockCapacity;
+
+    Symtable *labels;    // label -> id, index + 1 into labelBlocks
+    size_t *labelBlocks; // block each label starts
+    size_t labelCapacity;
+} Cfg;
+
+Cfg *Cfg_ctor(void);
+
+// Replaces the previous graph with the one of code, block 0 is the entry
+ErrorType Cfg_Build(Cfg *cfg, const InstrList *code);
+
+// Turns the instructions of blocks unreachable from the entry into OP_NOP, returns how many
+size_t Cfg_RemoveUnreachable(const Cfg *cfg, InstrList *code);
+
+void Cfg_dtor(Cfg *cfg);
+
+#endif
@@ -1 +1,1502 @@
-﻿#include "codegen.h"
+﻿#define _POSIX_C_SOURCE 200809L
+
+#include "codegen.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "format.h"
+#include "layout.h"
+#include "list.h"
+#include "lvn.h"
+#include "peephole.h"
+#include "tac.h"
+#include "semantic.h"
+#include "strpool.h"
+#include "tailcall.h"
+
+// scratch variables of every function frame, used between POPS and PUSHS of one operation
+#define VAR_A "LF@%a"
+#define VAR_B "LF@%b"
+#define VAR_R "LF@%r"
+#define VAR_TA "LF@%ta"
+#define VAR_TB "LF@%tb"
+#define VAR_RETVAL "LF@%retval1"
+// pending left operands of a linear recursion turned into a loop, valid while VAR_PENDING is true
+#define VAR_ACC "LF@%acc"
+#define VAR_PENDING "LF@%pending"
+
+// Loop nesting from which -O size still inlines the dynamic operations, any loop body is hot
+#define HOT_LOOP_DEPTH 1
+
+// Largest while condition (in AST nodes) that is repeated at the bottom of the loop
+#define ROTATE_MAX_CONDITION 16
+
+// Enough for the internal labels of the runtime routines, $Ifj$read_num%end and the like
+#define ROUTINE_LABEL_MAX 32
+
+// Instructions are collected per function and written out by flush, operands may be nullptr from the
+// first unused one
+static void emitInstr(const Codegen *gen, const Opcode opcode, const char *first, const char *second,
+                      const char *third) {
+    if (InstrList_Insert(gen->code, gen->code->count, opcode, first, second, third) != ERROR_OK) {
+        gen->code->failed = true;
+    }
+}
+
+static void emitOp(const Codegen *gen, const Opcode opcode) {
+    emitInstr(gen, opcode, nullptr, nullptr, nullptr);
+}
+
+static double now(void) {
+    struct timespec time;
+    if (timespec_get(&time, TIME_UTC) == 0) return 0.0;
+    return (double) time.tv_sec + (double) time.tv_nsec / 1e9;
+}
+
+// Runs the passes over the lowered function and writes it out
+static ErrorType flush(Codegen *gen) {
+    if (gen->code->failed) return ERROR_OTHER;
+    ErrorType error = Cfg_Build(gen->cfg, gen->code);
+    if (error != ERROR_OK) return error;
+    gen->unreachableRemoved += Cfg_RemoveUnreachable(gen->cfg, gen->code);
+    InstrList_Compact(gen->code);
+    if ((error = Cfg_Build(gen->cfg, gen->code)) != ERROR_OK) return error;
+    if ((error = Tac_Convert(gen->code, gen->cfg, &gen->stackSaved)) != ERROR_OK) return error;
+    if ((error = Cfg_Build(gen->cfg, gen->code)) != ERROR_OK) return error;
+    if ((error = Lvn_Function(gen->code, gen->cfg, &gen->valuesReused)) != ERROR_OK) return error;
+    if ((error = Tac_PackTemporaries(gen->code)) != ERROR_OK) return error;
+    if ((error = Cfg_Build(gen->cfg, gen->code)) != ERROR_OK) return error;
+    if ((error = Layout_Function(gen->code, gen->cfg, &gen->layout)) != ERROR_OK) return error;
+    if ((error = Peephole_Run(gen->code, &gen->peephole)) != ERROR_OK) return error;
+    const double start = now();
+    fputc('\n', gen->output);
+    gen->bytesWritten += 1 + InstrList_Write(gen->code, gen->output);
+    gen->seconds += now() - start;
+    InstrList_Clear(gen->code);
+    return ERROR_OK;
+}
+
+static unsigned newLabel(Codegen *gen) {
+    return ++gen->labelCount;
+}
+
+// Makes the owned label the current function's, its internal labels are label%N
+static ErrorType beginFunction(Codegen *gen, char *label) {
+    if (label == nullptr) return ERROR_OTHER;
+    free(gen->function);
+    free(gen->labelName);
+    gen->function = label;
+    gen->labelPrefix = strlen(label) + 1;
+    gen->labelName = malloc(gen->labelPrefix + 24);
+    if (gen->labelName == nullptr) return ERROR_OTHER;
+    memcpy(gen->labelName, label, gen->labelPrefix - 1);
+    gen->labelName[gen->labelPrefix - 1] = '%';
+    gen->labelName[gen->labelPrefix] = '\0';
+    gen->labelCount = 0;
+    return ERROR_OK;
+}
+
+// Only the number is written behind the prefix, the name is valid until the next call
+static const char *labelName(const Codegen *gen, const unsigned label) {
+    Format_Unsigned(gen->labelName + gen->labelPrefix, label);
+    return gen->labelName;
+}
+
+static void emitLabel(const Codegen *gen, const unsigned label) {
+    emitInstr(gen, OP_LABEL, labelName(gen, label), nullptr, nullptr);
+}
+
+static void emitJump(const Codegen *gen, const unsigned label) {
+    emitInstr(gen, OP_JUMP, labelName(gen, label), nullptr, nullptr);
+}
+
+// JUMPIFEQ / JUMPIFNEQ, or their stack variants without left and right
+static void emitBranch(const Codegen *gen, const Opcode opcode, const unsigned label, const char *left,
+                       const char *right) {
+    emitInstr(gen, opcode, labelName(gen, label), left, right);
+}
+
+// Locals are written through the frame slot they were allocated
+static const char *variableName(const Codegen *gen, const ASTNode *variable) {
+    return Frame_Slot(gen->frame, variable->token.identifier);
+}
+
+// Text of the variable or literal node as an operand, written into number if it is one
+static const char *symbolText(const Codegen *gen, const ASTNode *node, char number[static FORMAT_NUMBER_MAX]) {
+    switch (node->token.type) {
+        case TKTYPE_LITERAL_INT:
+            Format_Int(number, node->token.int_value);
+            return number;
+        case TKTYPE_LITERAL_FLOAT:
+            Format_Float(number, node->token.float_value);
+            return number;
+        case TKTYPE_LITERAL_STRING:
+            return StringPool_Encode(gen->strings, node->token.string_value);
+        case TKTYPE_LITERAL_BOOL:
+            return node->token.bool_value ? "bool@true" : "bool@false";
+        case TKTYPE_VARIABLE:
+            return variableName(gen, node);
+        case TKTYPE_LITERAL_NIL:
+        default:
+            return "nil@nil";
+    }
+}
+
+// instruction followed by the variable or literal node as its only operand
+static ErrorType emitSymbol(const Codegen *gen, const Opcode opcode, const ASTNode *node) {
+    char number[FORMAT_NUMBER_MAX];
+    const char *text = symbolText(gen, node, number);
+    if (text == nullptr) return ERROR_OTHER;
+    return InstrList_Insert(gen->code, gen->code->count, opcode, text, nullptr, nullptr);
+}
+
+// $name$suffix of a user function, returns the end of it like stpcpy
+static char *functionLabel(char *out, const char *name, const char *suffix) {
+    return stpcpy(stpcpy(stpcpy(stpcpy(out, "$"), name), "$"), suffix);
+}
+
+// CALL of the user function $name$suffix
+static void emitCall(const Codegen *gen, const char *name, const char *suffix) {
+    char buffer[128];
+    const size_t size = strlen(name) + strlen(suffix) + 3;
+    char *label = size <= sizeof buffer ? buffer : malloc(size);
+    if (label == nullptr) {
+        gen->code->failed = true;
+        return;
+    }
+    functionLabel(label, name, suffix);
+    emitInstr(gen, OP_CALL, label, nullptr, nullptr);
+    if (label != buffer) free(label);
+}
+
+// TF@%index, the index-th argument of a call being made
+static const char *argumentName(char out[static FORMAT_NUMBER_MAX + 4], const size_t index) {
+    Format_Unsigned(stpcpy(out, "TF@%"), index);
+    return out;
+}
+
+// routine%suffix, an internal label of a runtime routine
+static const char *routineLabel(char out[static ROUTINE_LABEL_MAX], const char *routine, const char *suffix) {
+    stpcpy(stpcpy(stpcpy(out, routine), "%"), suffix);
+    return out;
+}
+
+// Globals are only known once they are used, they get defined in Codegen_Finish
+static ErrorType noteVariable(const Codegen *gen, const ASTNode *node) {
+    const char *name = node->token.identifier;
+    if (strncmp(name, "GF@", 3) != 0) return ERROR_OK;
+    const ErrorType error = Symtable_Declare(gen->globals, name, nullptr);
+    return error == ERROR_SEMANTIC_REDEFINITION ? ERROR_OK : error;
+}
+
+static const char *inbuiltLabel(const INBUILTFUNCTION_TYPE type) {
+    switch (type) {
+        case INBUILT_STRING:
+            return "$Ifj$str";
+        case INBUILT_WRITE:
+            return "$Ifj$write";
+        case INBUILT_READNUM:
+            return "$Ifj$read_num";
+        case INBUILT_FLOOR:
+        default:
+            return "$Ifj$floor";
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Expressions, evaluated on the data stack
+
+// Variables and literals can be used as an instruction operand
+static bool isPure(const ASTNode *node) {
+    return node->token.type == TKTYPE_VARIABLE ||
+           (node->token.type >= TKTYPE_LITERAL_INT && node->token.type <= TKTYPE_LITERAL_BOOL);
+}
+
+static ErrorType genExpression(Codegen *gen, const ASTNode *expression);
+
+// Built-ins whose argument types allow plain instructions instead of a call of the runtime routine
+static bool isLowerable(const ASTNode *call) {
+    const ValueType type = ASTNode_childCount(call) > 1 ? ASTNode_child(call, 1)->type : VT_NONE;
+    switch (ASTNode_child(call, 0)->token.inbuilt_function_type) {
+        case INBUILT_WRITE:
+            return type == VT_STRING || type == VT_INT || type == VT_BOOL || type == VT_NIL || type == VT_FLOAT;
+        case INBUILT_STRING:
+            return type == VT_STRING || type == VT_INT || type == VT_FLOAT || type == VT_NIL;
+        case INBUILT_FLOOR:
+            return type == VT_INT || type == VT_FLOAT;
+        case INBUILT_READNUM:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static ErrorType genWrite(Codegen *gen, const ASTNode *argument) {
+    ErrorType error;
+    if (argument->type == VT_NIL) {
+        if ((error = genExpression(gen, argument)) != ERROR_OK) return error;
+        emitInstr(gen, OP_POPS, VAR_A, nullptr, nullptr);
+        emitInstr(gen, OP_WRITE, "string@null", nullptr, nullptr);
+        return ERROR_OK;
+    }
+    if (argument->token.type == TKTYPE_LITERAL_FLOAT) {
+        const double value = argument->token.float_value;
+        // integral floats are printed as integers
+        char number[FORMAT_NUMBER_MAX];
+        if (value > -1e18 && value < 1e18 && value == (double) (long long) value) {
+            Format_Int(number, (long long) value);
+        } else {
+            Format_Float(number, value);
+        }
+        emitInstr(gen, OP_WRITE, number, nullptr, nullptr);
+        return ERROR_OK;
+    }
+    if (argument->type != VT_FLOAT && isPure(argument)) {
+        if (argument->token.type == TKTYPE_VARIABLE && (error = noteVariable(gen, argument)) != ERROR_OK) return error;
+        return emitSymbol(gen, OP_WRITE, argument);
+    }
+    if ((error = genExpression(gen, argument)) != ERROR_OK) return error;
+    emitInstr(gen, OP_POPS, VAR_A, nullptr, nullptr);
+    if (argument->type == VT_FLOAT) {
+        // integral floats are printed as integers
+        const unsigned print = newLabel(gen);
+        emitInstr(gen, OP_ISINT, VAR_TA, VAR_A, nullptr);
+        emitBranch(gen, OP_JUMPIFEQ, print, VAR_TA, "bool@false");
+        emitInstr(gen, OP_FLOAT2INT, VAR_A, VAR_A, nullptr);
+        emitLabel(gen, print);
+    }
+    emitInstr(gen, OP_WRITE, VAR_A, nullptr, nullptr);
+    return ERROR_OK;
+}
+
+static ErrorType genLoweredInbuilt(Codegen *gen, const ASTNode *call, const bool keepResult) {
+    ErrorType error;
+    const INBUILTFUNCTION_TYPE type = ASTNode_child(call, 0)->token.inbuilt_function_type;
+    gen->inbuiltsLowered++;
+    if (type == INBUILT_WRITE) {
+        if ((error = genWrite(gen, ASTNode_child(call, 1))) != ERROR_OK) return error;
+        if (keepResult) emitInstr(gen, OP_PUSHS, "nil@nil", nullptr, nullptr);
+        return ERROR_OK;
+    }
+    if (type == INBUILT_READNUM) {
+        emitInstr(gen, OP_READ, VAR_A, "float", nullptr);
+    } else {
+        const ASTNode *argument = ASTNode_child(call, 1);
+        if ((error = genExpression(gen, argument)) != ERROR_OK) return error;
+        if (type == INBUILT_STRING && argument->type == VT_NIL) {
+            emitInstr(gen, OP_POPS, VAR_A, nullptr, nullptr);
+            emitInstr(gen, OP_MOVE, VAR_A, "string@null", nullptr);
+        } else {
+            // str of a string and floor of an int are the argument itself
+            if (type == INBUILT_STRING && argument->type == VT_INT) emitOp(gen, OP_INT2STRS);
+            if (type == INBUILT_STRING && argument->type == VT_FLOAT) emitOp(gen, OP_FLOAT2STRS);
+            if (type == INBUILT_FLOOR && argument->type == VT_FLOAT) emitOp(gen, OP_FLOAT2INTS);
+            if (!keepResult) emitInstr(gen, OP_POPS, VAR_A, nullptr, nullptr);
+            return ERROR_OK;
+        }
+    }
+    if (keepResult) emitInstr(gen, OP_PUSHS, VAR_A, nullptr, nullptr);
+    return ERROR_OK;
+}
+
+static ErrorType genCall(Codegen *gen, const ASTNode *call, const bool keepResult) {
+    ErrorType error;
+    const ASTNode *callee = ASTNode_child(call, 0);
+    if (callee->token.type == TKTYPE_INBUILTFUNCTION && isLowerable(call)) {
+        return genLoweredInbuilt(gen, call, keepResult);
+    }
+    const size_t count = ASTNode_childCount(call) - 1;
+    for (size_t i = 1; i <= count; i++) {
+        if ((error = genExpression(gen, ASTNode_child(call, i))) != ERROR_OK) return error;
+    }
+
+    char argument[FORMAT_NUMBER_MAX + 4];
+    emitOp(gen, OP_CREATEFRAME);
+    for (size_t i = 1; i <= count; i++) {
+        emitInstr(gen, OP_DEFVAR, argumentName(argument, i), nullptr, nullptr);
+    }
+    for (size_t i = count; i >= 1; i--) {
+        emitInstr(gen, OP_POPS, argumentName(argument, i), nullptr, nullptr);
+    }
+    if (callee->token.type == TKTYPE_INBUILTFUNCTION) {
+        gen->inbuilts |= 1u << callee->token.inbuilt_function_type;
+        emitInstr(gen, OP_CALL, inbuiltLabel(callee->token.inbuilt_function_type), nullptr, nullptr);
+    } else {
+        char arity[FORMAT_NUMBER_MAX];
+        Format_Unsigned(arity, count);
+        emitCall(gen, callee->token.identifier, arity);
+    }
+    // the result is left on the stack
+    if (!keepResult) emitInstr(gen, OP_POPS, VAR_A, nullptr, nullptr);
+    return ERROR_OK;
+}
+
+static ErrorType genBlock(Codegen *gen, const ASTNode *block);
+
+/*
+ * Inlined call: the arguments go into the renamed parameters in the caller's
+ * frame, a return inside the body leaves its value on the stack and jumps to
+ * the end of the copy.
+ */
+static ErrorType genInline(Codegen *gen, const ASTNode *call, const bool keepResult) {
+    ErrorType error;
+    const ASTNode *params = ASTNode_child(call, 0);
+    const size_t count = ASTNode_childCount(params);
+    const ASTNode *body = ASTNode_child(call, ASTNode_childCount(call) - 1);
+    for (size_t i = 1; i <= count; i++) {
+        if ((error = genExpression(gen, ASTNode_child(call, i))) != ERROR_OK) return error;
+    }
+    for (size_t i = count; i >= 1; i--) {
+        emitInstr(gen, OP_POPS, variableName(gen, ASTNode_child(params, i - 1)), nullptr, nullptr);
+    }
+
+    const unsigned outerEnd = gen->inlineEnd;
+    const unsigned outerDepth = gen->inlineDepth;
+    gen->inlineEnd = newLabel(gen);
+    gen->inlineDepth++;
+    error = genBlock(gen, body);
+    if (error == ERROR_OK) {
+        const ASTNode *last = ASTNode_child(body, ASTNode_childCount(body) - 1);
+        if (last == nullptr || last->token.type != TKTYPE_KEYWORD || last->token.keyword_type != KWTYPE_RETURN) {
+            emitInstr(gen, OP_PUSHS, "nil@nil", nullptr, nullptr);
+        }
+        emitLabel(gen, gen->inlineEnd);
+        if (!keepResult) emitInstr(gen, OP_POPS, VAR_A, nullptr, nullptr);
+    }
+    gen->inlineEnd = outerEnd;
+    gen->inlineDepth = outerDepth;
+    return error;
+}
+
+/*
+ * Makes VAR_A and VAR_B (with types in VAR_TA, VAR_TB) the same numeric type,
+ * converting an int operand to float if the other one is a float. Jumps to
+ * failure when either operand is not a Num.
+ */
+static void genNumericOperands(Codegen *gen, const unsigned failure) {
+    const unsigned leftOk = newLabel(gen);
+    const unsigned rightOk = newLabel(gen);
+    const unsigned same = newLabel(gen);
+    const unsigned leftInt = newLabel(gen);
+
+    emitBranch(gen, OP_JUMPIFEQ, leftOk, VAR_TA, "string@int");
+    emitBranch(gen, OP_JUMPIFNEQ, failure, VAR_TA, "string@float");
+    emitLabel(gen, leftOk);
+    emitBranch(gen, OP_JUMPIFEQ, rightOk, VAR_TB, "string@int");
+    emitBranch(gen, OP_JUMPIFNEQ, failure, VAR_TB, "string@float");
+    emitLabel(gen, rightOk);
+    emitBranch(gen, OP_JUMPIFEQ, same, VAR_TA, VAR_TB);
+    emitBranch(gen, OP_JUMPIFEQ, leftInt, VAR_TA, "string@int");
+    emitInstr(gen, OP_INT2FLOAT, VAR_B, VAR_B, nullptr);
+    emitInstr(gen, OP_MOVE, VAR_TB, "string@float", nullptr);
+    emitJump(gen, same);
+    emitLabel(gen, leftInt);
+    emitInstr(gen, OP_INT2FLOAT, VAR_A, VAR_A, nullptr);
+    emitInstr(gen, OP_MOVE, VAR_TA, "string@float", nullptr);
+    emitLabel(gen, same);
+}
+
+// Converts the value in variable to a bool: null is false, a bool stays, anything else is true
+static void genTruthiness(Codegen *gen, const char *variable, const char *type) {
+    const unsigned done = newLabel(gen);
+    emitInstr(gen, OP_TYPE, type, variable, nullptr);
+    emitBranch(gen, OP_JUMPIFEQ, done, type, "string@bool");
+    emitInstr(gen, OP_EQ, variable, type, "string@nil");
+    emitInstr(gen, OP_NOT, variable, variable, nullptr);
+    emitLabel(gen, done);
+}
+
+// VAR_R = VAR_A repeated VAR_B (an int) times
+static void genRepeatLoop(Codegen *gen, const unsigned done) {
+    const unsigned loop = newLabel(gen);
+    emitInstr(gen, OP_MOVE, VAR_R, "string@", nullptr);
+    emitLabel(gen, loop);
+    emitInstr(gen, OP_GT, VAR_TB, VAR_B, "int@0");
+    emitBranch(gen, OP_JUMPIFEQ, done, VAR_TB, "bool@false");
+    emitInstr(gen, OP_CONCAT, VAR_R, VAR_R, VAR_A);
+    emitInstr(gen, OP_SUB, VAR_B, VAR_B, "int@1");
+    emitJump(gen, loop);
+}
+
+static void genRepeat(Codegen *gen, const unsigned failure, const unsigned done) {
+    const unsigned count = newLabel(gen);
+    emitBranch(gen, OP_JUMPIFEQ, count, VAR_TB, "string@int");
+    emitBranch(gen, OP_JUMPIFNEQ, failure, VAR_TB, "string@float");
+    emitInstr(gen, OP_ISINT, VAR_R, VAR_B, nullptr);
+    emitBranch(gen, OP_JUMPIFEQ, failure, VAR_R, "bool@false");
+    emitInstr(gen, OP_FLOAT2INT, VAR_B, VAR_B, nullptr);
+    emitLabel(gen, count);
+    genRepeatLoop(gen, done);
+}
+
+static bool isExactly(const ValueType type, const ValueType set) {
+    return type != VT_NONE && (type & ~set) == 0;
+}
+
+static bool isSingleNumber(const ValueType type) {
+    return type == VT_INT || type == VT_FLOAT;
+}
+
+// Converts the int operand(s) on top of the stack to float
+static void genFloatOperands(const Codegen *gen, const ValueType left, const ValueType right, const bool both) {
+    if (right == VT_INT && (both || left == VT_FLOAT)) emitOp(gen, OP_INT2FLOATS);
+    if (left == VT_INT && (both || right == VT_FLOAT)) {
+        emitInstr(gen, OP_POPS, VAR_B, nullptr, nullptr);
+        emitOp(gen, OP_INT2FLOATS);
+        emitInstr(gen, OP_PUSHS, VAR_B, nullptr, nullptr);
+    }
+}
+
+/*
+ * Both operands are on the stack. When their types are proven the operation is
+ * emitted as plain stack instructions without any TYPE dispatch; returns false
+ * if the dynamic sequence is needed.
+ */
+static bool genDirectBinary(Codegen *gen, const OPERATOR_TYPE operator, const ValueType left,
+                            const ValueType right) {
+    switch (operator) {
+        case OPTYPE_PLUS:
+            if (left == VT_STRING && right == VT_STRING) {
+                emitInstr(gen, OP_POPS, VAR_B, nullptr, nullptr);
+                emitInstr(gen, OP_POPS, VAR_A, nullptr, nullptr);
+                emitInstr(gen, OP_CONCAT, VAR_A, VAR_A, VAR_B);
+                emitInstr(gen, OP_PUSHS, VAR_A, nullptr, nullptr);
+                return true;
+            }
+            [[fallthrough]];
+        case OPTYPE_MINUS:
+        case OPTYPE_MULTIPLY:
+        case OPTYPE_LESS:
+        case OPTYPE_GREATER:
+        case OPTYPE_LESSEQUAL:
+        case OPTYPE_GREATEREQUAL:
+            if (operator == OPTYPE_MULTIPLY && left == VT_STRING && right == VT_INT) {
+                const unsigned done = newLabel(gen);
+                emitInstr(gen, OP_POPS, VAR_B, nullptr, nullptr);
+                emitInstr(gen, OP_POPS, VAR_A, nullptr, nullptr);
+                genRepeatLoop(gen, done);
+                emitLabel(gen, done);
+                emitInstr(gen, OP_PUSHS, VAR_R, nullptr, nullptr);
+                return true;
+            }
+            if (!isSingleNumber(left) || !isSingleNumber(right)) return false;
+            genFloatOperands(gen, left, right, false);
+            switch (operator) {
+                case OPTYPE_PLUS:
+                    emitOp(gen, OP_ADDS);
+                    break;
+                case OPTYPE_MINUS:
+                    emitOp(gen, OP_SUBS);
+                    break;
+                case OPTYPE_MULTIPLY:
+                    emitOp(gen, OP_MULS);
+                    break;
+                case OPTYPE_LESS:
+                    emitOp(gen, OP_LTS);
+                    break;
+                case OPTYPE_GREATER:
+                    emitOp(gen, OP_GTS);
+                    break;
+                case OPTYPE_LESSEQUAL:
+                    emitOp(gen, OP_GTS);
+                    emitOp(gen, OP_NOTS);
+                    break;
+                default:
+                    emitOp(gen, OP_LTS);
+                    emitOp(gen, OP_NOTS);
+                    break;
+            }
+            return true;
+        case OPTYPE_DIVIDE:
+            if (!isSingleNumber(left) || !isSingleNumber(right)) return false;
+            genFloatOperands(gen, left, right, true);
+            emitOp(gen, OP_DIVS);
+            return true;
+        case OPTYPE_EQUAL:
+        case OPTYPE_NOTEQUAL:
+            if (left == VT_NIL || right == VT_NIL || (left == right && (left & (left - 1)) == 0)) {
+                // nil compares with anything, other values with their own type
+            } else if (isSingleNumber(left) && isSingleNumber(right)) {
+                genFloatOperands(gen, left, right, false);
+            } else if (isExactly(left, VT_ANY) && isExactly(right, VT_ANY) && (left & right) == 0 &&
+                       !(isExactly(left, VT_NUM) && isExactly(right, VT_NUM))) {
+                // disjoint types are never equal
+                emitInstr(gen, OP_POPS, VAR_A, nullptr, nullptr);
+                emitInstr(gen, OP_POPS, VAR_A, nullptr, nullptr);
+                emitInstr(gen, OP_PUSHS, operator == OPTYPE_EQUAL ? "bool@false" : "bool@true", nullptr, nullptr);
+                return true;
+            } else {
+                return false;
+            }
+            emitOp(gen, OP_EQS);
+            if (operator == OPTYPE_NOTEQUAL) emitOp(gen, OP_NOTS);
+            return true;
+        case OPTYPE_AND:
+        case OPTYPE_OR:
+            if (left != VT_BOOL || right != VT_BOOL) return false;
+            emitOp(gen, operator == OPTYPE_AND ? OP_ANDS : OP_ORS);
+            return true;
+        default:
+            return false;
+    }
+}
+
+static const char *helperLabel(const OPERATOR_TYPE operator) {
+    switch (operator) {
+        case OPTYPE_PLUS:
+            return "$$plus";
+        case OPTYPE_MINUS:
+            return "$$minus";
+        case OPTYPE_MULTIPLY:
+            return "$$multiply";
+        case OPTYPE_DIVIDE:
+            return "$$divide";
+        case OPTYPE_AND:
+            return "$$and";
+        case OPTYPE_OR:
+            return "$$or";
+        case OPTYPE_EQUAL:
+            return "$$equal";
+        case OPTYPE_NOTEQUAL:
+            return "$$notequal";
+        case OPTYPE_LESS:
+            return "$$less";
+        case OPTYPE_GREATER:
+            return "$$greater";
+        case OPTYPE_LESSEQUAL:
+            return "$$lessequal";
+        case OPTYPE_GREATEREQUAL:
+        default:
+            return "$$greaterequal";
+    }
+}
+
+static ErrorType genDynamicOperator(Codegen *gen, const OPERATOR_TYPE operator);
+
+/*
+ * Both operands are on the stack, left below right. Without proven types the
+ * TYPE dispatch is inlined, or with -O size left to a runtime routine unless
+ * the site is nested in enough loops to be hot.
+ */
+static ErrorType genOperator(Codegen *gen, const OPERATOR_TYPE operator, const ValueType left, const ValueType right) {
+    if (genDirectBinary(gen, operator, left, right)) {
+        gen->typeChecksElided++;
+        return ERROR_OK;
+    }
+    gen->typeChecks++;
+    if (gen->optimize == OPTIMIZE_SIZE && gen->loopDepth < HOT_LOOP_DEPTH) {
+        gen->helpers |= 1u << operator;
+        gen->helperCalls++;
+        emitOp(gen, OP_CREATEFRAME);
+        emitInstr(gen, OP_CALL, helperLabel(operator), nullptr, nullptr);
+        return ERROR_OK;
+    }
+    return genDynamicOperator(gen, operator);
+}
+
+static ErrorType genDynamicOperator(Codegen *gen, const OPERATOR_TYPE operator) {
+    const unsigned failure = newLabel(gen);
+    const unsigned done = newLabel(gen);
+    emitInstr(gen, OP_POPS, VAR_B, nullptr, nullptr);
+    emitInstr(gen, OP_POPS, VAR_A, nullptr, nullptr);
+    if (operator == OPTYPE_AND || operator == OPTYPE_OR) {
+        genTruthiness(gen, VAR_A, VAR_TA);
+        genTruthiness(gen, VAR_B, VAR_TB);
+        emitInstr(gen, operator == OPTYPE_AND ? OP_AND : OP_OR, VAR_A, VAR_A, VAR_B);
+        emitInstr(gen, OP_PUSHS, VAR_A, nullptr, nullptr);
+        return ERROR_OK;
+    }
+    emitInstr(gen, OP_TYPE, VAR_TA, VAR_A, nullptr);
+    emitInstr(gen, OP_TYPE, VAR_TB, VAR_B, nullptr);
+
+    switch (operator) {
+        case OPTYPE_PLUS: {
+            const unsigned numeric = newLabel(gen);
+            emitBranch(gen, OP_JUMPIFNEQ, numeric, VAR_TA, "string@string");
+            emitBranch(gen, OP_JUMPIFNEQ, failure, VAR_TB, "string@string");
+            emitInstr(gen, OP_CONCAT, VAR_A, VAR_A, VAR_B);
+            emitJump(gen, done);
+            emitLabel(gen, numeric);
+            genNumericOperands(gen, failure);
+            emitInstr(gen, OP_ADD, VAR_A, VAR_A, VAR_B);
+            break;
+        }
+        case OPTYPE_MINUS:
+            genNumericOperands(gen, failure);
+            emitInstr(gen, OP_SUB, VAR_A, VAR_A, VAR_B);
+            break;
+        case OPTYPE_MULTIPLY: {
+            const unsigned numeric = newLabel(gen);
+            const unsigned repeated = newLabel(gen);
+            emitBranch(gen, OP_JUMPIFNEQ, numeric, VAR_TA, "string@string");
+            genRepeat(gen, failure, repeated);
+            emitLabel(gen, repeated);
+            emitInstr(gen, OP_MOVE, VAR_A, VAR_R, nullptr);
+            emitJump(gen, done);
+            emitLabel(gen, numeric);
+            genNumericOperands(gen, failure);
+            emitInstr(gen, OP_MUL, VAR_A, VAR_A, VAR_B);
+            break;
+        }
+        case OPTYPE_DIVIDE: {
+            // Num division is always done in floating point
+            const unsigned floats = newLabel(gen);
+            genNumericOperands(gen, failure);
+            emitBranch(gen, OP_JUMPIFEQ, floats, VAR_TA, "string@float");
+            emitInstr(gen, OP_INT2FLOAT, VAR_A, VAR_A, nullptr);
+            emitInstr(gen, OP_INT2FLOAT, VAR_B, VAR_B, nullptr);
+            emitLabel(gen, floats);
+            emitInstr(gen, OP_DIV, VAR_A, VAR_A, VAR_B);
+            break;
+        }
+        case OPTYPE_LESS:
+        case OPTYPE_GREATEREQUAL:
+            genNumericOperands(gen, failure);
+            emitInstr(gen, OP_LT, VAR_A, VAR_A, VAR_B);
+            if (operator == OPTYPE_GREATEREQUAL) emitInstr(gen, OP_NOT, VAR_A, VAR_A, nullptr);
+            break;
+        case OPTYPE_GREATER:
+        case OPTYPE_LESSEQUAL:
+            genNumericOperands(gen, failure);
+            emitInstr(gen, OP_GT, VAR_A, VAR_A, VAR_B);
+            if (operator == OPTYPE_LESSEQUAL) emitInstr(gen, OP_NOT, VAR_A, VAR_A, nullptr);
+            break;
+        case OPTYPE_EQUAL:
+        case OPTYPE_NOTEQUAL: {
+            // values of different types are never equal, except int and float
+            const unsigned compare = newLabel(gen);
+            emitBranch(gen, OP_JUMPIFEQ, compare, VAR_TA, VAR_TB);
+            genNumericOperands(gen, failure);
+            emitLabel(gen, compare);
+            emitInstr(gen, OP_EQ, VAR_A, VAR_A, VAR_B);
+            if (operator == OPTYPE_NOTEQUAL) emitInstr(gen, OP_NOT, VAR_A, VAR_A, nullptr);
+            emitJump(gen, done);
+            emitLabel(gen, failure);
+            emitInstr(gen, OP_MOVE, VAR_A, operator == OPTYPE_EQUAL ? "bool@false" : "bool@true", nullptr);
+            emitLabel(gen, done);
+            emitInstr(gen, OP_PUSHS, VAR_A, nullptr, nullptr);
+            return ERROR_OK;
+        }
+        default:
+            return ERROR_OTHER;
+    }
+
+    emitJump(gen, done);
+    emitLabel(gen, failure);
+    emitInstr(gen, OP_EXIT, "int@26", nullptr, nullptr);
+    emitLabel(gen, done);
+    emitInstr(gen, OP_PUSHS, VAR_A, nullptr, nullptr);
+    return ERROR_OK;
+}
+
+static ValueType testedType(const ASTNode *test) {
+    switch (ASTNode_child(test, 1)->token.keyword_type) {
+        case KWTYPE_NUM:
+            return VT_NUM;
+        case KWTYPE_STRING:
+            return VT_STRING;
+        case KWTYPE_NULL:
+        default:
+            return VT_NIL;
+    }
+}
+
+static ErrorType genTypeTest(Codegen *gen, const ASTNode *test) {
+    const ASTNode *value = ASTNode_child(test, 0);
+    const ValueType tested = testedType(test);
+
+    // decided at compile time when the value's types are all inside or all outside the tested type
+    if (value->type != VT_NONE && (isExactly(value->type, tested) || (value->type & tested) == 0)) {
+        gen->typeChecksElided++;
+        if (!isPure(value)) {
+            const ErrorType error = genExpression(gen, value);
+            if (error != ERROR_OK) return error;
+            emitInstr(gen, OP_POPS, VAR_A, nullptr, nullptr);
+        }
+        emitInstr(gen, OP_PUSHS, (value->type & tested) ? "bool@true" : "bool@false", nullptr, nullptr);
+        return ERROR_OK;
+    }
+    gen->typeChecks++;
+
+    const ErrorType error = genExpression(gen, value);
+    if (error != ERROR_OK) return error;
+    emitInstr(gen, OP_POPS, VAR_A, nullptr, nullptr);
+    emitInstr(gen, OP_TYPE, VAR_TA, VAR_A, nullptr);
+    switch (tested) {
+        case VT_NUM: {
+            const unsigned done = newLabel(gen);
+            emitInstr(gen, OP_MOVE, VAR_A, "bool@true", nullptr);
+            emitBranch(gen, OP_JUMPIFEQ, done, VAR_TA, "string@int");
+            emitInstr(gen, OP_EQ, VAR_A, VAR_TA, "string@float");
+            emitLabel(gen, done);
+            break;
+        }
+        case VT_STRING:
+            emitInstr(gen, OP_EQ, VAR_A, VAR_TA, "string@string");
+            break;
+        default:
+            emitInstr(gen, OP_EQ, VAR_A, VAR_TA, "string@nil");
+            break;
+    }
+    emitInstr(gen, OP_PUSHS, VAR_A, nullptr, nullptr);
+    return ERROR_OK;
+}
+
+static ErrorType genBranch(Codegen *gen, const ASTNode *condition, unsigned label, bool jumpIf);
+
+static bool isStringConcat(const ASTNode *node) {
+    return node->token.type == TKTYPE_OPERATOR && node->token.operator_type == OPTYPE_PLUS &&
+           ASTNode_child(node, 0)->type == VT_STRING && ASTNode_child(node, 1)->type == VT_STRING;
+}
+
+static bool isStringLiteral(const ASTNode *node) {
+    return node->token.type == TKTYPE_LITERAL_STRING;
+}
+
+// Encoded value of the literals from pieces[*index] on, joined; *index moves past them
+static const char *joinLiterals(const Codegen *gen, const ASTNode **pieces, const size_t count, size_t *index) {
+    size_t length = 0;
+    size_t end = *index;
+    while (end < count && isStringLiteral(pieces[end])) length += strlen(pieces[end++]->token.string_value);
+    char *joined = malloc(length + 1);
+    if (joined == nullptr) return nullptr;
+    char *out = joined;
+    *out = '\0';
+    for (; *index < end; (*index)++) out = stpcpy(out, pieces[*index]->token.string_value);
+    const char *encoded = StringPool_Encode(gen->strings, joined);
+    free(joined);
+    return encoded;
+}
+
+/*
+ * A chain of + on proven strings. The first operand goes on the stack and
+ * every other one is appended to it by a single CONCAT; runs of literals are
+ * joined into one operand first.
+ */
+static ErrorType genConcat(Codegen *gen, const ASTNode *expression) {
+    size_t count = 1;
+    for (const ASTNode *node = expression; isStringConcat(node); node = ASTNode_child(node, 0)) count++;
+    const ASTNode **pieces = malloc(count * sizeof(ASTNode *));
+    if (pieces == nullptr) return ERROR_OTHER;
+    const ASTNode *node = expression;
+    for (size_t i = count; i-- > 1; node = ASTNode_child(node, 0)) pieces[i] = ASTNode_child(node, 1);
+    pieces[0] = node;
+
+    ErrorType error = ERROR_OK;
+    for (size_t i = 0; i < count && error == ERROR_OK;) {
+        const bool first = i == 0;
+        const ASTNode *piece = pieces[i];
+        if (isStringLiteral(piece)) {
+            const size_t start = i;
+            const char *encoded = joinLiterals(gen, pieces, count, &i);
+            if (encoded == nullptr) {
+                error = ERROR_OTHER;
+                break;
+            }
+            gen->literalsJoined += i - start - 1;
+            if (first) {
+                emitInstr(gen, OP_PUSHS, encoded, nullptr, nullptr);
+                continue;
+            }
+            emitInstr(gen, OP_POPS, VAR_A, nullptr, nullptr);
+            emitInstr(gen, OP_CONCAT, VAR_A, VAR_A, encoded);
+        } else if (!first && piece->token.type == TKTYPE_VARIABLE) {
+            i++;
+            if ((error = noteVariable(gen, piece)) != ERROR_OK) break;
+            emitInstr(gen, OP_POPS, VAR_A, nullptr, nullptr);
+            emitInstr(gen, OP_CONCAT, VAR_A, VAR_A, variableName(gen, piece));
+        } else {
+            i++;
+            if ((error = genExpression(gen, piece)) != ERROR_OK || first) continue;
+            emitInstr(gen, OP_POPS, VAR_B, nullptr, nullptr);
+            emitInstr(gen, OP_POPS, VAR_A, nullptr, nullptr);
+            emitInstr(gen, OP_CONCAT, VAR_A, VAR_A, VAR_B);
+        }
+        emitInstr(gen, OP_PUSHS, VAR_A, nullptr, nullptr);
+        gen->typeChecksElided++;
+    }
+    free(pieces);
+    return error;
+}
+
+// and / or whose right operand has to be skipped when the left one decides
+static ErrorType genLogical(Codegen *gen, const ASTNode *expression) {
+    const unsigned otherwise = newLabel(gen);
+    const unsigned done = newLabel(gen);
+    const ErrorType error = genBranch(gen, expression, otherwise, false);
+    if (error != ERROR_OK) return error;
+    emitInstr(gen, OP_PUSHS, "bool@true", nullptr, nullptr);
+    emitJump(gen, done);
+    emitLabel(gen, otherwise);
+    emitInstr(gen, OP_PUSHS, "bool@false", nullptr, nullptr);
+    emitLabel(gen, done);
+    return ERROR_OK;
+}
+
+static ErrorType genExpression(Codegen *gen, const ASTNode *expression) {
+    ErrorType error;
+    switch (expression->token.type) {
+        case TKTYPE_VARIABLE:
+            if ((error = noteVariable(gen, expression)) != ERROR_OK) return error;
+            [[fallthrough]];
+        case TKTYPE_LITERAL_INT:
+        case TKTYPE_LITERAL_FLOAT:
+        case TKTYPE_LITERAL_STRING:
+        case TKTYPE_LITERAL_NIL:
+        case TKTYPE_LITERAL_BOOL:
+            return emitSymbol(gen, OP_PUSHS, expression);
+        case TKTYPE_IDENTIFIER:
+            // getter
+            emitOp(gen, OP_CREATEFRAME);
+            emitCall(gen, expression->token.identifier, "get");
+            return ERROR_OK;
+        case TKTYPE_PUNCTUATION:
+            return genCall(gen, expression, true);
+        case TKTYPE_KEYWORD:
+            if (expression->token.keyword_type == KWTYPE_STATIC) return genInline(gen, expression, true);
+            return genTypeTest(gen, expression);
+        case TKTYPE_OPERATOR:
+            if (isStringConcat(expression)) return genConcat(gen, expression);
+            if ((expression->token.operator_type == OPTYPE_AND || expression->token.operator_type == OPTYPE_OR) &&
+                !isPure(ASTNode_child(expression, 1))) {
+                return genLogical(gen, expression);
+            }
+            for (size_t i = 0; i < ASTNode_childCount(expression); i++) {
+                if ((error = genExpression(gen, ASTNode_child(expression, i))) != ERROR_OK) return error;
+            }
+            if (expression->token.operator_type == OPTYPE_NOT) {
+                if (ASTNode_child(expression, 0)->type == VT_BOOL) {
+                    gen->typeChecksElided++;
+                    emitOp(gen, OP_NOTS);
+                    return ERROR_OK;
+                }
+                gen->typeChecks++;
+                emitInstr(gen, OP_POPS, VAR_A, nullptr, nullptr);
+                genTruthiness(gen, VAR_A, VAR_TA);
+                emitInstr(gen, OP_NOT, VAR_A, VAR_A, nullptr);
+                emitInstr(gen, OP_PUSHS, VAR_A, nullptr, nullptr);
+                return ERROR_OK;
+            }
+            return genOperator(gen, expression->token.operator_type, ASTNode_child(expression, 0)->type,
+                               ASTNode_child(expression, 1)->type);
+        default:
+            return ERROR_OTHER;
+    }
+}
+
+static bool canCompareDirectly(const OPERATOR_TYPE operator, const ValueType left, const ValueType right) {
+    if (isSingleNumber(left) && isSingleNumber(right)) return true;
+    if (operator != OPTYPE_EQUAL && operator != OPTYPE_NOTEQUAL) return false;
+    return left == VT_NIL || right == VT_NIL || (left == right && (left & (left - 1)) == 0);
+}
+
+// Both operands are on the stack; jumps to label when the comparison gives jumpIf
+static ErrorType genComparisonBranch(Codegen *gen, const OPERATOR_TYPE operator, const ValueType left,
+                                     const ValueType right, const unsigned label, const bool jumpIf) {
+    if (!canCompareDirectly(operator, left, right)) {
+        const ErrorType error = genOperator(gen, operator, left, right);
+        if (error != ERROR_OK) return error;
+        emitInstr(gen, OP_PUSHS, jumpIf ? "bool@true" : "bool@false", nullptr, nullptr);
+        emitBranch(gen, OP_JUMPIFEQS, label, nullptr, nullptr);
+        return ERROR_OK;
+    }
+    gen->typeChecksElided++;
+    if (isSingleNumber(left) && isSingleNumber(right)) genFloatOperands(gen, left, right, false);
+    // a != b, a <= b and a >= b jump on the opposite result of a == b, a > b and a < b
+    const bool negated = operator == OPTYPE_NOTEQUAL || operator == OPTYPE_LESSEQUAL ||
+                         operator == OPTYPE_GREATEREQUAL;
+    const bool wanted = jumpIf != negated;
+    if (operator == OPTYPE_EQUAL || operator == OPTYPE_NOTEQUAL) {
+        emitBranch(gen, wanted ? OP_JUMPIFEQS : OP_JUMPIFNEQS, label, nullptr, nullptr);
+        return ERROR_OK;
+    }
+    emitOp(gen, operator == OPTYPE_LESS || operator == OPTYPE_GREATEREQUAL ? OP_LTS : OP_GTS);
+    emitInstr(gen, OP_PUSHS, wanted ? "bool@true" : "bool@false", nullptr, nullptr);
+    emitBranch(gen, OP_JUMPIFEQS, label, nullptr, nullptr);
+    return ERROR_OK;
+}
+
+// The value is on the stack; null and false are false, anything else is true
+static void genTruthBranch(Codegen *gen, ValueType type, const unsigned label, const bool jumpIf) {
+    if (type == VT_BOOL) {
+        gen->typeChecksElided++;
+        emitInstr(gen, OP_PUSHS, jumpIf ? "bool@true" : "bool@false", nullptr, nullptr);
+        emitBranch(gen, OP_JUMPIFEQS, label, nullptr, nullptr);
+        return;
+    }
+    emitInstr(gen, OP_POPS, VAR_A, nullptr, nullptr);
+    if (type == VT_NONE) type = VT_ANY;
+    if (isExactly(type, VT_NIL | VT_BOOL)) {
+        // nil compares with a bool without a type error
+        gen->typeChecksElided++;
+        if (jumpIf) {
+            if (type & VT_BOOL) emitBranch(gen, OP_JUMPIFEQ, label, VAR_A, "bool@true");
+            return;
+        }
+        if (type & VT_NIL) emitBranch(gen, OP_JUMPIFEQ, label, VAR_A, "nil@nil");
+        if (type & VT_BOOL) emitBranch(gen, OP_JUMPIFEQ, label, VAR_A, "bool@false");
+        return;
+    }
+
+    const unsigned skip = newLabel(gen);
+    if (type & VT_NIL) emitBranch(gen, OP_JUMPIFEQ, jumpIf ? skip : label, VAR_A, "nil@nil");
+    if (type & VT_BOOL) {
+        gen->typeChecks++;
+        emitInstr(gen, OP_TYPE, VAR_TA, VAR_A, nullptr);
+        emitBranch(gen, OP_JUMPIFNEQ, jumpIf ? label : skip, VAR_TA, "string@bool");
+        emitBranch(gen, OP_JUMPIFEQ, label, VAR_A, jumpIf ? "bool@true" : "bool@false");
+    } else {
+        gen->typeChecksElided++;
+        if (jumpIf) emitJump(gen, label);
+    }
+    emitLabel(gen, skip);
+}
+
+/*
+ * Evaluates a condition and jumps to label when its truth is jumpIf, falling
+ * through otherwise. Comparisons jump on their result directly, not and the
+ * logical operators only move the jumps around, so the right operand of
+ * and / or is skipped once the left one decides.
+ */
+static ErrorType genBranch(Codegen *gen, const ASTNode *condition, const unsigned label, const bool jumpIf) {
+    ErrorType error;
+    if (condition->token.type == TKTYPE_OPERATOR) {
+        const ASTNode *left = ASTNode_child(condition, 0);
+        switch (condition->token.operator_type) {
+            case OPTYPE_NOT:
+                return genBranch(gen, left, label, !jumpIf);
+            case OPTYPE_AND:
+            case OPTYPE_OR: {
+                const ASTNode *right = ASTNode_child(condition, 1);
+                // the left operand decides when it is false for and, true for or
+                const bool decisive = condition->token.operator_type == OPTYPE_OR;
+                if (jumpIf == decisive) {
+                    if ((error = genBranch(gen, left, label, jumpIf)) != ERROR_OK) return error;
+                    return genBranch(gen, right, label, jumpIf);
+                }
+                const unsigned skip = newLabel(gen);
+                if ((error = genBranch(gen, left, skip, decisive)) != ERROR_OK) return error;
+                if ((error = genBranch(gen, right, label, jumpIf)) != ERROR_OK) return error;
+                emitLabel(gen, skip);
+                return ERROR_OK;
+            }
+            case OPTYPE_EQUAL:
+            case OPTYPE_NOTEQUAL:
+            case OPTYPE_LESS:
+            case OPTYPE_GREATER:
+            case OPTYPE_LESSEQUAL:
+            case OPTYPE_GREATEREQUAL: {
+                const ASTNode *right = ASTNode_child(condition, 1);
+                if ((error = genExpression(gen, left)) != ERROR_OK) return error;
+                if ((error = genExpression(gen, right)) != ERROR_OK) return error;
+                return genComparisonBranch(gen, condition->token.operator_type, left->type, right->type, label,
+                                           jumpIf);
+            }
+            default:
+                break;
+        }
+    }
+    if ((error = genExpression(gen, condition)) != ERROR_OK) return error;
+    genTruthBranch(gen, condition->type, label, jumpIf);
+    return ERROR_OK;
+}
+
+// ---------------------------------------------------------------------------
+// Statements
+
+static ErrorType genStatement(Codegen *gen, const ASTNode *statement);
+
+// Ifj.write of a literal other than a float, whose text is known
+static bool isConstantWrite(const ASTNode *statement) {
+    if (statement->token.type != TKTYPE_PUNCTUATION || statement->token.punctuation_type != PTTYPE_OPENPARENTHESIS) {
+        return false;
+    }
+    const ASTNode *callee = ASTNode_child(statement, 0);
+    if (callee->token.type != TKTYPE_INBUILTFUNCTION || callee->token.inbuilt_function_type != INBUILT_WRITE) {
+        return false;
+    }
+    const TokenType type = ASTNode_child(statement, 1)->token.type;
+    return type == TKTYPE_LITERAL_STRING || type == TKTYPE_LITERAL_INT || type == TKTYPE_LITERAL_BOOL ||
+           type == TKTYPE_LITERAL_NIL;
+}
+
+// Appends the text Ifj.write gives literal to the growing text
+static bool appendConstant(char **text, size_t *length, size_t *capacity, const Token *literal) {
+    char number[FORMAT_NUMBER_MAX];
+    const char *piece;
+    switch (literal->type) {
+        case TKTYPE_LITERAL_STRING:
+            piece = literal->string_value;
+            break;
+        case TKTYPE_LITERAL_INT:
+            Format_Decimal(number, literal->int_value);
+            piece = number;
+            break;
+        case TKTYPE_LITERAL_BOOL:
+            piece = literal->bool_value ? "true" : "false";
+            break;
+        default:
+            piece = "null";
+            break;
+    }
+    const size_t size = strlen(piece);
+    if (*length + size + 1 > *capacity) {
+        size_t newCapacity = *capacity ? *capacity * 2 : 64;
+        while (newCapacity < *length + size + 1) newCapacity *= 2;
+        char *grown = realloc(*text, newCapacity);
+        if (grown == nullptr) return false;
+        *text = grown;
+        *capacity = newCapacity;
+    }
+    memcpy(*text + *length, piece, size + 1);
+    *length += size;
+    return true;
+}
+
+// Constant writes from statement first to end become a single WRITE of their joined text
+static ErrorType genConstantWrites(Codegen *gen, const ASTNode *block, const size_t first, const size_t end) {
+    char *text = nullptr;
+    size_t length = 0;
+    size_t capacity = 0;
+    for (size_t i = first; i < end; i++) {
+        if (!appendConstant(&text, &length, &capacity, &ASTNode_child(ASTNode_child(block, i), 1)->token)) {
+            free(text);
+            return ERROR_OTHER;
+        }
+    }
+    const char *encoded = StringPool_Encode(gen->strings, text);
+    free(text);
+    if (encoded == nullptr) return ERROR_OTHER;
+    emitInstr(gen, OP_WRITE, encoded, nullptr, nullptr);
+    gen->inbuiltsLowered++;
+    gen->writesMerged += end - first - 1;
+    return ERROR_OK;
+}
+
+static ErrorType genBlock(Codegen *gen, const ASTNode *block) {
+    const size_t count = ASTNode_childCount(block);
+    for (size_t i = 0; i < count;) {
+        ErrorType error;
+        size_t end = i;
+        while (end < count && isConstantWrite(ASTNode_child(block, end))) end++;
+        if (end - i > 1) {
+            error = genConstantWrites(gen, block, i, end);
+            i = end;
+        } else {
+            error = genStatement(gen, ASTNode_child(block, i++));
+        }
+        if (error != ERROR_OK) return error;
+    }
+    return ERROR_OK;
+}
+
+static ErrorType genAssignment(Codegen *gen, const ASTNode *target, const ASTNode *value) {
+    ErrorType error;
+    if ((error = genExpression(gen, value)) != ERROR_OK) return error;
+    if (target->token.type == TKTYPE_VARIABLE) {
+        if ((error = noteVariable(gen, target)) != ERROR_OK) return error;
+        emitInstr(gen, OP_POPS, variableName(gen, target), nullptr, nullptr);
+        return ERROR_OK;
+    }
+    // setter
+    emitOp(gen, OP_CREATEFRAME);
+    emitInstr(gen, OP_DEFVAR, "TF@%1", nullptr, nullptr);
+    emitInstr(gen, OP_POPS, "TF@%1", nullptr, nullptr);
+    emitCall(gen, target->token.identifier, "set");
+    emitInstr(gen, OP_POPS, VAR_A, nullptr, nullptr);
+    return ERROR_OK;
+}
+
+// Self call in a tail position: new arguments for the parameters, then back to the start of the body
+static ErrorType genTailCall(Codegen *gen, const ASTNode *call) {
+    ErrorType error;
+    const size_t count = ASTNode_childCount(call) - 1;
+    for (size_t i = 1; i <= count; i++) {
+        if ((error = genExpression(gen, ASTNode_child(call, i))) != ERROR_OK) return error;
+    }
+    const ASTNode *params = ASTNode_child(gen->current, 1);
+    for (size_t i = count; i >= 1; i--) {
+        emitInstr(gen, OP_POPS, variableName(gen, ASTNode_child(params, i - 1)), nullptr, nullptr);
+    }
+    emitJump(gen, gen->entry);
+    gen->tailCalls++;
+    return ERROR_OK;
+}
+
+// Combines the value on the stack with the pending operands, if there are any
+static ErrorType genAccumulate(Codegen *gen) {
+    const unsigned none = newLabel(gen);
+    emitBranch(gen, OP_JUMPIFEQ, none, VAR_PENDING, "bool@false");
+    emitInstr(gen, OP_POPS, VAR_R, nullptr, nullptr);
+    emitInstr(gen, OP_PUSHS, VAR_ACC, nullptr, nullptr);
+    emitInstr(gen, OP_PUSHS, VAR_R, nullptr, nullptr);
+    const ErrorType error = genOperator(gen, gen->accumulator, VT_ANY, VT_ANY);
+    emitLabel(gen, none);
+    return error;
+}
+
+// The result is on the stack
+static ErrorType genReturn(Codegen *gen) {
+    if (gen->accumulating) {
+        const ErrorType error = genAccumulate(gen);
+        if (error != ERROR_OK) return error;
+    }
+    emitOp(gen, OP_POPFRAME);
+    emitOp(gen, OP_RETURN);
+    return ERROR_OK;
+}
+
+static size_t countNodes(const ASTNode *node) {
+    size_t count = 1;
+    for (size_t i = 0; i < ASTNode_childCount(node); i++) count += countNodes(ASTNode_child(node, i));
+    return count;
+}
+
+/*
+ * Rotated: the test is repeated after the body and jumps back to it, so an
+ * iteration takes a single conditional jump. A larger condition is not copied,
+ * the loop is entered by a jump to the test at the bottom instead.
+ */
+static ErrorType genWhile(Codegen *gen, const ASTNode *loop) {
+    const ASTNode *condition = ASTNode_child(loop, 0);
+    const unsigned body = newLabel(gen);
+    const unsigned test = newLabel(gen);
+    const unsigned end = newLabel(gen);
+    ErrorType error;
+    gen->loopDepth++;
+    if (countNodes(condition) <= ROTATE_MAX_CONDITION) {
+        if ((error = genBranch(gen, condition, end, false)) != ERROR_OK) return error;
+    } else {
+        emitJump(gen, test);
+    }
+    emitLabel(gen, body);
+    if ((error = genBlock(gen, ASTNode_child(loop, 1))) != ERROR_OK) return error;
+    emitLabel(gen, test);
+    if ((error = genBranch(gen, condition, body, true)) != ERROR_OK) return error;
+    emitLabel(gen, end);
+    gen->loopDepth--;
+    return ERROR_OK;
+}
+
+// The int copy runs when every guarded local holds an int on entry, the loop itself otherwise
+static ErrorType genVersionedWhile(Codegen *gen, const ASTNode *loop) {
+    const unsigned generic = newLabel(gen);
+    const unsigned end = newLabel(gen);
+    for (size_t i = 3; i < ASTNode_childCount(loop); i++) {
+        emitInstr(gen, OP_TYPE, VAR_TA, variableName(gen, ASTNode_child(loop, i)), nullptr);
+        emitBranch(gen, OP_JUMPIFNEQ, generic, VAR_TA, "string@int");
+    }
+    ErrorType error;
+    if ((error = genWhile(gen, ASTNode_child(loop, 2))) != ERROR_OK) return error;
+    emitJump(gen, end);
+    emitLabel(gen, generic);
+    if ((error = genWhile(gen, loop)) != ERROR_OK) return error;
+    emitLabel(gen, end);
+    gen->loopsVersioned++;
+    return ERROR_OK;
+}
+
+static ErrorType genStatement(Codegen *gen, const ASTNode *statement) {
+    ErrorType error;
+    const Token *token = &statement->token;
+
+    if (token->type == TKTYPE_PUNCTUATION) {
+        if (token->punctuation_type == PTTYPE_OPENBRACE) return genBlock(gen, statement);
+        return genCall(gen, statement, false);
+    }
+    if (token->type == TKTYPE_OPERATOR) {
+        return genAssignment(gen, ASTNode_child(statement, 0), ASTNode_child(statement, 1));
+    }
+
+    switch (token->keyword_type) {
+        case KWTYPE_VAR: {
+            const ASTNode *variable = ASTNode_child(statement, 0);
+            if (ASTNode_childCount(statement) > 1) {
+                return genAssignment(gen, variable, ASTNode_child(statement, 1));
+            }
+            emitInstr(gen, OP_MOVE, variableName(gen, variable), "nil@nil", nullptr);
+            return ERROR_OK;
+        }
+        case KWTYPE_IF: {
+            const unsigned otherwise = newLabel(gen);
+            const unsigned end = newLabel(gen);
+            if ((error = genBranch(gen, ASTNode_child(statement, 0), otherwise, false)) != ERROR_OK) return error;
+            if ((error = genBlock(gen, ASTNode_child(statement, 1))) != ERROR_OK) return error;
+            emitJump(gen, end);
+            emitLabel(gen, otherwise);
+            if (ASTNode_childCount(statement) > 2) {
+                if ((error = genBlock(gen, ASTNode_child(statement, 2))) != ERROR_OK) return error;
+            }
+            emitLabel(gen, end);
+            return ERROR_OK;
+        }
+        case KWTYPE_WHILE:
+            if (ASTNode_childCount(statement) > 2) return genVersionedWhile(gen, statement);
+            return genWhile(gen, statement);
+        case KWTYPE_STATIC:
+            return genInline(gen, statement, false);
+        case KWTYPE_RETURN:
+            if (gen->inlineDepth > 0) {
+                if (ASTNode_childCount(statement) > 0) {
+                    if ((error = genExpression(gen, ASTNode_child(statement, 0))) != ERROR_OK) return error;
+                } else {
+                    emitInstr(gen, OP_PUSHS, "nil@nil", nullptr, nullptr);
+                }
+                emitJump(gen, gen->inlineEnd);
+                return ERROR_OK;
+            }
+            if (ASTNode_childCount(statement) > 0) {
+                const ASTNode *value = ASTNode_child(statement, 0);
+                if (TailCall_IsSelf(gen->current, value)) return genTailCall(gen, value);
+                if (gen->accumulating && TailCall_IsAccumulating(gen->current, value, gen->accumulator)) {
+                    if ((error = genExpression(gen, ASTNode_child(value, 0))) != ERROR_OK) return error;
+                    if ((error = genAccumulate(gen)) != ERROR_OK) return error;
+                    emitInstr(gen, OP_POPS, VAR_ACC, nullptr, nullptr);
+                    emitInstr(gen, OP_MOVE, VAR_PENDING, "bool@true", nullptr);
+                    return genTailCall(gen, ASTNode_child(value, 1));
+                }
+                if ((error = genExpression(gen, value)) != ERROR_OK) return error;
+            } else {
+                emitInstr(gen, OP_PUSHS, "nil@nil", nullptr, nullptr);
+            }
+            return genReturn(gen);
+        default:
+            return ERROR_OTHER;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Functions and program
+
+Codegen *Codegen_ctor(FILE *output) {
+    Codegen *gen = calloc(1, sizeof(Codegen));
+    if (gen == nullptr) return nullptr;
+    gen->output = output;
+    gen->globals = Symtable_ctor(0);
+    gen->frame = Frame_ctor();
+    gen->code = InstrList_ctor(0);
+    gen->cfg = Cfg_ctor();
+    gen->strings = StringPool_ctor();
+    if (gen->globals == nullptr || gen->frame == nullptr || gen->code == nullptr || gen->cfg == nullptr ||
+        gen->strings == nullptr) {
+        StringPool_dtor(gen->strings);
+        Cfg_dtor(gen->cfg);
+        InstrList_dtor(gen->code);
+        Frame_dtor(gen->frame);
+        Symtable_dtor(gen->globals);
+        free(gen);
+        return nullptr;
+    }
+    static const char header[] = ".IFJcode25\nJUMP $$main\n";
+    if (output == nullptr) return gen;
+    fputs(header, output);
+    gen->bytesWritten = sizeof header - 1;
+    return gen;
+}
+
+static ErrorType genFunction(Codegen *gen, const ASTNode *function) {
+    unsigned arity;
+    const FunctionKind kind = Semantic_FunctionKind(function, &arity);
+    const char *name = ASTNode_child(function, 0)->token.identifier;
+
+    char suffix[FORMAT_NUMBER_MAX];
+    if (kind == FNKIND_GETTER) {
+        strcpy(suffix, "get");
+    } else if (kind == FNKIND_SETTER) {
+        strcpy(suffix, "set");
+    } else {
+        Format_Unsigned(suffix, arity);
+    }
+    char *label = malloc(strlen(name) + strlen(suffix) + 3);
+    if (label != nullptr) functionLabel(label, name, suffix);
+    ErrorType error = beginFunction(gen, label);
+    if (error != ERROR_OK) return error;
+
+    emitInstr(gen, OP_LABEL, gen->function, nullptr, nullptr);
+    emitOp(gen, OP_PUSHFRAME);
+    emitInstr(gen, OP_DEFVAR, VAR_A, nullptr, nullptr);
+    emitInstr(gen, OP_DEFVAR, VAR_B, nullptr, nullptr);
+    emitInstr(gen, OP_DEFVAR, VAR_R, nullptr, nullptr);
+    emitInstr(gen, OP_DEFVAR, VAR_TA, nullptr, nullptr);
+    emitInstr(gen, OP_DEFVAR, VAR_TB, nullptr, nullptr);
+
+    /*
+     * DEFVAR may not run twice on the same variable, so every frame slot is
+     * defined once here and a declaration in the body only assigns. The
+     * parameter slots are the caller's LF@%1.. and are used in place.
+     */
+    error = Frame_Allocate(gen->frame, function);
+    if (error != ERROR_OK) return error;
+    for (size_t i = gen->frame->paramCount; i < gen->frame->slotCount; i++) {
+        emitInstr(gen, OP_DEFVAR, gen->frame->slots[i], nullptr, nullptr);
+    }
+    gen->frameLocals += gen->frame->localCount;
+    gen->frameSlots += gen->frame->slotCount;
+
+    gen->current = function;
+    gen->accumulating = gen->accumulate && TailCall_Accumulator(function, &gen->accumulator);
+    if (gen->accumulating) {
+        emitInstr(gen, OP_DEFVAR, VAR_ACC, nullptr, nullptr);
+        emitInstr(gen, OP_DEFVAR, VAR_PENDING, nullptr, nullptr);
+        emitInstr(gen, OP_MOVE, VAR_PENDING, "bool@false", nullptr);
+        gen->accumulated++;
+    }
+    // self tail calls jump here
+    gen->entry = newLabel(gen);
+    emitLabel(gen, gen->entry);
+
+    error = genBlock(gen, ASTNode_child(function, ASTNode_childCount(function) - 1));
+    if (error != ERROR_OK) return error;
+    emitInstr(gen, OP_PUSHS, "nil@nil", nullptr, nullptr);
+    if ((error = genReturn(gen)) != ERROR_OK) return error;
+    return flush(gen);
+}
+
+static ErrorType genInbuilt(Codegen *gen, const INBUILTFUNCTION_TYPE type) {
+    const char *label = inbuiltLabel(type);
+    char local[ROUTINE_LABEL_MAX];
+    emitInstr(gen, OP_LABEL, label, nullptr, nullptr);
+    emitOp(gen, OP_PUSHFRAME);
+    // every path but write's sets the result in VAR_RETVAL, it is pushed on return
+    if (type != INBUILT_WRITE) emitInstr(gen, OP_DEFVAR, VAR_RETVAL, nullptr, nullptr);
+    emitInstr(gen, OP_DEFVAR, VAR_TA, nullptr, nullptr);
+    switch (type) {
+        case INBUILT_WRITE:
+            // integral floats are printed as integers, null as "null"
+            emitInstr(gen, OP_TYPE, VAR_TA, "LF@%1", nullptr);
+            emitInstr(gen, OP_JUMPIFNEQ, routineLabel(local, label, "value"), VAR_TA, "string@nil");
+            emitInstr(gen, OP_MOVE, "LF@%1", "string@null", nullptr);
+            emitInstr(gen, OP_LABEL, routineLabel(local, label, "value"), nullptr, nullptr);
+            emitInstr(gen, OP_JUMPIFNEQ, routineLabel(local, label, "print"), VAR_TA, "string@float");
+            emitInstr(gen, OP_ISINT, VAR_TA, "LF@%1", nullptr);
+            emitInstr(gen, OP_JUMPIFEQ, routineLabel(local, label, "print"), VAR_TA, "bool@false");
+            emitInstr(gen, OP_FLOAT2INT, "LF@%1", "LF@%1", nullptr);
+            emitInstr(gen, OP_LABEL, routineLabel(local, label, "print"), nullptr, nullptr);
+            emitInstr(gen, OP_WRITE, "LF@%1", nullptr, nullptr);
+            break;
+        case INBUILT_STRING:
+            emitInstr(gen, OP_TYPE, VAR_TA, "LF@%1", nullptr);
+            emitInstr(gen, OP_MOVE, VAR_RETVAL, "LF@%1", nullptr);
+            emitInstr(gen, OP_JUMPIFEQ, routineLabel(local, label, "end"), VAR_TA, "string@string");
+            emitInstr(gen, OP_MOVE, VAR_RETVAL, "string@null", nullptr);
+            emitInstr(gen, OP_JUMPIFEQ, routineLabel(local, label, "end"), VAR_TA, "string@nil");
+            emitInstr(gen, OP_JUMPIFEQ, routineLabel(local, label, "float"), VAR_TA, "string@float");
+            emitInstr(gen, OP_JUMPIFEQ, routineLabel(local, label, "bool"), VAR_TA, "string@bool");
+            emitInstr(gen, OP_INT2STR, VAR_RETVAL, "LF@%1", nullptr);
+            emitInstr(gen, OP_JUMP, routineLabel(local, label, "end"), nullptr, nullptr);
+            emitInstr(gen, OP_LABEL, routineLabel(local, label, "float"), nullptr, nullptr);
+            emitInstr(gen, OP_FLOAT2STR, VAR_RETVAL, "LF@%1", nullptr);
+            emitInstr(gen, OP_JUMP, routineLabel(local, label, "end"), nullptr, nullptr);
+            emitInstr(gen, OP_LABEL, routineLabel(local, label, "bool"), nullptr, nullptr);
+            emitInstr(gen, OP_MOVE, VAR_RETVAL, "string@true", nullptr);
+            emitInstr(gen, OP_JUMPIFEQ, routineLabel(local, label, "end"), "LF@%1", "bool@true");
+            emitInstr(gen, OP_MOVE, VAR_RETVAL, "string@false", nullptr);
+            emitInstr(gen, OP_LABEL, routineLabel(local, label, "end"), nullptr, nullptr);
+            break;
+        case INBUILT_READNUM:
+            emitInstr(gen, OP_READ, VAR_RETVAL, "float", nullptr);
+            break;
+        case INBUILT_FLOOR:
+            emitInstr(gen, OP_TYPE, VAR_TA, "LF@%1", nullptr);
+            emitInstr(gen, OP_MOVE, VAR_RETVAL, "LF@%1", nullptr);
+            emitInstr(gen, OP_JUMPIFEQ, routineLabel(local, label, "end"), VAR_TA, "string@int");
+            emitInstr(gen, OP_JUMPIFEQ, routineLabel(local, label, "float"), VAR_TA, "string@float");
+            emitInstr(gen, OP_EXIT, "int@25", nullptr, nullptr);
+            emitInstr(gen, OP_LABEL, routineLabel(local, label, "float"), nullptr, nullptr);
+            emitInstr(gen, OP_FLOAT2INT, VAR_RETVAL, "LF@%1", nullptr);
+            emitInstr(gen, OP_LABEL, routineLabel(local, label, "end"), nullptr, nullptr);
+            break;
+        default:
+            break;
+    }
+    emitInstr(gen, OP_PUSHS, type == INBUILT_WRITE ? "nil@nil" : VAR_RETVAL, nullptr, nullptr);
+    emitOp(gen, OP_POPFRAME);
+    emitOp(gen, OP_RETURN);
+    return flush(gen);
+}
+
+// Runtime routine of operator's dynamic dispatch, for the sites that call it
+static ErrorType genHelper(Codegen *gen, const OPERATOR_TYPE operator) {
+    ErrorType error = beginFunction(gen, strdup(helperLabel(operator)));
+    if (error != ERROR_OK) return error;
+    emitInstr(gen, OP_LABEL, gen->function, nullptr, nullptr);
+    emitOp(gen, OP_PUSHFRAME);
+    emitInstr(gen, OP_DEFVAR, VAR_A, nullptr, nullptr);
+    emitInstr(gen, OP_DEFVAR, VAR_B, nullptr, nullptr);
+    emitInstr(gen, OP_DEFVAR, VAR_R, nullptr, nullptr);
+    emitInstr(gen, OP_DEFVAR, VAR_TA, nullptr, nullptr);
+    emitInstr(gen, OP_DEFVAR, VAR_TB, nullptr, nullptr);
+    error = genDynamicOperator(gen, operator);
+    if (error != ERROR_OK) return error;
+    emitOp(gen, OP_POPFRAME);
+    emitOp(gen, OP_RETURN);
+    return flush(gen);
+}
+
+static ErrorType genEntry(Codegen *gen) {
+    emitInstr(gen, OP_LABEL, "$$main", nullptr, nullptr);
+    for (size_t i = 0; i < gen->globals->entryCount; i++) {
+        emitInstr(gen, OP_DEFVAR, gen->globals->entries[i].name, nullptr, nullptr);
+        emitInstr(gen, OP_MOVE, gen->globals->entries[i].name, "nil@nil", nullptr);
+    }
+    emitOp(gen, OP_CREATEFRAME);
+    emitInstr(gen, OP_CALL, "$main$0", nullptr, nullptr);
+    emitInstr(gen, OP_EXIT, "int@0", nullptr, nullptr);
+    ErrorType error = flush(gen);
+
+    for (INBUILTFUNCTION_TYPE type = INBUILT_STRING; type <= INBUILT_FLOOR && error == ERROR_OK; type++) {
+        if (gen->inbuilts & (1u << type)) error = genInbuilt(gen, type);
+    }
+    for (OPERATOR_TYPE operator = 0; operator < OPTYPE_ASSIGN && error == ERROR_OK; operator++) {
+        if (gen->helpers & (1u << operator)) error = genHelper(gen, operator);
+    }
+    if (error != ERROR_OK) return error;
+    return ferror(gen->output) ? ERROR_OTHER : ERROR_OK;
+}
+
+ErrorType Codegen_Function(Codegen *gen, const ASTNode *function) {
+    const ErrorType error = genFunction(gen, function);
+    // its literals are written already, keeping them would grow with the program
+    if (gen->streaming) StringPool_Clear(gen->strings);
+    return error;
+}
+
+ErrorType Codegen_Finish(Codegen *gen) {
+    return genEntry(gen);
+}
+
+void Codegen_dtor(Codegen *gen) {
+    if (gen == nullptr) return;
+    Symtable_dtor(gen->globals);
+    Frame_dtor(gen->frame);
+    InstrList_dtor(gen->code);
+    Cfg_dtor(gen->cfg);
+    StringPool_dtor(gen->strings);
+    free(gen->function);
+    free(gen->labelName);
+    free(gen);
+}
+
+char *generate(ASTNode *root) {
+    char *code = nullptr;
+    size_t size = 0;
+    FILE *output = open_memstream(&code, &size);
+    if (output == nullptr) return nullptr;
+
+    Codegen *gen = Codegen_ctor(output);
+    ErrorType error = gen == nullptr ? ERROR_OTHER : ERROR_OK;
+    for (size_t i = 0; i < ASTNode_childCount(root) && error == ERROR_OK; i++) {
+        error = Codegen_Function(gen, ASTNode_child(root, i));
+    }
+    if (error == ERROR_OK) error = Codegen_Finish(gen);
+    Codegen_dtor(gen);
+
+    fclose(output);
+    if (error != ERROR_OK) {
+        free(code);
+        return nullptr;
+    }
+    return code;
+}
@@ -1,7 +1,109 @@
 ﻿#ifndef IFJCODE25_CODEGEN_H
 #define IFJCODE25_CODEGEN_H
 
+#include <stdio.h>
+
+#include "cfg.h"
+#include "frame.h"
+#include "instr.h"
+#include "layout.h"
 #include "parser.h"
+#include "peephole.h"
+#include "strpool.h"
+#include "symtable.h"
+
+// How operations without proven operand types are emitted
+typedef enum OptimizeMode {
+    OPTIMIZE_SPEED, // TYPE dispatch inlined at every site
+    OPTIMIZE_SIZE,  // calls of shared runtime routines, except in hot loops
+} OptimizeMode;
+
+/*
+ * Streaming IFJcode25 generator. Each function is lowered to stack code in an
+ * instruction list, split into basic blocks, turned into three-address form,
+ * value numbered, laid out with the cold blocks last, run through the peephole
+ * rules and written out, so only the current function's AST and instructions
+ * have to be kept in memory.
+ * Codegen_Finish appends the entry point (global variables, call of main) and
+ * the runtime routines of the built-ins and operations that were called.
+ */
+typedef struct Codegen {
+    FILE *output;
+    Symtable *globals; // GF@ variables seen so far, defined at the entry point
+    unsigned inbuilts; // bit per INBUILTFUNCTION_TYPE that was called
+    unsigned helpers;  // bit per OPERATOR_TYPE whose runtime routine was called
+
+    char *function;         // label of the function being generated
+    char *labelName;        // its internal label being formatted, function% and a number
+    size_t labelPrefix;     // length of the function% in front
+    const ASTNode *current; // and its AST
+    Frame *frame;           // frame slots of its locals
+    InstrList *code;        // its instructions, until they are written
+    Cfg *cfg;               // their basic blocks
+    StringPool *strings;    // encoded string literals of the whole program, of one function when streaming
+    unsigned labelCount;
+    unsigned inlineDepth; // nesting of inlined bodies being generated
+    unsigned inlineEnd;   // label a return in the innermost inlined body jumps to
+    unsigned entry;       // label at the start of the body, after the prologue
+    unsigned loopDepth;   // loops around the code being generated
+
+    OptimizeMode optimize;
+
+    bool streaming;            // option: functions come one at a time, nothing is kept across them
+    bool accumulate;           // option: linear recursion becomes a loop with an accumulator
+    bool accumulating;         // the current function got one
+    OPERATOR_TYPE accumulator; // operator combining its pending operands
+
+    // operations that kept the runtime TYPE dispatch / that type inference made static, counted per
+    // emitted site: folded and removed code has none, a rotated loop's repeated condition counts twice
+    unsigned long typeChecks;
+    unsigned long typeChecksElided;
+
+    // locals of all functions / frame variables they were packed into
+    unsigned long frameLocals;
+    unsigned long frameSlots;
+
+    // instructions in unreachable blocks / saved by the three-address form / reusing a computed value
+    unsigned long unreachableRemoved;
+    unsigned long stackSaved;
+    unsigned long valuesReused;
+
+    // self tail calls turned into jumps / functions given an accumulator for that
+    unsigned long tailCalls;
+    unsigned long accumulated;
+
+    // loops given an int copy behind a type guard
+    unsigned long loopsVersioned;
+
+    // string literals joined with a neighbour in a concatenation chain
+    unsigned long literalsJoined;
+
+    // operations that call a runtime routine instead of inlining the dispatch
+    unsigned long helperCalls;
+
+    // getter and setter uses the front end replaced by GF@ accesses
+    unsigned long accessorsDirect;
+
+    // built-in calls lowered to plain instructions / constant writes merged into a previous one
+    unsigned long inbuiltsLowered;
+    unsigned long writesMerged;
+
+    // bytes of IFJcode25 written / seconds spent writing them, summed over the workers of Parallel_Codegen
+    size_t bytesWritten;
+    double seconds;
+
+    LayoutStats layout;     // cold blocks moved behind the hot code
+    PeepholeStats peephole; // instructions removed by each peephole rule
+} Codegen;
+
+// Without output nothing is written until one is set, as for the workers of Parallel_Codegen
+Codegen *Codegen_ctor(FILE *output);
+
+ErrorType Codegen_Function(Codegen *gen, const ASTNode *function);
+
+ErrorType Codegen_Finish(Codegen *gen);
+
+void Codegen_dtor(Codegen *gen);
 
 char *generate(ASTNode *root);
 
@@ -0,0 +1,109 @@
+﻿#include "dce.h"
+
+#include <stdlib.h>
+
+#include "callgraph.h"
+#include "list.h"
+
+static bool isLiteral(const ASTNode *node) {
+    return node->token.type >= TKTYPE_LITERAL_INT && node->token.type <= TKTYPE_LITERAL_BOOL;
+}
+
+static bool isTruthy(const ASTNode *literal) {
+    if (literal->token.type == TKTYPE_LITERAL_NIL) return false;
+    if (literal->token.type == TKTYPE_LITERAL_BOOL) return literal->token.bool_value;
+    return true;
+}
+
+static bool isKeyword(const ASTNode *node, const KEYWORD_TYPE type) {
+    return node->token.type == TKTYPE_KEYWORD && node->token.keyword_type == type;
+}
+
+static bool pruneBlock(ASTNode *block);
+
+// Returns whether control never falls through the statement
+static bool pruneStatement(ASTNode *statement) {
+    const Token *token = &statement->token;
+    if (token->type == TKTYPE_PUNCTUATION && token->punctuation_type == PTTYPE_OPENBRACE) {
+        return pruneBlock(statement);
+    }
+    if (token->type != TKTYPE_KEYWORD) return false;
+
+    switch (token->keyword_type) {
+        case KWTYPE_IF: {
+            const bool thenReturns = pruneBlock(ASTNode_child(statement, 1));
+            const bool elseReturns = ASTNode_childCount(statement) > 2 && pruneBlock(ASTNode_child(statement, 2));
+            return thenReturns && elseReturns;
+        }
+        case KWTYPE_WHILE: {
+            pruneBlock(ASTNode_child(statement, 1));
+            // there is no break, a loop on a true literal is never left
+            const ASTNode *condition = ASTNode_child(statement, 0);
+            return isLiteral(condition) && isTruthy(condition);
+        }
+        case KWTYPE_RETURN:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool pruneBlock(ASTNode *block) {
+    List *statements = block->children;
+    for (size_t i = 0; i < ASTNode_childCount(block); i++) {
+        ASTNode *statement = statements->data[i];
+        const ASTNode *condition = ASTNode_child(statement, 0);
+
+        if (isKeyword(statement, KWTYPE_IF) && isLiteral(condition)) {
+            // the taken branch block replaces the whole if
+            const size_t branch = isTruthy(condition) ? 1 : 2;
+            if (branch >= ASTNode_childCount(statement)) {
+                List_Remove(statements, i--);
+                continue;
+            }
+            statements->data[i] = statement->children->data[branch];
+            statement->children->data[branch] = nullptr;
+            ASTNode_dtor(statement);
+            statement = statements->data[i];
+        } else if (isKeyword(statement, KWTYPE_WHILE) && isLiteral(condition) && !isTruthy(condition)) {
+            List_Remove(statements, i--);
+            continue;
+        }
+
+        if (pruneStatement(statement)) {
+            while (statements->count > i + 1) List_Remove(statements, statements->count - 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+ErrorType Dce_Function(ASTNode *function) {
+    pruneBlock(ASTNode_child(function, ASTNode_childCount(function) - 1));
+    return ERROR_OK;
+}
+
+ErrorType Dce_Program(ASTNode *root) {
+    ErrorType error;
+    CallGraph *graph = CallGraph_ctor(root, &error);
+    if (graph == nullptr) return error;
+    const size_t count = ASTNode_childCount(root);
+    bool *reached = calloc(count ? count : 1, sizeof(bool));
+    if (reached == nullptr) {
+        CallGraph_dtor(graph);
+        return ERROR_OTHER;
+    }
+
+    size_t main;
+    if (CallGraph_Find(graph, "main", FNKIND_FUNCTION, 0, &main)) {
+        reached[main] = true;
+        CallGraph_Reach(graph, main, reached);
+    }
+    for (size_t i = count; i-- > 0;) {
+        if (!reached[i]) List_Remove(root->children, i);
+    }
+
+    free(reached);
+    CallGraph_dtor(graph);
+    return ERROR_OK;
+}
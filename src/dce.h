@@ -0,0 +1,21 @@
+﻿#ifndef IFJCODE25_DCE_H
+#define IFJCODE25_DCE_H
+
+#include "error.h"
+#include "parser.h"
+
+/*
+ * Removes code that can never run from one checked and folded function:
+ * statements after a return (or after an if whose branches all return, or an
+ * endless loop), branches of an if whose condition is a literal and loops whose
+ * condition is a false literal.
+ */
+ErrorType Dce_Function(ASTNode *function);
+
+/*
+ * Drops every function of the program that is not reachable from main through
+ * calls, getter uses or setter assignments. Needs the whole checked program.
+ */
+ErrorType Dce_Program(ASTNode *root);
+
+#endif
@@ -0,0 +1,668 @@
+﻿#include "fold.h"
+
+#include <stdckdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "format.h"
+#include "list.h"
+#include "symtable.h"
+
+// longest string a repetition may produce at compile time
+#define FOLD_MAX_REPEAT_LENGTH 4096
+
+typedef struct Constant {
+    TokenType type; // TKTYPE_LITERAL_*, TKTYPE_EOF = not a constant
+    union {
+        long long intValue;
+        double floatValue;
+        char *stringValue;
+        bool boolValue;
+    };
+} Constant;
+
+typedef enum SlotKind {
+    SLOT_UNREACHED,
+    SLOT_CONSTANT,
+    SLOT_VARYING,
+} SlotKind;
+
+typedef struct Slot {
+    SlotKind kind;
+    Constant value;
+} Slot;
+
+typedef struct Folder {
+    Symtable *slots; // frame name of a local -> slot index + 1
+    size_t slotCount;
+    Slot *state;
+    bool rewrite; // false while a loop is iterated to its fixed point
+} Folder;
+
+static const Constant NOT_CONSTANT = {.type = TKTYPE_EOF};
+
+static void Constant_dtor(Constant *constant) {
+    if (constant->type == TKTYPE_LITERAL_STRING) free(constant->stringValue);
+    *constant = NOT_CONSTANT;
+}
+
+static bool copyConstant(Constant *to, const Constant *from) {
+    *to = *from;
+    if (from->type == TKTYPE_LITERAL_STRING) {
+        to->stringValue = strdup(from->stringValue);
+        if (to->stringValue == nullptr) {
+            *to = NOT_CONSTANT;
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool equalConstants(const Constant *a, const Constant *b) {
+    if (a->type != b->type) return false;
+    switch (a->type) {
+        case TKTYPE_LITERAL_INT:
+            return a->intValue == b->intValue;
+        case TKTYPE_LITERAL_FLOAT:
+            return memcmp(&a->floatValue, &b->floatValue, sizeof(double)) == 0;
+        case TKTYPE_LITERAL_STRING:
+            return strcmp(a->stringValue, b->stringValue) == 0;
+        case TKTYPE_LITERAL_BOOL:
+            return a->boolValue == b->boolValue;
+        default:
+            return true;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Evaluation with the semantics of the generated code
+
+static bool isNumber(const Constant *c) {
+    return c->type == TKTYPE_LITERAL_INT || c->type == TKTYPE_LITERAL_FLOAT;
+}
+
+static double toDouble(const Constant *c) {
+    return c->type == TKTYPE_LITERAL_INT ? (double) c->intValue : c->floatValue;
+}
+
+static bool isTruthy(const Constant *c) {
+    if (c->type == TKTYPE_LITERAL_NIL) return false;
+    if (c->type == TKTYPE_LITERAL_BOOL) return c->boolValue;
+    return true;
+}
+
+static bool makeInt(Constant *out, const long long value) {
+    *out = (Constant){.type = TKTYPE_LITERAL_INT, .intValue = value};
+    return true;
+}
+
+static bool makeString(Constant *out, char *value) {
+    if (value == nullptr) return false;
+    *out = (Constant){.type = TKTYPE_LITERAL_STRING, .stringValue = value};
+    return true;
+}
+
+static bool makeBool(Constant *out, const bool value) {
+    *out = (Constant){.type = TKTYPE_LITERAL_BOOL, .boolValue = value};
+    return true;
+}
+
+static bool concatenate(Constant *out, const char *left, const char *right, const long long count) {
+    const size_t leftLength = strlen(left);
+    const size_t rightLength = strlen(right);
+    char *result = malloc(leftLength + rightLength * (size_t) count + 1);
+    if (result == nullptr) return false;
+    memcpy(result, left, leftLength);
+    for (long long i = 0; i < count; i++) {
+        memcpy(result + leftLength + rightLength * (size_t) i, right, rightLength);
+    }
+    result[leftLength + rightLength * (size_t) count] = '\0';
+    return makeString(out, result);
+}
+
+static bool arithmetic(const OPERATOR_TYPE operator, const Constant *left, const Constant *right, Constant *out) {
+    if (left->type == TKTYPE_LITERAL_INT && right->type == TKTYPE_LITERAL_INT && operator != OPTYPE_DIVIDE) {
+        const long long a = left->intValue;
+        const long long b = right->intValue;
+        long long result;
+        // an overflowing result is left for runtime
+        switch (operator) {
+            case OPTYPE_PLUS:
+                return !ckd_add(&result, a, b) && makeInt(out, result);
+            case OPTYPE_MINUS:
+                return !ckd_sub(&result, a, b) && makeInt(out, result);
+            default:
+                return !ckd_mul(&result, a, b) && makeInt(out, result);
+        }
+    }
+    const double a = toDouble(left);
+    const double b = toDouble(right);
+    double result;
+    switch (operator) {
+        case OPTYPE_PLUS:
+            result = a + b;
+            break;
+        case OPTYPE_MINUS:
+            result = a - b;
+            break;
+        case OPTYPE_MULTIPLY:
+            result = a * b;
+            break;
+        default:
+            // division by zero is a runtime error
+            if (b == 0.0) return false;
+            result = a / b;
+            break;
+    }
+    *out = (Constant){.type = TKTYPE_LITERAL_FLOAT, .floatValue = result};
+    return true;
+}
+
+static bool equal(const Constant *left, const Constant *right) {
+    if (isNumber(left) && isNumber(right)) {
+        if (left->type == TKTYPE_LITERAL_INT && right->type == TKTYPE_LITERAL_INT) {
+            return left->intValue == right->intValue;
+        }
+        return toDouble(left) == toDouble(right);
+    }
+    if (left->type != right->type) return false;
+    switch (left->type) {
+        case TKTYPE_LITERAL_STRING:
+            return strcmp(left->stringValue, right->stringValue) == 0;
+        case TKTYPE_LITERAL_BOOL:
+            return left->boolValue == right->boolValue;
+        default:
+            return true;
+    }
+}
+
+static bool compare(const OPERATOR_TYPE operator, const Constant *left, const Constant *right) {
+    if (left->type == TKTYPE_LITERAL_INT && right->type == TKTYPE_LITERAL_INT) {
+        const long long a = left->intValue;
+        const long long b = right->intValue;
+        switch (operator) {
+            case OPTYPE_LESS:
+                return a < b;
+            case OPTYPE_GREATER:
+                return a > b;
+            case OPTYPE_LESSEQUAL:
+                return a <= b;
+            default:
+                return a >= b;
+        }
+    }
+    const double a = toDouble(left);
+    const double b = toDouble(right);
+    switch (operator) {
+        case OPTYPE_LESS:
+            return a < b;
+        case OPTYPE_GREATER:
+            return a > b;
+        case OPTYPE_LESSEQUAL:
+            return !(a > b);
+        default:
+            return !(a < b);
+    }
+}
+
+static bool applyBinary(const OPERATOR_TYPE operator, const Constant *left, const Constant *right, Constant *out) {
+    switch (operator) {
+        case OPTYPE_PLUS:
+            if (left->type == TKTYPE_LITERAL_STRING && right->type == TKTYPE_LITERAL_STRING) {
+                return concatenate(out, left->stringValue, right->stringValue, 1);
+            }
+            [[fallthrough]];
+        case OPTYPE_MINUS:
+        case OPTYPE_DIVIDE:
+            if (!isNumber(left) || !isNumber(right)) return false;
+            return arithmetic(operator, left, right, out);
+        case OPTYPE_MULTIPLY:
+            if (left->type == TKTYPE_LITERAL_STRING && isNumber(right)) {
+                const double count = toDouble(right);
+                if (!Format_IsIntegral(count) || count > FOLD_MAX_REPEAT_LENGTH) return false;
+                const long long times = count > 0 ? (long long) count : 0;
+                if (times * (long long) strlen(left->stringValue) > FOLD_MAX_REPEAT_LENGTH) return false;
+                return concatenate(out, "", left->stringValue, times);
+            }
+            if (!isNumber(left) || !isNumber(right)) return false;
+            return arithmetic(operator, left, right, out);
+        case OPTYPE_LESS:
+        case OPTYPE_GREATER:
+        case OPTYPE_LESSEQUAL:
+        case OPTYPE_GREATEREQUAL:
+            if (!isNumber(left) || !isNumber(right)) return false;
+            return makeBool(out, compare(operator, left, right));
+        case OPTYPE_EQUAL:
+            return makeBool(out, equal(left, right));
+        case OPTYPE_NOTEQUAL:
+            return makeBool(out, !equal(left, right));
+        case OPTYPE_AND:
+            return makeBool(out, isTruthy(left) && isTruthy(right));
+        case OPTYPE_OR:
+            return makeBool(out, isTruthy(left) || isTruthy(right));
+        default:
+            return false;
+    }
+}
+
+// Ifj.str as done by INT2STR / FLOAT2STR
+static bool applyStr(const Constant *argument, Constant *out) {
+    char buffer[FORMAT_FLOAT_TEXT_MAX];
+    switch (argument->type) {
+        case TKTYPE_LITERAL_STRING:
+            return makeString(out, strdup(argument->stringValue));
+        case TKTYPE_LITERAL_NIL:
+            return makeString(out, strdup("null"));
+        case TKTYPE_LITERAL_BOOL:
+            return makeString(out, strdup(argument->boolValue ? "true" : "false"));
+        case TKTYPE_LITERAL_INT:
+            Format_Decimal(buffer, argument->intValue);
+            return makeString(out, strdup(buffer));
+        case TKTYPE_LITERAL_FLOAT:
+            Format_FloatText(buffer, argument->floatValue);
+            return makeString(out, strdup(buffer));
+        default:
+            return false;
+    }
+}
+
+static bool applyCall(const ASTNode *callee, const Constant *arguments, const size_t count, Constant *out) {
+    if (callee->token.type != TKTYPE_INBUILTFUNCTION || count != 1) return false;
+    switch (callee->token.inbuilt_function_type) {
+        case INBUILT_STRING:
+            return applyStr(&arguments[0], out);
+        case INBUILT_FLOOR:
+            if (arguments[0].type == TKTYPE_LITERAL_INT) return copyConstant(out, &arguments[0]);
+            if (arguments[0].type != TKTYPE_LITERAL_FLOAT) return false;
+            // FLOAT2INT fails at runtime on the rest
+            if (!Format_FitsInt(arguments[0].floatValue)) return false;
+            return makeInt(out, (long long) arguments[0].floatValue);
+        default:
+            return false;
+    }
+}
+
+static bool applyTypeTest(const ASTNode *test, const Constant *value, Constant *out) {
+    switch (ASTNode_child(test, 1)->token.keyword_type) {
+        case KWTYPE_NUM:
+            return makeBool(out, isNumber(value));
+        case KWTYPE_STRING:
+            return makeBool(out, value->type == TKTYPE_LITERAL_STRING);
+        default:
+            return makeBool(out, value->type == TKTYPE_LITERAL_NIL);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// AST rewriting
+
+static Slot *localSlot(const Folder *folder, const ASTNode *variable) {
+    unsigned id;
+    if (variable->token.type != TKTYPE_VARIABLE || strncmp(variable->token.identifier, "LF@", 3) != 0) {
+        return nullptr;
+    }
+    if (Symtable_Lookup(folder->slots, variable->token.identifier, &id) != ERROR_OK) return nullptr;
+    return &folder->state[id - 1];
+}
+
+static bool literalConstant(const Token *token, Constant *out) {
+    switch (token->type) {
+        case TKTYPE_LITERAL_INT:
+            *out = (Constant){.type = TKTYPE_LITERAL_INT, .intValue = token->int_value};
+            return true;
+        case TKTYPE_LITERAL_FLOAT:
+            *out = (Constant){.type = TKTYPE_LITERAL_FLOAT, .floatValue = token->float_value};
+            return true;
+        case TKTYPE_LITERAL_STRING:
+            return makeString(out, strdup(token->string_value));
+        case TKTYPE_LITERAL_NIL:
+            *out = (Constant){.type = TKTYPE_LITERAL_NIL};
+            return true;
+        case TKTYPE_LITERAL_BOOL:
+            return makeBool(out, token->bool_value);
+        default:
+            return false;
+    }
+}
+
+static ErrorType replaceWithLiteral(ASTNode **slot, const Constant *value) {
+    Token token = {.type = value->type};
+    switch (value->type) {
+        case TKTYPE_LITERAL_INT:
+            token.int_value = value->intValue;
+            break;
+        case TKTYPE_LITERAL_FLOAT:
+            token.float_value = value->floatValue;
+            break;
+        case TKTYPE_LITERAL_STRING:
+            token.string_value = strdup(value->stringValue);
+            if (token.string_value == nullptr) return ERROR_OTHER;
+            break;
+        case TKTYPE_LITERAL_BOOL:
+            token.bool_value = value->boolValue;
+            break;
+        default:
+            break;
+    }
+    ASTNode *literal = ASTNode_ctor(token);
+    if (literal == nullptr) {
+        free((char *) (token.type == TKTYPE_LITERAL_STRING ? token.string_value : nullptr));
+        return ERROR_OTHER;
+    }
+    ASTNode_dtor(*slot);
+    *slot = literal;
+    return ERROR_OK;
+}
+
+static ASTNode **childSlot(const ASTNode *node, const size_t index) {
+    return &node->children->data[index];
+}
+
+/*
+ * Folds the children first; if the node's value is then known it is stored in
+ * value and, when rewriting, the node is replaced by a literal.
+ */
+static ErrorType foldExpression(Folder *folder, ASTNode **slot, Constant *value) {
+    ErrorType error = ERROR_OK;
+    ASTNode *node = *slot;
+    *value = NOT_CONSTANT;
+    bool known = false;
+
+    switch (node->token.type) {
+        case TKTYPE_LITERAL_INT:
+        case TKTYPE_LITERAL_FLOAT:
+        case TKTYPE_LITERAL_STRING:
+        case TKTYPE_LITERAL_NIL:
+        case TKTYPE_LITERAL_BOOL:
+            // already a literal, nothing to replace
+            if (!literalConstant(&node->token, value)) return ERROR_OTHER;
+            return ERROR_OK;
+
+        case TKTYPE_VARIABLE: {
+            const Slot *local = localSlot(folder, node);
+            if (local != nullptr && local->kind == SLOT_CONSTANT) {
+                if (!copyConstant(value, &local->value)) return ERROR_OTHER;
+                known = true;
+            }
+            break;
+        }
+
+        case TKTYPE_PUNCTUATION: {
+            const size_t count = ASTNode_childCount(node) - 1;
+            Constant *arguments = calloc(count ? count : 1, sizeof(Constant));
+            if (arguments == nullptr) return ERROR_OTHER;
+            bool constant = true;
+            for (size_t i = 0; i < count && error == ERROR_OK; i++) {
+                error = foldExpression(folder, childSlot(node, i + 1), &arguments[i]);
+                constant = constant && arguments[i].type != TKTYPE_EOF;
+            }
+            if (error == ERROR_OK && constant) known = applyCall(ASTNode_child(node, 0), arguments, count, value);
+            for (size_t i = 0; i < count; i++) Constant_dtor(&arguments[i]);
+            free(arguments);
+            break;
+        }
+
+        case TKTYPE_OPERATOR: {
+            Constant left;
+            Constant right = NOT_CONSTANT;
+            if ((error = foldExpression(folder, childSlot(node, 0), &left)) != ERROR_OK) return error;
+            if (node->token.operator_type == OPTYPE_NOT) {
+                if (left.type != TKTYPE_EOF) known = makeBool(value, !isTruthy(&left));
+            } else {
+                error = foldExpression(folder, childSlot(node, 1), &right);
+                if (error == ERROR_OK && left.type != TKTYPE_EOF && right.type != TKTYPE_EOF) {
+                    known = applyBinary(node->token.operator_type, &left, &right, value);
+                }
+            }
+            Constant_dtor(&left);
+            Constant_dtor(&right);
+            break;
+        }
+
+        case TKTYPE_KEYWORD:
+            if (node->token.keyword_type == KWTYPE_IS) {
+                Constant operand;
+                if ((error = foldExpression(folder, childSlot(node, 0), &operand)) != ERROR_OK) return error;
+                if (operand.type != TKTYPE_EOF) known = applyTypeTest(node, &operand, value);
+                Constant_dtor(&operand);
+            }
+            break;
+
+        default:
+            // getter calls
+            break;
+    }
+
+    if (error == ERROR_OK && known && folder->rewrite) error = replaceWithLiteral(slot, value);
+    if (!known) *value = NOT_CONSTANT;
+    return error;
+}
+
+static ErrorType foldRoot(Folder *folder, ASTNode **slot) {
+    Constant value;
+    const ErrorType error = foldExpression(folder, slot, &value);
+    Constant_dtor(&value);
+    return error;
+}
+
+static void assignLocal(const Folder *folder, const ASTNode *target, Constant *value) {
+    Slot *local = localSlot(folder, target);
+    if (local == nullptr) {
+        Constant_dtor(value);
+        return;
+    }
+    Constant_dtor(&local->value);
+    if (value->type == TKTYPE_EOF) {
+        local->kind = SLOT_VARYING;
+    } else {
+        local->kind = SLOT_CONSTANT;
+        local->value = *value;
+        *value = NOT_CONSTANT;
+    }
+}
+
+static void clearState(Slot *state, const size_t count, const SlotKind kind) {
+    for (size_t i = 0; i < count; i++) {
+        Constant_dtor(&state[i].value);
+        state[i].kind = kind;
+    }
+}
+
+static Slot *copyState(const Folder *folder) {
+    Slot *copy = calloc(folder->slotCount ? folder->slotCount : 1, sizeof(Slot));
+    if (copy == nullptr) return nullptr;
+    for (size_t i = 0; i < folder->slotCount; i++) {
+        copy[i].kind = folder->state[i].kind;
+        if (!copyConstant(&copy[i].value, &folder->state[i].value)) {
+            clearState(copy, i, SLOT_UNREACHED);
+            free(copy);
+            return nullptr;
+        }
+    }
+    return copy;
+}
+
+static void freeState(Slot *state, const size_t count) {
+    if (state == nullptr) return;
+    clearState(state, count, SLOT_UNREACHED);
+    free(state);
+}
+
+// Merges from into into; returns whether into changed
+static bool joinState(Slot *into, Slot *from, const size_t count) {
+    bool changed = false;
+    for (size_t i = 0; i < count; i++) {
+        if (from[i].kind == SLOT_UNREACHED || into[i].kind == SLOT_VARYING) continue;
+        if (into[i].kind == SLOT_UNREACHED) {
+            into[i] = from[i];
+            from[i] = (Slot){.kind = SLOT_UNREACHED, .value = NOT_CONSTANT};
+            changed = true;
+        } else if (from[i].kind == SLOT_VARYING || !equalConstants(&into[i].value, &from[i].value)) {
+            Constant_dtor(&into[i].value);
+            into[i].kind = SLOT_VARYING;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+static ErrorType foldBlock(Folder *folder, const ASTNode *block);
+
+static ErrorType foldIf(Folder *folder, ASTNode *statement) {
+    ErrorType error = foldRoot(folder, childSlot(statement, 0));
+    if (error != ERROR_OK) return error;
+    Slot *otherwise = copyState(folder);
+    if (otherwise == nullptr) return ERROR_OTHER;
+
+    error = foldBlock(folder, ASTNode_child(statement, 1));
+    if (error == ERROR_OK && ASTNode_childCount(statement) > 2) {
+        Slot *then = folder->state;
+        folder->state = otherwise;
+        error = foldBlock(folder, ASTNode_child(statement, 2));
+        // a loop in the branch may have replaced the state array
+        otherwise = folder->state;
+        folder->state = then;
+    }
+    joinState(folder->state, otherwise, folder->slotCount);
+    freeState(otherwise, folder->slotCount);
+    return error;
+}
+
+// The loop head state is widened until the body stops changing it, then the body is rewritten with it
+static ErrorType foldWhile(Folder *folder, ASTNode *statement) {
+    ErrorType error = ERROR_OK;
+    const bool rewrite = folder->rewrite;
+    folder->rewrite = false;
+
+    Slot *head = nullptr;
+    for (;;) {
+        freeState(head, folder->slotCount);
+        if ((head = copyState(folder)) == nullptr) {
+            error = ERROR_OTHER;
+            break;
+        }
+        if ((error = foldRoot(folder, childSlot(statement, 0))) != ERROR_OK) break;
+        if ((error = foldBlock(folder, ASTNode_child(statement, 1))) != ERROR_OK) break;
+        // state = head joined with the state at the end of the body
+        if (!joinState(head, folder->state, folder->slotCount)) break;
+        freeState(folder->state, folder->slotCount);
+        folder->state = head;
+        head = nullptr;
+    }
+    folder->rewrite = rewrite;
+
+    if (error == ERROR_OK) {
+        freeState(folder->state, folder->slotCount);
+        folder->state = head;
+        head = nullptr;
+        if ((head = copyState(folder)) == nullptr) error = ERROR_OTHER;
+    }
+    if (error == ERROR_OK) error = foldRoot(folder, childSlot(statement, 0));
+    if (error == ERROR_OK) error = foldBlock(folder, ASTNode_child(statement, 1));
+    if (error == ERROR_OK) {
+        // the loop is left from its head
+        freeState(folder->state, folder->slotCount);
+        folder->state = head;
+        head = nullptr;
+    }
+    freeState(head, folder->slotCount);
+    return error;
+}
+
+static ErrorType foldStatement(Folder *folder, ASTNode *statement) {
+    ErrorType error;
+    const Token *token = &statement->token;
+
+    if (token->type == TKTYPE_PUNCTUATION) {
+        if (token->punctuation_type == PTTYPE_OPENBRACE) return foldBlock(folder, statement);
+        // call statement, its result is not used so the call itself stays
+        for (size_t i = 1; i < ASTNode_childCount(statement); i++) {
+            if ((error = foldRoot(folder, childSlot(statement, i))) != ERROR_OK) return error;
+        }
+        return ERROR_OK;
+    }
+
+    if (token->type == TKTYPE_OPERATOR) {
+        Constant value;
+        if ((error = foldExpression(folder, childSlot(statement, 1), &value)) != ERROR_OK) return error;
+        assignLocal(folder, ASTNode_child(statement, 0), &value);
+        return ERROR_OK;
+    }
+
+    switch (token->keyword_type) {
+        case KWTYPE_VAR: {
+            Constant value = {.type = TKTYPE_LITERAL_NIL};
+            if (ASTNode_childCount(statement) > 1) {
+                if ((error = foldExpression(folder, childSlot(statement, 1), &value)) != ERROR_OK) return error;
+            }
+            assignLocal(folder, ASTNode_child(statement, 0), &value);
+            return ERROR_OK;
+        }
+        case KWTYPE_IF:
+            return foldIf(folder, statement);
+        case KWTYPE_WHILE:
+            return foldWhile(folder, statement);
+        case KWTYPE_RETURN:
+            if (ASTNode_childCount(statement) > 0) {
+                if ((error = foldRoot(folder, childSlot(statement, 0))) != ERROR_OK) return error;
+            }
+            clearState(folder->state, folder->slotCount, SLOT_UNREACHED);
+            return ERROR_OK;
+        default:
+            return ERROR_OK;
+    }
+}
+
+static ErrorType foldBlock(Folder *folder, const ASTNode *block) {
+    for (size_t i = 0; i < ASTNode_childCount(block); i++) {
+        const ErrorType error = foldStatement(folder, ASTNode_child(block, i));
+        if (error != ERROR_OK) return error;
+    }
+    return ERROR_OK;
+}
+
+static ErrorType collectLocals(Folder *folder, const ASTNode *node) {
+    if (node->token.type == TKTYPE_KEYWORD && node->token.keyword_type == KWTYPE_VAR) {
+        const ErrorType error = Symtable_Declare(folder->slots, ASTNode_child(node, 0)->token.identifier, nullptr);
+        if (error != ERROR_OK) return error;
+        folder->slotCount++;
+    }
+    for (size_t i = 0; i < ASTNode_childCount(node); i++) {
+        const ErrorType error = collectLocals(folder, ASTNode_child(node, i));
+        if (error != ERROR_OK) return error;
+    }
+    return ERROR_OK;
+}
+
+ErrorType Fold_Function(ASTNode *function) {
+    Folder folder = {.slots = Symtable_ctor(0), .rewrite = true};
+    if (folder.slots == nullptr) return ERROR_OTHER;
+
+    // parameters are never constant
+    const size_t childCount = ASTNode_childCount(function);
+    size_t paramCount = 0;
+    ErrorType error = ERROR_OK;
+    if (childCount > 2) {
+        const ASTNode *params = ASTNode_child(function, 1);
+        paramCount = ASTNode_childCount(params);
+        for (size_t i = 0; i < paramCount && error == ERROR_OK; i++) {
+            error = Symtable_Declare(folder.slots, ASTNode_child(params, i)->token.identifier, nullptr);
+        }
+        folder.slotCount = paramCount;
+    }
+    const ASTNode *body = ASTNode_child(function, childCount - 1);
+    if (error == ERROR_OK) error = collectLocals(&folder, body);
+
+    if (error == ERROR_OK) {
+        folder.state = calloc(folder.slotCount ? folder.slotCount : 1, sizeof(Slot));
+        if (folder.state == nullptr) error = ERROR_OTHER;
+    }
+    if (error == ERROR_OK) {
+        for (size_t i = 0; i < paramCount; i++) folder.state[i].kind = SLOT_VARYING;
+        error = foldBlock(&folder, body);
+    }
+
+    freeState(folder.state, folder.slotCount);
+    Symtable_dtor(folder.slots);
+    return error;
+}
@@ -0,0 +1,17 @@
+﻿#ifndef IFJCODE25_FOLD_H
+#define IFJCODE25_FOLD_H
+
+#include "error.h"
+#include "parser.h"
+
+/*
+ * Constant folding and propagation over one checked function. Subtrees whose
+ * value is known at compile time (arithmetic with int/float promotion, string
+ * concatenation and repetition, comparisons, "is", Ifj.str and Ifj.floor) are
+ * replaced by a literal computed with the interpreter's semantics. Locals that
+ * hold a known constant at a use are replaced by that constant. Operations that
+ * would fail at runtime are left alone so the runtime error is preserved.
+ */
+ErrorType Fold_Function(ASTNode *function);
+
+#endif
@@ -0,0 +1,201 @@
+﻿#include "format.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char DIGIT_PAIRS[] = "00010203040506070809"
+                                  "10111213141516171819"
+                                  "20212223242526272829"
+                                  "30313233343536373839"
+                                  "40414243444546474849"
+                                  "50515253545556575859"
+                                  "60616263646566676869"
+                                  "70717273747576777879"
+                                  "80818283848586878889"
+                                  "90919293949596979899";
+
+static const char HEX_DIGITS[] = "0123456789abcdef";
+
+// Bit per byte value written as \ddd: everything up to the space, '#' and '\'
+static const uint32_t ESCAPED[256 / 32] = {
+    0xffffffff,
+    (1u << (' ' - 32)) | (1u << ('#' - 32)),
+    1u << ('\\' - 64),
+};
+
+static bool isEscaped(const unsigned char c) {
+    return ESCAPED[c / 32] >> (c % 32) & 1;
+}
+
+static char *append(char *out, const char *text, const size_t length) {
+    memcpy(out, text, length);
+    out[length] = '\0';
+    return out + length;
+}
+
+char *Format_Unsigned(char *out, unsigned long long value) {
+    // filled from the end, two digits at a time
+    char digits[24];
+    char *start = digits + sizeof digits;
+    while (value >= 100) {
+        start -= 2;
+        memcpy(start, &DIGIT_PAIRS[value % 100 * 2], 2);
+        value /= 100;
+    }
+    if (value >= 10) {
+        start -= 2;
+        memcpy(start, &DIGIT_PAIRS[value * 2], 2);
+    } else {
+        *--start = (char) ('0' + value);
+    }
+    return append(out, start, (size_t) (digits + sizeof digits - start));
+}
+
+char *Format_Decimal(char *out, const long long value) {
+    if (value >= 0) return Format_Unsigned(out, (unsigned long long) value);
+    *out++ = '-';
+    // negated as unsigned, so the smallest value does not overflow
+    return Format_Unsigned(out, 0ull - (unsigned long long) value);
+}
+
+char *Format_Int(char *out, const long long value) {
+    return Format_Decimal(append(out, "int@", 4), value);
+}
+
+char *Format_Float(char *out, const double value) {
+    out = append(out, "float@", 6);
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof bits);
+    if (bits >> 63) *out++ = '-';
+    if (isinf(value)) return append(out, "inf", 3);
+    if (isnan(value)) return append(out, "nan", 3);
+
+    const int biased = (int) (bits >> 52 & 0x7ff);
+    uint64_t mantissa = bits & 0xfffffffffffffull;
+    int exponent = biased - 1023;
+    char lead = '1';
+    if (biased == 0) {
+        // zero and the subnormals, which keep the smallest exponent
+        lead = '0';
+        exponent = mantissa == 0 ? 0 : -1022;
+    }
+    *out++ = '0';
+    *out++ = 'x';
+    *out++ = lead;
+
+    if (mantissa != 0) {
+        *out++ = '.';
+        for (int shift = 48; mantissa != 0; shift -= 4) {
+            *out++ = HEX_DIGITS[mantissa >> shift & 0xf];
+            mantissa &= (1ull << shift) - 1;
+        }
+    }
+    *out++ = 'p';
+    *out++ = exponent < 0 ? '-' : '+';
+    return Format_Unsigned(out, (unsigned long long) (exponent < 0 ? -exponent : exponent));
+}
+
+bool Format_IsIntegral(const double value) {
+    if (!isfinite(value)) return false;
+    // every double of at least 2^52 is whole, smaller ones fit a long long
+    if (value >= 0x1p52 || value <= -0x1p52) return true;
+    return value == (double) (long long) value;
+}
+
+bool Format_FitsInt(const double value) {
+    return value >= -0x1p63 && value < 0x1p63;
+}
+
+// mantissa * 2^exponent, a whole number of 2^64 and more, converted in limbs of nine digits
+static char *wholeText(char *out, uint64_t mantissa, int exponent) {
+    uint32_t limbs[40]; // lowest first, DBL_MAX has 309 digits
+    size_t count = 0;
+    for (; mantissa != 0; mantissa /= 1000000000) limbs[count++] = (uint32_t) (mantissa % 1000000000);
+    while (exponent > 0) {
+        // a limb shifted by 29 bits and a carry still fit 64 bits
+        const int step = exponent < 29 ? exponent : 29;
+        uint64_t carry = 0;
+        for (size_t i = 0; i < count; i++) {
+            const uint64_t shifted = ((uint64_t) limbs[i] << step) + carry;
+            limbs[i] = (uint32_t) (shifted % 1000000000);
+            carry = shifted / 1000000000;
+        }
+        for (; carry != 0; carry /= 1000000000) limbs[count++] = (uint32_t) (carry % 1000000000);
+        exponent -= step;
+    }
+    out = Format_Unsigned(out, limbs[count - 1]);
+    for (size_t i = count - 1; i-- > 0;) {
+        uint32_t limb = limbs[i];
+        for (int digit = 8; digit >= 0; digit--, limb /= 10) out[digit] = (char) ('0' + limb % 10);
+        out += 9;
+    }
+    *out = '\0';
+    return out;
+}
+
+char *Format_FloatText(char *out, const double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof bits);
+    if (bits >> 63) *out++ = '-';
+    if (isinf(value)) return append(out, "inf", 3);
+    if (isnan(value)) return append(out, "nan", 3);
+
+    // value is mantissa * 2^exponent
+    const int biased = (int) (bits >> 52 & 0x7ff);
+    uint64_t mantissa = bits & 0xfffffffffffffull;
+    if (biased != 0) mantissa |= 1ull << 52;
+    const int exponent = (biased != 0 ? biased : 1) - 1075;
+    if (mantissa == 0) return append(out, "0", 1);
+    if (exponent > 11) return wholeText(out, mantissa, exponent);
+    if (exponent >= 0) return Format_Unsigned(out, mantissa << exponent);
+    if (Format_IsIntegral(value)) return Format_Unsigned(out, mantissa >> -exponent);
+
+    // hundredths, rounded to the nearest with ties to even like printf; below 2^52 they fit easily
+    const uint64_t scaled = mantissa * 100;
+    uint64_t hundredths = 0;
+    if (-exponent < 64) {
+        const int shift = -exponent;
+        const uint64_t rest = scaled & ((1ull << shift) - 1);
+        const uint64_t half = 1ull << (shift - 1);
+        hundredths = scaled >> shift;
+        if (rest > half || (rest == half && (hundredths & 1))) hundredths++;
+    }
+    out = Format_Unsigned(out, hundredths / 100);
+    *out++ = '.';
+    return append(out, &DIGIT_PAIRS[hundredths % 100 * 2], 2);
+}
+
+char *Format_Numbered(const char *name, const char *separator, const unsigned long long number) {
+    const size_t nameLength = strlen(name);
+    const size_t separatorLength = strlen(separator);
+    char *text = malloc(nameLength + separatorLength + FORMAT_NUMBER_MAX);
+    if (text == nullptr) return nullptr;
+    memcpy(text, name, nameLength);
+    memcpy(text + nameLength, separator, separatorLength);
+    Format_Unsigned(text + nameLength + separatorLength, number);
+    return text;
+}
+
+size_t Format_StringSize(const char *value) {
+    size_t size = sizeof "string@";
+    for (const unsigned char *p = (const unsigned char *) value; *p; p++) size += isEscaped(*p) ? 4 : 1;
+    return size;
+}
+
+char *Format_String(char *out, const char *value) {
+    out = append(out, "string@", 7);
+    for (const unsigned char *p = (const unsigned char *) value; *p; p++) {
+        if (!isEscaped(*p)) {
+            *out++ = (char) *p;
+            continue;
+        }
+        *out++ = '\\';
+        *out++ = (char) ('0' + *p / 100);
+        memcpy(out, &DIGIT_PAIRS[*p % 100 * 2], 2);
+        out += 2;
+    }
+    *out = '\0';
+    return out;
+}
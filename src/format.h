@@ -0,0 +1,50 @@
+﻿#ifndef IFJCODE25_FORMAT_H
+#define IFJCODE25_FORMAT_H
+
+#include <stddef.h>
+
+/*
+ * Operand text of IFJcode25 written straight into a caller's buffer, without
+ * the printf family or temporary strings. Each function writes the text and a
+ * terminating '\0' and returns a pointer to that '\0', like stpcpy, so parts
+ * can be chained.
+ */
+
+// Enough for any number operand, int@ or float@ included
+#define FORMAT_NUMBER_MAX 32
+
+// Enough for Format_FloatText of any double, 309 digits of DBL_MAX and a sign
+#define FORMAT_FLOAT_TEXT_MAX 320
+
+// Decimal digits only
+char *Format_Unsigned(char *out, unsigned long long value);
+
+// The decimal value with a '-' if it is negative
+char *Format_Decimal(char *out, long long value);
+
+// int@ and the decimal value
+char *Format_Int(char *out, long long value);
+
+// float@ and the value as C's "%a" writes it, every bit of it kept
+char *Format_Float(char *out, double value);
+
+// Whether value is a whole number, decided without converting it to an integer type
+bool Format_IsIntegral(double value);
+
+// Whether FLOAT2INT takes value, that is whether its integral part fits a long long
+bool Format_FitsInt(double value);
+
+// Ifj.str of a float as FLOAT2STR gives it: whole numbers with no fraction, others with
+// two decimals, rounded like printf's "%.2f" from the exact binary value.
+char *Format_FloatText(char *out, double value);
+
+// name, separator and number in a new string, like the renamed locals LF@x$3%2, nullptr without memory
+char *Format_Numbered(const char *name, const char *separator, unsigned long long number);
+
+// Size of the buffer Format_String needs for value, its '\0' included
+size_t Format_StringSize(const char *value);
+
+// string@ and value with whitespace, control characters, # and \ as \ddd
+char *Format_String(char *out, const char *value);
+
+#endif
@@ -0,0 +1,197 @@
+﻿#include "frame.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "format.h"
+#include "semantic.h"
+
+static bool reserve(void **data, size_t *capacity, const size_t count, const size_t size) {
+    if (count < *capacity) return true;
+    const size_t newCapacity = *capacity ? *capacity * 2 : 16;
+    void *grown = realloc(*data, newCapacity * size);
+    if (grown == nullptr) return false;
+    *data = grown;
+    *capacity = newCapacity;
+    return true;
+}
+
+Frame *Frame_ctor(void) {
+    Frame *frame = calloc(1, sizeof(Frame));
+    if (frame == nullptr) return nullptr;
+    frame->names = Symtable_ctor(0);
+    if (frame->names == nullptr) {
+        free(frame);
+        return nullptr;
+    }
+    return frame;
+}
+
+static ErrorType declare(Frame *frame, const char *name, const size_t position) {
+    unsigned id;
+    const ErrorType error = Symtable_Declare(frame->names, name, &id);
+    if (error != ERROR_OK) return error;
+    if (!reserve((void **) &frame->locals, &frame->localCapacity, frame->localCount, sizeof(FrameLocal))) {
+        return ERROR_OTHER;
+    }
+    frame->locals[frame->localCount++] = (FrameLocal){.name = name, .start = position, .end = position};
+    return ERROR_OK;
+}
+
+static ErrorType use(Frame *frame, const char *name, const size_t position) {
+    unsigned id;
+    if (Symtable_Lookup(frame->names, name, &id) != ERROR_OK) return ERROR_OK;
+    if (!reserve((void **) &frame->uses, &frame->useCapacity, frame->useCount, sizeof(FrameUse))) {
+        return ERROR_OTHER;
+    }
+    frame->uses[frame->useCount++] = (FrameUse){.local = id, .position = position};
+    return ERROR_OK;
+}
+
+// Numbers the nodes in preorder, which is also the order codegen evaluates them in
+static ErrorType walk(Frame *frame, const ASTNode *node, size_t *position) {
+    ErrorType error = ERROR_OK;
+    const size_t here = (*position)++;
+    const Token *token = &node->token;
+
+    if (token->type == TKTYPE_KEYWORD && token->keyword_type == KWTYPE_VAR) {
+        error = declare(frame, ASTNode_child(node, 0)->token.identifier, here);
+    } else if (token->type == TKTYPE_KEYWORD && token->keyword_type == KWTYPE_STATIC) {
+        // parameters of an inlined copy, written after the arguments are evaluated
+        const ASTNode *params = ASTNode_child(node, 0);
+        for (size_t i = 0; i < ASTNode_childCount(params) && error == ERROR_OK; i++) {
+            error = declare(frame, ASTNode_child(params, i)->token.identifier, here);
+        }
+    } else if (token->type == TKTYPE_VARIABLE && strncmp(token->identifier, "LF@", 3) == 0) {
+        error = use(frame, token->identifier, here);
+    }
+    if (error != ERROR_OK) return error;
+
+    size_t loop = 0;
+    const bool isLoop = token->type == TKTYPE_KEYWORD && token->keyword_type == KWTYPE_WHILE;
+    if (isLoop) {
+        if (!reserve((void **) &frame->loops, &frame->loopCapacity, frame->loopCount, sizeof(FrameInterval))) {
+            return ERROR_OTHER;
+        }
+        loop = frame->loopCount++;
+        frame->loops[loop].start = here;
+    }
+    for (size_t i = 0; i < ASTNode_childCount(node) && error == ERROR_OK; i++) {
+        error = walk(frame, ASTNode_child(node, i), position);
+    }
+    if (isLoop) frame->loops[loop].end = *position - 1;
+    return error;
+}
+
+static void extendIntervals(const Frame *frame) {
+    for (size_t i = 0; i < frame->useCount; i++) {
+        const FrameUse *use = &frame->uses[i];
+        FrameLocal *local = &frame->locals[use->local - 1];
+        if (use->position > local->end) local->end = use->position;
+        // a loop that reads a local declared outside it needs the value again on the next iteration
+        for (size_t j = 0; j < frame->loopCount; j++) {
+            const FrameInterval *loop = &frame->loops[j];
+            const bool usedInside = loop->start <= use->position && use->position <= loop->end;
+            const bool declaredInside = loop->start <= local->start && local->start <= loop->end;
+            if (usedInside && !declaredInside && loop->end > local->end) local->end = loop->end;
+        }
+    }
+}
+
+// Locals are already ordered by the start of their interval
+static ErrorType linearScan(Frame *frame) {
+    const size_t count = frame->localCount ? frame->localCount : 1;
+    size_t *active = malloc(count * sizeof(size_t));
+    unsigned *released = malloc(count * sizeof(unsigned));
+    ErrorType error = active && released ? ERROR_OK : ERROR_OTHER;
+    size_t activeCount = 0;
+    size_t releasedCount = 0;
+
+    for (size_t i = 0; i < frame->localCount && error == ERROR_OK; i++) {
+        FrameLocal *local = &frame->locals[i];
+        for (size_t j = 0; j < activeCount;) {
+            const FrameLocal *other = &frame->locals[active[j]];
+            if (other->end < local->start) {
+                released[releasedCount++] = other->slot;
+                active[j] = active[--activeCount];
+            } else {
+                j++;
+            }
+        }
+        if (releasedCount > 0) {
+            local->slot = released[--releasedCount];
+        } else if (reserve((void **) &frame->slots, &frame->slotCapacity, frame->slotCount, sizeof(char *))) {
+            local->slot = (unsigned) frame->slotCount;
+            frame->slots[frame->slotCount++] = local->name;
+        } else {
+            error = ERROR_OTHER;
+        }
+        active[activeCount++] = i;
+    }
+
+    free(released);
+    free(active);
+    return error;
+}
+
+static ErrorType nameParameters(Frame *frame, const unsigned arity) {
+    if (arity > frame->positionalCount) {
+        char **positional = realloc(frame->positional, arity * sizeof(char *));
+        if (positional == nullptr) return ERROR_OTHER;
+        frame->positional = positional;
+        for (; frame->positionalCount < arity; frame->positionalCount++) {
+            frame->positional[frame->positionalCount] = Format_Numbered("LF@", "%", frame->positionalCount + 1);
+            if (frame->positional[frame->positionalCount] == nullptr) return ERROR_OTHER;
+        }
+    }
+    // parameters start together at 0, so the scan gave them the first slots in order
+    for (unsigned i = 0; i < arity; i++) frame->slots[i] = frame->positional[i];
+    frame->paramCount = arity;
+    return ERROR_OK;
+}
+
+ErrorType Frame_Allocate(Frame *frame, const ASTNode *function) {
+    Symtable_Clear(frame->names);
+    frame->localCount = 0;
+    frame->useCount = 0;
+    frame->loopCount = 0;
+    frame->slotCount = 0;
+    frame->paramCount = 0;
+
+    // parameters are live from the prologue on
+    ErrorType error = ERROR_OK;
+    unsigned arity;
+    if (Semantic_FunctionKind(function, &arity) == FNKIND_GETTER) {
+        arity = 0;
+    } else {
+        const ASTNode *params = ASTNode_child(function, 1);
+        for (unsigned i = 0; i < arity && error == ERROR_OK; i++) {
+            error = declare(frame, ASTNode_child(params, i)->token.identifier, 0);
+        }
+    }
+    size_t position = 1;
+    if (error == ERROR_OK) error = walk(frame, ASTNode_child(function, ASTNode_childCount(function) - 1), &position);
+    if (error != ERROR_OK) return error;
+
+    extendIntervals(frame);
+    if ((error = linearScan(frame)) != ERROR_OK) return error;
+    return nameParameters(frame, arity);
+}
+
+const char *Frame_Slot(const Frame *frame, const char *name) {
+    unsigned id;
+    if (Symtable_Lookup(frame->names, name, &id) != ERROR_OK) return name;
+    return frame->slots[frame->locals[id - 1].slot];
+}
+
+void Frame_dtor(Frame *frame) {
+    if (frame == nullptr) return;
+    Symtable_dtor(frame->names);
+    free(frame->locals);
+    free(frame->uses);
+    free(frame->loops);
+    free(frame->slots);
+    for (size_t i = 0; i < frame->positionalCount; i++) free(frame->positional[i]);
+    free(frame->positional);
+    free(frame);
+}
@@ -0,0 +1,72 @@
+﻿#ifndef IFJCODE25_FRAME_H
+#define IFJCODE25_FRAME_H
+
+#include <stddef.h>
+
+#include "error.h"
+#include "parser.h"
+#include "symtable.h"
+
+/*
+ * Frame slot allocation for the locals of one function: parameters, declared
+ * variables and the parameters of inlined copies. Every local gets a live
+ * interval over the preorder positions of the body, from its declaration to
+ * its last use, stretched to the end of any loop that uses it but does not
+ * declare it. A linear scan then lets locals whose intervals do not overlap
+ * share one LF@ variable, named after the first local that got it.
+ *
+ * The parameters take the first slots, which are the LF@%1.. variables the
+ * caller defined in the frame, so the callee neither defines nor copies them.
+ */
+
+typedef struct FrameLocal {
+    const char *name; // points into the AST
+    size_t start;
+    size_t end;
+    unsigned slot;
+} FrameLocal;
+
+typedef struct FrameInterval {
+    size_t start;
+    size_t end;
+} FrameInterval;
+
+typedef struct FrameUse {
+    unsigned local; // id in names
+    size_t position;
+} FrameUse;
+
+typedef struct Frame {
+    Symtable *names; // local frame name -> id, index + 1 into locals
+    FrameLocal *locals;
+    size_t localCount;
+    size_t localCapacity;
+
+    FrameUse *uses;
+    size_t useCount;
+    size_t useCapacity;
+
+    FrameInterval *loops;
+    size_t loopCount;
+    size_t loopCapacity;
+
+    const char **slots; // slot -> frame name
+    size_t slotCount;
+    size_t slotCapacity;
+    size_t paramCount; // slots the caller already defined
+
+    char **positional; // LF@%1.., kept between functions
+    size_t positionalCount;
+} Frame;
+
+Frame *Frame_ctor(void);
+
+// Replaces the previous allocation with one for function
+ErrorType Frame_Allocate(Frame *frame, const ASTNode *function);
+
+// Frame name standing in for a local, or name itself for anything else
+const char *Frame_Slot(const Frame *frame, const char *name);
+
+void Frame_dtor(Frame *frame);
+
+#endif
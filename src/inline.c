@@ -0,0 +1,165 @@
+﻿#include "inline.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "callgraph.h"
+#include "format.h"
+#include "list.h"
+#include "semantic.h"
+
+typedef struct Inliner {
+    ASTNode *root;
+    CallGraph *graph;
+    unsigned threshold;
+    bool *recursive; // by function index
+    bool *visited;   // callers are processed after their callees
+    unsigned instances;
+} Inliner;
+
+static ASTNode *functionBody(const ASTNode *function) {
+    return ASTNode_child(function, ASTNode_childCount(function) - 1);
+}
+
+static size_t countNodes(const ASTNode *node) {
+    size_t count = 1;
+    for (size_t i = 0; i < ASTNode_childCount(node); i++) count += countNodes(ASTNode_child(node, i));
+    return count;
+}
+
+// Every inlined copy gets its own frame names: LF@x$3 -> LF@x$3%<instance>
+static ErrorType renameLocals(ASTNode *node, const unsigned instance) {
+    if (node->token.type == TKTYPE_VARIABLE && strncmp(node->token.identifier, "LF@", 3) == 0) {
+        const char *name = node->token.identifier;
+        char *renamed = Format_Numbered(name, "%", instance);
+        if (renamed == nullptr) return ERROR_OTHER;
+        free((char *) name);
+        node->token.identifier = renamed;
+    }
+    for (size_t i = 0; i < ASTNode_childCount(node); i++) {
+        const ErrorType error = renameLocals(ASTNode_child(node, i), instance);
+        if (error != ERROR_OK) return error;
+    }
+    return ERROR_OK;
+}
+
+static bool isInlinable(const Inliner *inliner, const size_t callee) {
+    if (inliner->recursive[callee]) return false;
+    return countNodes(functionBody(ASTNode_child(inliner->root, callee))) <= inliner->threshold;
+}
+
+/*
+ * Replaces the reference in *slot by an inlined call of callee; the argument
+ * nodes are moved over from the reference (first argument at index first).
+ */
+static ErrorType expand(Inliner *inliner, ASTNode **slot, const size_t callee, const size_t first) {
+    const ASTNode *function = ASTNode_child(inliner->root, callee);
+    ASTNode *reference = *slot;
+
+    ASTNode *call = ASTNode_ctor((Token){.type = TKTYPE_KEYWORD, .keyword_type = KWTYPE_STATIC});
+    ASTNode *params = ASTNode_ctor((Token){.type = TKTYPE_PUNCTUATION, .punctuation_type = PTTYPE_OPENPARENTHESIS});
+    if (ASTNode_addChild(call, params) == nullptr) {
+        ASTNode_dtor(params);
+        ASTNode_dtor(call);
+        return ERROR_OTHER;
+    }
+    call->type = reference->type;
+
+    unsigned arity;
+    if (Semantic_FunctionKind(function, &arity) != FNKIND_GETTER) {
+        const ASTNode *declared = ASTNode_child(function, 1);
+        for (unsigned i = 0; i < arity; i++) {
+            ASTNode *param = ASTNode_clone(ASTNode_child(declared, i));
+            if (ASTNode_addChild(params, param) == nullptr) {
+                ASTNode_dtor(param);
+                ASTNode_dtor(call);
+                return ERROR_OTHER;
+            }
+        }
+    }
+    for (size_t i = first; i < ASTNode_childCount(reference); i++) {
+        if (ASTNode_addChild(call, ASTNode_child(reference, i)) == nullptr) {
+            ASTNode_dtor(call);
+            return ERROR_OTHER;
+        }
+        reference->children->data[i] = nullptr;
+    }
+    ASTNode *body = ASTNode_clone(functionBody(function));
+    if (ASTNode_addChild(call, body) == nullptr) {
+        ASTNode_dtor(body);
+        ASTNode_dtor(call);
+        return ERROR_OTHER;
+    }
+
+    const ErrorType error = renameLocals(params, inliner->instances);
+    if (error != ERROR_OK || renameLocals(body, inliner->instances) != ERROR_OK) {
+        ASTNode_dtor(call);
+        return ERROR_OTHER;
+    }
+    inliner->instances++;
+    ASTNode_dtor(reference);
+    *slot = call;
+    return ERROR_OK;
+}
+
+static ErrorType inlineNode(Inliner *inliner, ASTNode **slot) {
+    ASTNode *node = *slot;
+    for (size_t i = CallGraph_IsNamed(node) ? 1 : 0; i < ASTNode_childCount(node); i++) {
+        const ErrorType error = inlineNode(inliner, &node->children->data[i]);
+        if (error != ERROR_OK) return error;
+    }
+
+    size_t callee;
+    if (!CallGraph_Reference(inliner->graph, node, &callee) || !isInlinable(inliner, callee)) return ERROR_OK;
+    return expand(inliner, slot, callee, node->token.type == TKTYPE_IDENTIFIER ? 0 : 1);
+}
+
+static ErrorType inlineFunction(Inliner *inliner, const size_t index) {
+    if (inliner->visited[index]) return ERROR_OK;
+    inliner->visited[index] = true;
+
+    const CallGraph *graph = inliner->graph;
+    for (size_t i = 0; i < graph->calleeCounts[index]; i++) {
+        const ErrorType error = inlineFunction(inliner, graph->callees[index][i]);
+        if (error != ERROR_OK) return error;
+    }
+    const ASTNode *body = functionBody(ASTNode_child(inliner->root, index));
+    for (size_t i = 0; i < ASTNode_childCount(body); i++) {
+        const ErrorType error = inlineNode(inliner, &body->children->data[i]);
+        if (error != ERROR_OK) return error;
+    }
+    return ERROR_OK;
+}
+
+ErrorType Inline_Program(ASTNode *root, const unsigned threshold) {
+    if (threshold == 0) return ERROR_OK;
+    ErrorType error;
+    CallGraph *graph = CallGraph_ctor(root, &error);
+    if (graph == nullptr) return error;
+
+    const size_t count = ASTNode_childCount(root);
+    Inliner inliner = {
+        .root = root,
+        .graph = graph,
+        .threshold = threshold,
+        .recursive = calloc(count ? count : 1, sizeof(bool)),
+        .visited = calloc(count ? count : 1, sizeof(bool)),
+    };
+    bool *reached = calloc(count ? count : 1, sizeof(bool));
+    if (inliner.recursive == nullptr || inliner.visited == nullptr || reached == nullptr) error = ERROR_OTHER;
+
+    for (size_t i = 0; i < count && error == ERROR_OK; i++) {
+        memset(reached, 0, count * sizeof(bool));
+        CallGraph_Reach(graph, i, reached);
+        inliner.recursive[i] = reached[i];
+    }
+    for (size_t i = 0; i < count && error == ERROR_OK; i++) {
+        error = inlineFunction(&inliner, i);
+    }
+
+    free(reached);
+    free(inliner.visited);
+    free(inliner.recursive);
+    CallGraph_dtor(graph);
+    return error;
+}
@@ -0,0 +1,21 @@
+﻿#ifndef IFJCODE25_INLINE_H
+#define IFJCODE25_INLINE_H
+
+#include "error.h"
+#include "parser.h"
+
+// Largest body (in AST nodes) that is inlined by default
+#define INLINE_DEFAULT_THRESHOLD 40
+
+/*
+ * Replaces calls, getter uses and setter assignments of small non-recursive
+ * functions by an inlined call node holding a copy of the callee's body, with
+ * its locals renamed apart. Callees are processed before their callers, so a
+ * copied body already has its own calls inlined and threshold bounds the size
+ * of every copy. Call sites inside loops are inlined too, codegen defines the
+ * renamed locals of a copy once in the prologue. Needs the whole checked
+ * program; threshold 0 turns inlining off.
+ */
+ErrorType Inline_Program(ASTNode *root, unsigned threshold);
+
+#endif
@@ -0,0 +1,283 @@
+﻿#include "instr.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define INSTR_MIN_CAPACITY 64
+
+// Operand texts are copied into blocks of this size, longer ones get a block of their own
+#define INSTR_TEXT_BLOCK 4096
+
+// Lines up to this long are written with a single fwrite
+#define INSTR_LINE_MAX 512
+
+static const char *const OPCODE_NAMES[OP_COUNT] = {
+    [OP_NOP] = "",
+    [OP_MOVE] = "MOVE",
+    [OP_CREATEFRAME] = "CREATEFRAME",
+    [OP_PUSHFRAME] = "PUSHFRAME",
+    [OP_POPFRAME] = "POPFRAME",
+    [OP_DEFVAR] = "DEFVAR",
+    [OP_CALL] = "CALL",
+    [OP_RETURN] = "RETURN",
+    [OP_PUSHS] = "PUSHS",
+    [OP_POPS] = "POPS",
+    [OP_CLEARS] = "CLEARS",
+    [OP_ADD] = "ADD",
+    [OP_SUB] = "SUB",
+    [OP_MUL] = "MUL",
+    [OP_DIV] = "DIV",
+    [OP_IDIV] = "IDIV",
+    [OP_ADDS] = "ADDS",
+    [OP_SUBS] = "SUBS",
+    [OP_MULS] = "MULS",
+    [OP_DIVS] = "DIVS",
+    [OP_IDIVS] = "IDIVS",
+    [OP_LT] = "LT",
+    [OP_GT] = "GT",
+    [OP_EQ] = "EQ",
+    [OP_LTS] = "LTS",
+    [OP_GTS] = "GTS",
+    [OP_EQS] = "EQS",
+    [OP_AND] = "AND",
+    [OP_OR] = "OR",
+    [OP_NOT] = "NOT",
+    [OP_ANDS] = "ANDS",
+    [OP_ORS] = "ORS",
+    [OP_NOTS] = "NOTS",
+    [OP_INT2FLOAT] = "INT2FLOAT",
+    [OP_FLOAT2INT] = "FLOAT2INT",
+    [OP_INT2CHAR] = "INT2CHAR",
+    [OP_STRI2INT] = "STRI2INT",
+    [OP_INT2STR] = "INT2STR",
+    [OP_FLOAT2STR] = "FLOAT2STR",
+    [OP_INT2FLOATS] = "INT2FLOATS",
+    [OP_FLOAT2INTS] = "FLOAT2INTS",
+    [OP_INT2CHARS] = "INT2CHARS",
+    [OP_STRI2INTS] = "STRI2INTS",
+    [OP_INT2STRS] = "INT2STRS",
+    [OP_FLOAT2STRS] = "FLOAT2STRS",
+    [OP_ISINT] = "ISINT",
+    [OP_ISINTS] = "ISINTS",
+    [OP_READ] = "READ",
+    [OP_WRITE] = "WRITE",
+    [OP_CONCAT] = "CONCAT",
+    [OP_STRLEN] = "STRLEN",
+    [OP_GETCHAR] = "GETCHAR",
+    [OP_SETCHAR] = "SETCHAR",
+    [OP_TYPE] = "TYPE",
+    [OP_TYPES] = "TYPES",
+    [OP_LABEL] = "LABEL",
+    [OP_JUMP] = "JUMP",
+    [OP_JUMPIFEQ] = "JUMPIFEQ",
+    [OP_JUMPIFNEQ] = "JUMPIFNEQ",
+    [OP_JUMPIFEQS] = "JUMPIFEQS",
+    [OP_JUMPIFNEQS] = "JUMPIFNEQS",
+    [OP_EXIT] = "EXIT",
+    [OP_BREAK] = "BREAK",
+    [OP_DPRINT] = "DPRINT",
+};
+
+const char *Opcode_Name(const Opcode opcode) {
+    return opcode < OP_COUNT ? OPCODE_NAMES[opcode] : "";
+}
+
+bool Opcode_WritesFirst(const Opcode opcode) {
+    switch (opcode) {
+        case OP_NOP:
+        case OP_CREATEFRAME:
+        case OP_PUSHFRAME:
+        case OP_POPFRAME:
+        case OP_CALL:
+        case OP_RETURN:
+        case OP_PUSHS:
+        case OP_CLEARS:
+        case OP_ADDS:
+        case OP_SUBS:
+        case OP_MULS:
+        case OP_DIVS:
+        case OP_IDIVS:
+        case OP_LTS:
+        case OP_GTS:
+        case OP_EQS:
+        case OP_ANDS:
+        case OP_ORS:
+        case OP_NOTS:
+        case OP_INT2FLOATS:
+        case OP_FLOAT2INTS:
+        case OP_INT2CHARS:
+        case OP_STRI2INTS:
+        case OP_INT2STRS:
+        case OP_FLOAT2STRS:
+        case OP_ISINTS:
+        case OP_TYPES:
+        case OP_WRITE:
+        case OP_LABEL:
+        case OP_JUMP:
+        case OP_JUMPIFEQ:
+        case OP_JUMPIFNEQ:
+        case OP_JUMPIFEQS:
+        case OP_JUMPIFNEQS:
+        case OP_EXIT:
+        case OP_BREAK:
+        case OP_DPRINT:
+            return false;
+        default:
+            return true;
+    }
+}
+
+InstrList *InstrList_ctor(const size_t capacity) {
+    InstrList *list = malloc(sizeof(InstrList));
+    if (list == nullptr) return nullptr;
+    list->capacity = capacity ? capacity : INSTR_MIN_CAPACITY;
+    list->count = 0;
+    list->failed = false;
+    list->text = nullptr;
+    list->items = malloc(list->capacity * sizeof(Instr));
+    if (list->items == nullptr) {
+        free(list);
+        return nullptr;
+    }
+    return list;
+}
+
+// Copy of text that lives until the list is cleared
+static const char *copyText(InstrList *list, const char *text) {
+    const size_t size = strlen(text) + 1;
+    InstrText *block = list->text;
+    if (block == nullptr || block->size - block->used < size) {
+        const size_t blockSize = size > INSTR_TEXT_BLOCK ? size : INSTR_TEXT_BLOCK;
+        block = malloc(sizeof(InstrText) + blockSize);
+        if (block == nullptr) return nullptr;
+        block->next = list->text;
+        block->size = blockSize;
+        block->used = 0;
+        list->text = block;
+    }
+    char *copy = memcpy(block->text + block->used, text, size);
+    block->used += size;
+    return copy;
+}
+
+static bool grow(InstrList *list) {
+    if (list->count < list->capacity) return true;
+    Instr *items = realloc(list->items, list->capacity * 2 * sizeof(Instr));
+    if (items == nullptr) return false;
+    list->items = items;
+    list->capacity *= 2;
+    return true;
+}
+
+ErrorType InstrList_Insert(InstrList *list, const size_t index, const Opcode opcode, const char *first,
+                           const char *second, const char *third) {
+    if (!grow(list)) return ERROR_OTHER;
+    const char *const given[INSTR_MAX_OPERANDS] = {first, second, third};
+    Instr instr = {.opcode = opcode};
+    for (size_t i = 0; i < INSTR_MAX_OPERANDS && given[i]; i++) {
+        instr.operands[i] = copyText(list, given[i]);
+        if (instr.operands[i] == nullptr) return ERROR_OTHER;
+    }
+    memmove(&list->items[index + 1], &list->items[index], (list->count - index) * sizeof(Instr));
+    list->items[index] = instr;
+    list->count++;
+    return ERROR_OK;
+}
+
+ErrorType InstrList_Set(InstrList *list, const size_t index, const Opcode opcode, const char *first,
+                        const char *second) {
+    const char *operands[INSTR_MAX_OPERANDS] = {
+        first ? copyText(list, first) : nullptr,
+        second ? copyText(list, second) : nullptr,
+    };
+    if ((first && operands[0] == nullptr) || (second && operands[1] == nullptr)) return ERROR_OTHER;
+    Instr *instr = &list->items[index];
+    instr->opcode = opcode;
+    memcpy(instr->operands, operands, sizeof operands);
+    return ERROR_OK;
+}
+
+ErrorType InstrList_SetOperand(InstrList *list, const size_t index, const size_t operand, const char *text) {
+    const char *copy = copyText(list, text);
+    if (copy == nullptr) return ERROR_OTHER;
+    list->items[index].operands[operand] = copy;
+    return ERROR_OK;
+}
+
+void InstrList_Compact(InstrList *list) {
+    size_t kept = 0;
+    for (size_t i = 0; i < list->count; i++) {
+        if (list->items[i].opcode != OP_NOP) list->items[kept++] = list->items[i];
+    }
+    list->count = kept;
+}
+
+// Puts the line of instr together in line, returns its length or 0 if it does not fit
+static size_t formatLine(const Instr *instr, char line[static INSTR_LINE_MAX]) {
+    size_t lengths[INSTR_MAX_OPERANDS] = {};
+    const size_t name = strlen(OPCODE_NAMES[instr->opcode]);
+    size_t total = name + 1;
+    for (size_t j = 0; j < INSTR_MAX_OPERANDS && instr->operands[j]; j++) {
+        lengths[j] = strlen(instr->operands[j]);
+        total += lengths[j] + 1;
+    }
+    if (total > INSTR_LINE_MAX) return 0;
+
+    char *out = line;
+    memcpy(out, OPCODE_NAMES[instr->opcode], name);
+    out += name;
+    for (size_t j = 0; j < INSTR_MAX_OPERANDS && instr->operands[j]; j++) {
+        *out++ = ' ';
+        memcpy(out, instr->operands[j], lengths[j]);
+        out += lengths[j];
+    }
+    *out = '\n';
+    return total;
+}
+
+size_t InstrList_Write(const InstrList *list, FILE *output) {
+    char line[INSTR_LINE_MAX];
+    size_t written = 0;
+    for (size_t i = 0; i < list->count; i++) {
+        const Instr *instr = &list->items[i];
+        if (instr->opcode == OP_NOP) continue;
+        const size_t length = formatLine(instr, line);
+        if (length > 0) {
+            fwrite(line, 1, length, output);
+            written += length;
+            continue;
+        }
+        fputs(OPCODE_NAMES[instr->opcode], output);
+        written += strlen(OPCODE_NAMES[instr->opcode]) + 1;
+        for (size_t j = 0; j < INSTR_MAX_OPERANDS && instr->operands[j]; j++) {
+            fputc(' ', output);
+            fputs(instr->operands[j], output);
+            written += strlen(instr->operands[j]) + 1;
+        }
+        fputc('\n', output);
+    }
+    return written;
+}
+
+// The newest block is kept for the next function
+void InstrList_Clear(InstrList *list) {
+    InstrText *block = list->text;
+    if (block != nullptr) {
+        while (block->next != nullptr) {
+            InstrText *next = block->next;
+            block->next = next->next;
+            free(next);
+        }
+        block->used = 0;
+    }
+    list->count = 0;
+    list->failed = false;
+}
+
+void InstrList_dtor(InstrList *list) {
+    if (list == nullptr) return;
+    InstrList_Clear(list);
+    free(list->text);
+    free(list->items);
+    free(list);
+}
@@ -0,0 +1,132 @@
+﻿#ifndef IFJCODE25_INSTR_H
+#define IFJCODE25_INSTR_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "error.h"
+
+/*
+ * IFJcode25 instructions as generated, before they are written out. Operands
+ * are kept as their textual form (LF@x, int@1, string@a\032b, labels), which
+ * is all the peephole rules need to compare.
+ */
+
+typedef enum Opcode {
+    OP_NOP, // removed by an optimization, never written
+    OP_MOVE,
+    OP_CREATEFRAME,
+    OP_PUSHFRAME,
+    OP_POPFRAME,
+    OP_DEFVAR,
+    OP_CALL,
+    OP_RETURN,
+    OP_PUSHS,
+    OP_POPS,
+    OP_CLEARS,
+    OP_ADD,
+    OP_SUB,
+    OP_MUL,
+    OP_DIV,
+    OP_IDIV,
+    OP_ADDS,
+    OP_SUBS,
+    OP_MULS,
+    OP_DIVS,
+    OP_IDIVS,
+    OP_LT,
+    OP_GT,
+    OP_EQ,
+    OP_LTS,
+    OP_GTS,
+    OP_EQS,
+    OP_AND,
+    OP_OR,
+    OP_NOT,
+    OP_ANDS,
+    OP_ORS,
+    OP_NOTS,
+    OP_INT2FLOAT,
+    OP_FLOAT2INT,
+    OP_INT2CHAR,
+    OP_STRI2INT,
+    OP_INT2STR,
+    OP_FLOAT2STR,
+    OP_INT2FLOATS,
+    OP_FLOAT2INTS,
+    OP_INT2CHARS,
+    OP_STRI2INTS,
+    OP_INT2STRS,
+    OP_FLOAT2STRS,
+    OP_ISINT,
+    OP_ISINTS,
+    OP_READ,
+    OP_WRITE,
+    OP_CONCAT,
+    OP_STRLEN,
+    OP_GETCHAR,
+    OP_SETCHAR,
+    OP_TYPE,
+    OP_TYPES,
+    OP_LABEL,
+    OP_JUMP,
+    OP_JUMPIFEQ,
+    OP_JUMPIFNEQ,
+    OP_JUMPIFEQS,
+    OP_JUMPIFNEQS,
+    OP_EXIT,
+    OP_BREAK,
+    OP_DPRINT,
+    OP_COUNT
+} Opcode;
+
+#define INSTR_MAX_OPERANDS 3
+
+typedef struct Instr {
+    Opcode opcode;
+    const char *operands[INSTR_MAX_OPERANDS]; // in the list's text, unused ones are nullptr
+} Instr;
+
+typedef struct InstrText {
+    struct InstrText *next;
+    size_t used;
+    size_t size;
+    char text[];
+} InstrText;
+
+typedef struct InstrList {
+    Instr *items;
+    size_t count;
+    size_t capacity;
+    bool failed;      // an instruction could not be added, like ferror for a stream
+    InstrText *text;  // copies of the operands, all freed by InstrList_Clear
+} InstrList;
+
+const char *Opcode_Name(Opcode opcode);
+
+// Whether the first operand is a variable the instruction assigns
+bool Opcode_WritesFirst(Opcode opcode);
+
+InstrList *InstrList_ctor(size_t capacity);
+
+// Inserts an instruction before items[index], operands may be nullptr from the first unused one
+ErrorType InstrList_Insert(InstrList *list, size_t index, Opcode opcode, const char *first, const char *second,
+                           const char *third);
+
+// Turns items[index] into a new instruction, operands may be nullptr
+ErrorType InstrList_Set(InstrList *list, size_t index, Opcode opcode, const char *first, const char *second);
+
+// Replaces one operand of items[index]
+ErrorType InstrList_SetOperand(InstrList *list, size_t index, size_t operand, const char *text);
+
+// Drops every OP_NOP
+void InstrList_Compact(InstrList *list);
+
+// Writes every instruction but OP_NOP as a line, returns how many bytes that was
+size_t InstrList_Write(const InstrList *list, FILE *output);
+
+void InstrList_Clear(InstrList *list);
+
+void InstrList_dtor(InstrList *list);
+
+#endif
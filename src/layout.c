@@ -0,0 +1,261 @@
+﻿#include "layout.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "format.h"
+
+typedef struct Layout {
+    const InstrList *code;
+    const Cfg *cfg;
+    bool *cold;
+    size_t *shared;  // per block, block its jumps go to instead, itself if none
+    size_t *order;   // blocks in their new order, without the shared ones
+    size_t orderCount;
+    const char **labels; // per block, label jumps to it use, nullptr if none is needed
+    char **generated;    // per block, label added in front of it, owned
+} Layout;
+
+static const Instr *lastOf(const Layout *layout, const size_t block) {
+    const BasicBlock *b = &layout->cfg->blocks[block];
+    return &layout->code->items[b->first + b->count - 1];
+}
+
+static bool isConditional(const Opcode opcode) {
+    return opcode == OP_JUMPIFEQ || opcode == OP_JUMPIFNEQ || opcode == OP_JUMPIFEQS || opcode == OP_JUMPIFNEQS;
+}
+
+static bool isJump(const Opcode opcode) {
+    return opcode == OP_JUMP || isConditional(opcode);
+}
+
+static Opcode inverted(const Opcode opcode) {
+    switch (opcode) {
+        case OP_JUMPIFEQ:
+            return OP_JUMPIFNEQ;
+        case OP_JUMPIFNEQ:
+            return OP_JUMPIFEQ;
+        case OP_JUMPIFEQS:
+            return OP_JUMPIFNEQS;
+        default:
+            return OP_JUMPIFEQS;
+    }
+}
+
+static bool isNil(const char *operand) {
+    return operand != nullptr && (strcmp(operand, "nil@nil") == 0 || strcmp(operand, "string@nil") == 0);
+}
+
+static bool isErrorExit(const Instr *instr) {
+    return instr->opcode == OP_EXIT && strcmp(instr->operands[0], "int@0") != 0;
+}
+
+static bool isLabelsOnly(const Layout *layout, const size_t block) {
+    const BasicBlock *b = &layout->cfg->blocks[block];
+    for (size_t i = b->first; i < b->first + b->count; i++) {
+        if (layout->code->items[i].opcode != OP_LABEL) return false;
+    }
+    return true;
+}
+
+// Nothing but labels in front of an EXIT, and at least one of them
+static bool isExitOnly(const Layout *layout, const size_t block) {
+    const BasicBlock *b = &layout->cfg->blocks[block];
+    if (b->count < 2 || !isErrorExit(lastOf(layout, block))) return false;
+    for (size_t i = b->first; i < b->first + b->count - 1; i++) {
+        if (layout->code->items[i].opcode != OP_LABEL) return false;
+    }
+    return true;
+}
+
+// Block a jump to label goes to, CFG_NO_BLOCK for a label of another function
+static size_t blockOf(const Layout *layout, const char *label) {
+    unsigned id;
+    if (Symtable_Lookup(layout->cfg->labels, label, &id) != ERROR_OK) return CFG_NO_BLOCK;
+    return layout->cfg->labelBlocks[id - 1];
+}
+
+static void findCold(const Layout *layout) {
+    const Cfg *cfg = layout->cfg;
+    size_t *predecessors = layout->order; // free until the order is built
+    for (size_t b = 0; b < cfg->blockCount; b++) predecessors[b] = 0;
+    for (size_t b = 0; b < cfg->blockCount; b++) {
+        if (cfg->blocks[b].next != CFG_NO_BLOCK) predecessors[cfg->blocks[b].next]++;
+        if (cfg->blocks[b].target != CFG_NO_BLOCK) predecessors[cfg->blocks[b].target]++;
+    }
+
+    for (size_t b = 1; b < cfg->blockCount; b++) {
+        if (isErrorExit(lastOf(layout, b))) layout->cold[b] = true;
+    }
+    for (size_t b = 0; b < cfg->blockCount; b++) {
+        const Instr *last = lastOf(layout, b);
+        if (last->opcode != OP_JUMPIFEQ && last->opcode != OP_JUMPIFNEQ) continue;
+        if (!isNil(last->operands[1]) && !isNil(last->operands[2])) continue;
+        const size_t nilSide = last->opcode == OP_JUMPIFEQ ? cfg->blocks[b].target : cfg->blocks[b].next;
+        // moving an empty block would only add a jump back
+        if (nilSide == CFG_NO_BLOCK || nilSide == 0 || predecessors[nilSide] != 1) continue;
+        if (!isLabelsOnly(layout, nilSide)) layout->cold[nilSide] = true;
+    }
+}
+
+// An exit block nothing falls into is replaced by the first equal one
+static void shareExits(const Layout *layout, unsigned long *shared) {
+    const Cfg *cfg = layout->cfg;
+    bool *fallenInto = calloc(cfg->blockCount, sizeof(bool));
+    for (size_t b = 0; b < cfg->blockCount; b++) layout->shared[b] = b;
+    // without the memory every exit stays where it is
+    if (fallenInto == nullptr) return;
+    for (size_t b = 0; b < cfg->blockCount; b++) {
+        if (cfg->blocks[b].next != CFG_NO_BLOCK) fallenInto[cfg->blocks[b].next] = true;
+    }
+
+    for (size_t b = 1; b < cfg->blockCount; b++) {
+        if (fallenInto[b] || !isExitOnly(layout, b)) continue;
+        for (size_t earlier = 1; earlier < b; earlier++) {
+            if (layout->shared[earlier] != earlier || !isExitOnly(layout, earlier)) continue;
+            if (strcmp(lastOf(layout, earlier)->operands[0], lastOf(layout, b)->operands[0]) != 0) continue;
+            layout->shared[b] = earlier;
+            (*shared)++;
+            break;
+        }
+    }
+    free(fallenInto);
+}
+
+static void buildOrder(Layout *layout, unsigned long *moved) {
+    const Cfg *cfg = layout->cfg;
+    size_t lastHot = 0;
+    for (size_t b = 0; b < cfg->blockCount; b++) {
+        if (!layout->cold[b]) lastHot = b;
+    }
+    layout->orderCount = 0;
+    for (size_t b = 0; b < cfg->blockCount; b++) {
+        if (!layout->cold[b]) layout->order[layout->orderCount++] = b;
+    }
+    for (size_t b = 0; b < cfg->blockCount; b++) {
+        if (!layout->cold[b] || layout->shared[b] != b) continue;
+        layout->order[layout->orderCount++] = b;
+        if (b < lastHot) (*moved)++;
+    }
+}
+
+// Names the blocks a fall-through that no longer holds has to jump to
+static ErrorType nameTargets(const Layout *layout) {
+    const char *function = layout->code->items[0].operands[0];
+    for (size_t k = 0; k < layout->orderCount; k++) {
+        const size_t block = layout->order[k];
+        const size_t fallsTo = layout->cfg->blocks[block].next;
+        const size_t follower = k + 1 < layout->orderCount ? layout->order[k + 1] : CFG_NO_BLOCK;
+        if (fallsTo == CFG_NO_BLOCK || fallsTo == follower || layout->labels[fallsTo] != nullptr) continue;
+
+        const Instr *first = &layout->code->items[layout->cfg->blocks[fallsTo].first];
+        if (first->opcode == OP_LABEL) {
+            layout->labels[fallsTo] = first->operands[0];
+            continue;
+        }
+        // function%cN
+        const size_t length = strlen(function);
+        layout->generated[fallsTo] = malloc(length + 2 + FORMAT_NUMBER_MAX);
+        if (layout->generated[fallsTo] == nullptr) return ERROR_OTHER;
+        memcpy(layout->generated[fallsTo], function, length);
+        memcpy(layout->generated[fallsTo] + length, "%c", 2);
+        Format_Unsigned(layout->generated[fallsTo] + length + 2, fallsTo);
+        layout->labels[fallsTo] = layout->generated[fallsTo];
+    }
+    return ERROR_OK;
+}
+
+static ErrorType append(InstrList *out, const Opcode opcode, const char *const operands[INSTR_MAX_OPERANDS]) {
+    return InstrList_Insert(out, out->count, opcode, operands[0], operands[1], operands[2]);
+}
+
+static ErrorType copyBlock(const Layout *layout, InstrList *out, const size_t k) {
+    const size_t block = layout->order[k];
+    const BasicBlock *b = &layout->cfg->blocks[block];
+    const size_t follower = k + 1 < layout->orderCount ? layout->order[k + 1] : CFG_NO_BLOCK;
+    ErrorType error;
+    if (layout->generated[block] != nullptr) {
+        const char *const label[INSTR_MAX_OPERANDS] = {layout->generated[block]};
+        if ((error = append(out, OP_LABEL, label)) != ERROR_OK) return error;
+    }
+
+    for (size_t i = b->first; i < b->first + b->count; i++) {
+        const Instr *instr = &layout->code->items[i];
+        const char *operands[INSTR_MAX_OPERANDS] = {instr->operands[0], instr->operands[1], instr->operands[2]};
+        Opcode opcode = instr->opcode;
+        size_t target = CFG_NO_BLOCK;
+        if (isJump(opcode) && (target = blockOf(layout, operands[0])) != CFG_NO_BLOCK &&
+            layout->shared[target] != target) {
+            target = layout->shared[target];
+            operands[0] = layout->code->items[layout->cfg->blocks[target].first].operands[0];
+        }
+        // the jump now skips the moved block it used to fall into
+        if (i == b->first + b->count - 1 && isConditional(opcode) && follower != CFG_NO_BLOCK &&
+            b->next != follower && target == follower) {
+            opcode = inverted(opcode);
+            operands[0] = layout->labels[b->next];
+        }
+        if ((error = append(out, opcode, operands)) != ERROR_OK) return error;
+    }
+
+    const Instr *last = &out->items[out->count - 1];
+    if (b->next == CFG_NO_BLOCK || b->next == follower) return ERROR_OK;
+    if (isConditional(last->opcode) && strcmp(last->operands[0], layout->labels[b->next]) == 0) return ERROR_OK;
+    const char *const jump[INSTR_MAX_OPERANDS] = {layout->labels[b->next]};
+    return append(out, OP_JUMP, jump);
+}
+
+static ErrorType rewrite(Layout *layout, InstrList *code, LayoutStats *stats) {
+    unsigned long moved = 0;
+    unsigned long shared = 0;
+    findCold(layout);
+    shareExits(layout, &shared);
+    buildOrder(layout, &moved);
+    if (moved == 0 && shared == 0) return ERROR_OK;
+
+    ErrorType error = nameTargets(layout);
+    if (error != ERROR_OK) return error;
+    InstrList *out = InstrList_ctor(code->count);
+    if (out == nullptr) return ERROR_OTHER;
+    for (size_t k = 0; k < layout->orderCount && error == ERROR_OK; k++) error = copyBlock(layout, out, k);
+    if (error == ERROR_OK) {
+        const InstrList reordered = *out;
+        *out = *code;
+        *code = reordered;
+        stats->moved += moved;
+        stats->shared += shared;
+    }
+    InstrList_dtor(out);
+    return error;
+}
+
+ErrorType Layout_Function(InstrList *code, const Cfg *cfg, LayoutStats *stats) {
+    if (cfg->blockCount < 2 || code->items[0].opcode != OP_LABEL) return ERROR_OK;
+    // code falling off its end would fall into the moved blocks
+    const Opcode end = code->items[code->count - 1].opcode;
+    if (end != OP_JUMP && end != OP_RETURN && end != OP_EXIT) return ERROR_OK;
+
+    Layout layout = {
+        .code = code,
+        .cfg = cfg,
+        .cold = calloc(cfg->blockCount, sizeof(bool)),
+        .shared = calloc(cfg->blockCount, sizeof(size_t)),
+        .order = calloc(cfg->blockCount, sizeof(size_t)),
+        .labels = calloc(cfg->blockCount, sizeof(char *)),
+        .generated = calloc(cfg->blockCount, sizeof(char *)),
+    };
+    ErrorType error = ERROR_OTHER;
+    if (layout.cold != nullptr && layout.shared != nullptr && layout.order != nullptr && layout.labels != nullptr &&
+        layout.generated != nullptr) {
+        error = rewrite(&layout, code, stats);
+    }
+    if (layout.generated != nullptr) {
+        for (size_t b = 0; b < cfg->blockCount; b++) free(layout.generated[b]);
+    }
+    free(layout.cold);
+    free(layout.shared);
+    free(layout.order);
+    free(layout.labels);
+    free(layout.generated);
+    return error;
+}
@@ -0,0 +1,26 @@
+﻿#ifndef IFJCODE25_LAYOUT_H
+#define IFJCODE25_LAYOUT_H
+
+#include "cfg.h"
+#include "error.h"
+#include "instr.h"
+
+typedef struct LayoutStats {
+    unsigned long moved;  // cold blocks placed after the hot code
+    unsigned long shared; // error exits replaced by a jump to an equal one
+} LayoutStats;
+
+/*
+ * Reorders one function's basic blocks so the likely path falls through. Cold
+ * blocks, those ending in an EXIT with an error code and those only entered
+ * when a value was compared equal to nil, go after the rest in their original
+ * order; a conditional jump over a moved block is inverted, any other
+ * fall-through that no longer holds gets a JUMP. Blocks consisting only of
+ * labels and an EXIT are shared by every jump with the same exit code.
+ *
+ * Expects the graph of code, labels it adds are internal and start with the
+ * function's own, so Peephole_Run can remove the jumps that became redundant.
+ */
+ErrorType Layout_Function(InstrList *code, const Cfg *cfg, LayoutStats *stats);
+
+#endif
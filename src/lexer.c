@@ -24,6 +24,8 @@ typedef enum LEXER_STATE {
     LS_INBUILTFUNCTION,
     LS_CANBESPECIALCHARACTERINSTRING,
     LS_CANBEMULTILITECOMMENTEND,
+    LS_CANBENESTEDCOMMENTSTART,
+    LS_CANBENOTORNOTEQUAL,
 } LEXER_STATE;
 
 bool isHexadecimal(const char c) { return isdigit(c) || (c <= 'F' && c >= 'A') || (c <= 'f' && c >= 'a'); }
@@ -118,6 +120,62 @@ inline int getMaxInbuiltFunctionLength() {
     return 8; // read_num
 }
 
+// Characters that end an identifier or a number literal without a separating space
+static bool isTokenTerminator(const int c) {
+    return c != '\0' && strchr("+-*/<>=!&|,;{}", c) != nullptr;
+}
+
+static ErrorOrToken finishIdentifier(StringBuilder *sb) {
+    char *strId = StringBuilder_ToString(sb);
+    StringBuilder_dtor(sb);
+    if (strId == nullptr) {
+        return (ErrorOrToken){.isError = true, .errorType = ERROR_OTHER};
+    }
+    const KEYWORD_TYPE kw = isKeyword(strId);
+    if (kw != KWTYPE_NONE) {
+        free(strId);
+        return (ErrorOrToken){.isError = false, .token = {.type = TKTYPE_KEYWORD, .keyword_type = kw}};
+    }
+    return (ErrorOrToken){.isError = false, .token = {.type = TKTYPE_IDENTIFIER, .identifier = strId}};
+}
+
+static ErrorOrToken finishNumber(StringBuilder *sb, const LEXER_STATE state) {
+    char *strNum = StringBuilder_ToString(sb);
+    StringBuilder_dtor(sb);
+    if (strNum == nullptr) {
+        return (ErrorOrToken){.isError = true, .errorType = ERROR_OTHER};
+    }
+    ErrorOrToken result = {.isError = false};
+    if (state == LS_FLOAT) {
+        result.token = (Token){.type = TKTYPE_LITERAL_FLOAT, .float_value = strtod(strNum, nullptr)};
+    } else {
+        result.token = (Token){.type = TKTYPE_LITERAL_INT, .int_value = strtoll(strNum, nullptr, 10)};
+    }
+    free(strNum);
+    return result;
+}
+
+static ErrorOrToken singleCharOperator(StringBuilder *sb, const LEXER_STATE state) {
+    StringBuilder_dtor(sb);
+    OPERATOR_TYPE op;
+    switch (state) {
+        case LS_CANBEGREATERORGREATEROREQUAL:
+            op = OPTYPE_GREATER;
+            break;
+        case LS_CANBELESSERORLESSOREQUAL:
+            op = OPTYPE_LESS;
+            break;
+        case LS_CANBENOTORNOTEQUAL:
+            op = OPTYPE_NOT;
+            break;
+        case LS_CANBEASSIGNOREQUALS:
+        default:
+            op = OPTYPE_ASSIGN;
+            break;
+    }
+    return (ErrorOrToken){.isError = false, .token = {.type = TKTYPE_OPERATOR, .operator_type = op}};
+}
+
 ErrorOrToken GetNextToken(FILE *source) {
     int c;
     LEXER_STATE state = LS_NONE;
@@ -130,7 +188,47 @@ ErrorOrToken GetNextToken(FILE *source) {
         return result;
     }
 
+    // block comments may be nested
+    unsigned commentDepth = 0;
+
     while ((c = fgetc(source)) != EOF) {
+        switch (state) {
+            case LS_MULTILINE_COMMENT:
+                if (c == '*') state = LS_CANBEMULTILITECOMMENTEND;
+                else if (c == '/') state = LS_CANBENESTEDCOMMENTSTART;
+                continue;
+            case LS_CANBEMULTILITECOMMENTEND:
+                if (c == '/') state = --commentDepth == 0 ? LS_NONE : LS_MULTILINE_COMMENT;
+                else if (c != '*') state = LS_MULTILINE_COMMENT;
+                continue;
+            case LS_CANBENESTEDCOMMENTSTART:
+                if (c == '*') {
+                    commentDepth++;
+                    state = LS_MULTILINE_COMMENT;
+                } else if (c != '/') {
+                    state = LS_MULTILINE_COMMENT;
+                }
+                continue;
+            case LS_CANBEASSIGNOREQUALS:
+            case LS_CANBEGREATERORGREATEROREQUAL:
+            case LS_CANBELESSERORLESSOREQUAL:
+            case LS_CANBENOTORNOTEQUAL:
+                if (c == '=') break;
+                ungetc(c, source);
+                return singleCharOperator(sb, state);
+            case LS_IDENTIFIERORKEYWORD:
+                if (!isTokenTerminator(c)) break;
+                ungetc(c, source);
+                return finishIdentifier(sb);
+            case LS_INTORFLOAT:
+            case LS_FLOAT:
+                if (!isTokenTerminator(c)) break;
+                ungetc(c, source);
+                return finishNumber(sb, state);
+            default:
+                break;
+        }
+
         switch ((char) c) {
             case '\\':
                 switch (state) {
@@ -295,6 +393,7 @@ ErrorOrToken GetNextToken(FILE *source) {
                     }
                     case LS_CANBECOMMENTORDIVIDE:
                         state = LS_MULTILINE_COMMENT;
+                        commentDepth = 1;
                         break;
                     case LS_COMMENT:
                         break;
@@ -334,6 +433,7 @@ ErrorOrToken GetNextToken(FILE *source) {
                         char *strId = StringBuilder_ToString(sb);
 
                         if (strcmp(strId, "Ifj") == 0) {
+                            free(strId);
                             StringBuilder_Clear(sb);
                             state = LS_INBUILTFUNCTION;
                             break;
@@ -364,7 +464,6 @@ ErrorOrToken GetNextToken(FILE *source) {
             case ' ':
             case '\t':
             case '\r':
-                ErrorOrToken token;
                 switch (state) {
                     case LS_NONE:
                         continue;
@@ -372,18 +471,7 @@ ErrorOrToken GetNextToken(FILE *source) {
                         state = LS_MULTILINE_COMMENT;
                         break;
                     case LS_IDENTIFIERORKEYWORD:
-                        token.isError = false;
-                        char *strId = StringBuilder_ToString(sb);
-                        StringBuilder_dtor(sb);
-                        const KEYWORD_TYPE kw = isKeyword(strId);
-                        if (kw != KWTYPE_NONE) {
-                            return (ErrorOrToken){
-                                .isError = false, .token = {.type = TKTYPE_KEYWORD, .keyword_type = kw}
-                            };
-                        }
-                        return (ErrorOrToken){
-                            .isError = false, .token = {.type = TKTYPE_IDENTIFIER, .identifier = strId}
-                        };
+                        return finishIdentifier(sb);
                     case LS_CANBEASSIGNOREQUALS:
                         StringBuilder_dtor(sb);
                         return (ErrorOrToken){
@@ -408,21 +496,9 @@ ErrorOrToken GetNextToken(FILE *source) {
                             StringBuilder_Add(sb, (char) c);
                             break;
                         }
-                        token.isError = false;
-                        const char *strInt = StringBuilder_ToString(sb);
-                        StringBuilder_dtor(sb);
-                        return (ErrorOrToken){
-                            .isError = false, .token = {.type = TKTYPE_LITERAL_INT, .int_value = atoi(strInt)}
-                        };
-                        break;
+                        return finishNumber(sb, LS_INTORFLOAT);
                     case LS_FLOAT:
-                        token.isError = false;
-                        const char *strFloat = StringBuilder_ToString(sb);
-                        StringBuilder_dtor(sb);
-                        return (ErrorOrToken){
-                            .isError = false,
-                            .token = {.type = TKTYPE_LITERAL_FLOAT, .float_value = (float) atof(strFloat)}
-                        };
+                        return finishNumber(sb, LS_FLOAT);
                     case LS_CANBECOMMENTORDIVIDE:
                         StringBuilder_dtor(sb);
                         return (ErrorOrToken){
@@ -624,17 +700,7 @@ ErrorOrToken GetNextToken(FILE *source) {
                         break;
                     case LS_IDENTIFIERORKEYWORD:
                         ungetc(c, source);
-                        char *strId = StringBuilder_ToString(sb);
-                        StringBuilder_dtor(sb);
-                        const KEYWORD_TYPE kw = isKeyword(strId);
-                        if (kw != KWTYPE_NONE) {
-                            return (ErrorOrToken){
-                                .isError = false, .token = {.type = TKTYPE_KEYWORD, .keyword_type = kw}
-                            };
-                        }
-                        return (ErrorOrToken){
-                            .isError = false, .token = {.type = TKTYPE_IDENTIFIER, .identifier = strId}
-                        };
+                        return finishIdentifier(sb);
                     case LS_CANBECOMMENTORDIVIDE:
                         ungetc(c, source);
                         StringBuilder_dtor(sb);
@@ -681,17 +747,7 @@ ErrorOrToken GetNextToken(FILE *source) {
                         break;
                     case LS_IDENTIFIERORKEYWORD:
                         ungetc(c, source);
-                        char *strId = StringBuilder_ToString(sb);
-                        StringBuilder_dtor(sb);
-                        const KEYWORD_TYPE kw = isKeyword(strId);
-                        if (kw != KWTYPE_NONE) {
-                            return (ErrorOrToken){
-                                .isError = false, .token = {.type = TKTYPE_KEYWORD, .keyword_type = kw}
-                            };
-                        }
-                        return (ErrorOrToken){
-                            .isError = false, .token = {.type = TKTYPE_IDENTIFIER, .identifier = strId}
-                        };
+                        return finishIdentifier(sb);
                     case LS_CANBECOMMENTORDIVIDE:
                         ungetc(c, source);
                         StringBuilder_dtor(sb);
@@ -704,19 +760,10 @@ ErrorOrToken GetNextToken(FILE *source) {
                         break;
                     case LS_FLOAT:
                         ungetc(c, source);
-                        char *strFloat = StringBuilder_ToString(sb);
-                        StringBuilder_dtor(sb);
-                        return (ErrorOrToken){
-                            .isError = false,
-                            .token = {.type = TKTYPE_LITERAL_FLOAT, .float_value = (float) atof(strFloat)}
-                        };
+                        return finishNumber(sb, LS_FLOAT);
                     case LS_INTORFLOAT:
                         ungetc(c, source);
-                        char *strInt = StringBuilder_ToString(sb);
-                        StringBuilder_dtor(sb);
-                        return (ErrorOrToken){
-                            .isError = false, .token = {.type = TKTYPE_LITERAL_INT, .int_value = atoi(strInt)}
-                        };
+                        return finishNumber(sb, LS_INTORFLOAT);
                     default:
                         return (ErrorOrToken){.isError = true, .errorType = ERROR_LEXICAL};
                 }
@@ -737,17 +784,7 @@ ErrorOrToken GetNextToken(FILE *source) {
                         break;
                     case LS_IDENTIFIERORKEYWORD:
                         ungetc(c, source);
-                        char *strId = StringBuilder_ToString(sb);
-                        StringBuilder_dtor(sb);
-                        const KEYWORD_TYPE kw = isKeyword(strId);
-                        if (kw != KWTYPE_NONE) {
-                            return (ErrorOrToken){
-                                .isError = false, .token = {.type = TKTYPE_KEYWORD, .keyword_type = kw}
-                            };
-                        }
-                        return (ErrorOrToken){
-                            .isError = false, .token = {.type = TKTYPE_IDENTIFIER, .identifier = strId}
-                        };
+                        return finishIdentifier(sb);
                     case LS_CANBECOMMENTORDIVIDE:
                         ungetc(c, source);
                         StringBuilder_dtor(sb);
@@ -897,11 +934,8 @@ ErrorOrToken GetNextToken(FILE *source) {
             case '<':
                 switch (state) {
                     case LS_NONE:
-                        StringBuilder_dtor(sb);
-                        return (ErrorOrToken){
-                            .isError = false,
-                            .token = {.type = TKTYPE_OPERATOR, .operator_type = OPTYPE_LESS}
-                        };
+                        state = LS_CANBELESSERORLESSOREQUAL;
+                        break;
                     case LS_CANBEMULTILITECOMMENTEND:
                         state = LS_MULTILINE_COMMENT;
                         break;
@@ -939,6 +973,58 @@ ErrorOrToken GetNextToken(FILE *source) {
                 }
                 break;
 
+            case '&':
+            case '|':
+                switch (state) {
+                    case LS_NONE:
+                        StringBuilder_dtor(sb);
+                        // only && and || exist
+                        if (fgetc(source) != c) return (ErrorOrToken){.isError = true, .errorType = ERROR_LEXICAL};
+                        return (ErrorOrToken){
+                            .isError = false,
+                            .token = {.type = TKTYPE_OPERATOR, .operator_type = c == '&' ? OPTYPE_AND : OPTYPE_OR}
+                        };
+                    case LS_STRING:
+                        StringBuilder_Add(sb, (char) c);
+                        break;
+                    case LS_CANBECOMMENTORDIVIDE:
+                        ungetc(c, source);
+                        StringBuilder_dtor(sb);
+                        return (ErrorOrToken){
+                            .isError = false,
+                            .token = {.type = TKTYPE_OPERATOR, .operator_type = OPTYPE_DIVIDE}
+                        };
+                    case LS_COMMENT:
+                        break;
+                    default:
+                        StringBuilder_dtor(sb);
+                        return (ErrorOrToken){.isError = true, .errorType = ERROR_LEXICAL};
+                }
+                break;
+
+            case '!':
+                switch (state) {
+                    case LS_NONE:
+                        state = LS_CANBENOTORNOTEQUAL;
+                        break;
+                    case LS_STRING:
+                        StringBuilder_Add(sb, (char) c);
+                        break;
+                    case LS_CANBECOMMENTORDIVIDE:
+                        ungetc(c, source);
+                        StringBuilder_dtor(sb);
+                        return (ErrorOrToken){
+                            .isError = false,
+                            .token = {.type = TKTYPE_OPERATOR, .operator_type = OPTYPE_DIVIDE}
+                        };
+                    case LS_COMMENT:
+                        break;
+                    default:
+                        StringBuilder_dtor(sb);
+                        return (ErrorOrToken){.isError = true, .errorType = ERROR_LEXICAL};
+                }
+                break;
+
             case '=':
                 switch (state) {
                     case LS_NONE:
@@ -951,7 +1037,13 @@ ErrorOrToken GetNextToken(FILE *source) {
                         StringBuilder_dtor(sb);
                         return (ErrorOrToken){
                             .isError = false,
-                            .token = {.type = TKTYPE_OPERATOR, .operator_type = OPTYPE_ASSIGN}
+                            .token = {.type = TKTYPE_OPERATOR, .operator_type = OPTYPE_EQUAL}
+                        };
+                    case LS_CANBENOTORNOTEQUAL:
+                        StringBuilder_dtor(sb);
+                        return (ErrorOrToken){
+                            .isError = false,
+                            .token = {.type = TKTYPE_OPERATOR, .operator_type = OPTYPE_NOTEQUAL}
                         };
                     case LS_CANBELESSERORLESSOREQUAL:
                         StringBuilder_dtor(sb);
@@ -1039,3 +1131,19 @@ ErrorOrToken GetNextToken(FILE *source) {
     StringBuilder_dtor(sb);
     return (ErrorOrToken){.isError = false, .token = {.type = TKTYPE_EOF}};
 }
+
+void FreeToken(Token *token) {
+    switch (token->type) {
+        case TKTYPE_IDENTIFIER:
+        case TKTYPE_VARIABLE:
+            free((char *) token->identifier);
+            token->identifier = nullptr;
+            break;
+        case TKTYPE_LITERAL_STRING:
+            free((char *) token->string_value);
+            token->string_value = nullptr;
+            break;
+        default:
+            break;
+    }
+}
@@ -4,7 +4,10 @@
 #include <stdio.h>
 
 struct ErrorOrToken;
+struct Token;
 
 struct ErrorOrToken GetNextToken(FILE *source);
 
+void FreeToken(struct Token *token);
+
 #endif
@@ -32,6 +32,17 @@ void List_Add(List *list, const ASTNode *data) {
     list->data[list->count++] = (ASTNode *) data;
 }
 
+void List_Remove(List *list, const size_t index) {
+    if (index >= list->count) {
+        return;
+    }
+    ASTNode_dtor(list->data[index]);
+    for (size_t i = index + 1; i < list->count; i++) {
+        list->data[i - 1] = list->data[i];
+    }
+    list->count--;
+}
+
 void List_Clear(List *list) {
     for (size_t i = 0; i < list->count; i++) {
         ASTNode_dtor(list->data[i]);
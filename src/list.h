@@ -17,6 +17,9 @@ List *List_ctor(size_t capacity);
 
 void List_Add(List *list, const ASTNode *data);
 
+// Frees the element at index and shifts the rest down
+void List_Remove(List *list, size_t index);
+
 void List_Clear(List *list);
 
 void List_dtor(List *list);
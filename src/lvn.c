@@ -0,0 +1,223 @@
+﻿#include "lvn.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct ValueName {
+    char *name; // variable or constant, owned
+    unsigned value;
+} ValueName;
+
+typedef struct Expression {
+    Opcode opcode;
+    unsigned left;
+    unsigned right; // 0 for a single operand
+    unsigned value;
+} Expression;
+
+typedef struct Numbering {
+    ValueName *names;
+    size_t nameCount;
+    size_t nameCapacity;
+
+    Expression *expressions;
+    size_t expressionCount;
+    size_t expressionCapacity;
+
+    unsigned valueCount;
+} Numbering;
+
+static bool reserve(void **data, size_t *capacity, const size_t count, const size_t size) {
+    if (count < *capacity) return true;
+    const size_t newCapacity = *capacity ? *capacity * 2 : 16;
+    void *grown = realloc(*data, newCapacity * size);
+    if (grown == nullptr) return false;
+    *data = grown;
+    *capacity = newCapacity;
+    return true;
+}
+
+static bool isPure(const Opcode opcode) {
+    switch (opcode) {
+        case OP_ADD:
+        case OP_SUB:
+        case OP_MUL:
+        case OP_DIV:
+        case OP_IDIV:
+        case OP_LT:
+        case OP_GT:
+        case OP_EQ:
+        case OP_AND:
+        case OP_OR:
+        case OP_NOT:
+        case OP_INT2FLOAT:
+        case OP_FLOAT2INT:
+        case OP_INT2CHAR:
+        case OP_STRI2INT:
+        case OP_INT2STR:
+        case OP_FLOAT2STR:
+        case OP_ISINT:
+        case OP_CONCAT:
+        case OP_STRLEN:
+        case OP_GETCHAR:
+        case OP_TYPE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool isCommutative(const Opcode opcode) {
+    return opcode == OP_ADD || opcode == OP_MUL || opcode == OP_EQ || opcode == OP_AND || opcode == OP_OR;
+}
+
+static ValueName *findName(const Numbering *numbering, const char *name) {
+    for (size_t i = 0; i < numbering->nameCount; i++) {
+        if (strcmp(numbering->names[i].name, name) == 0) return &numbering->names[i];
+    }
+    return nullptr;
+}
+
+// Some variable or constant currently holding value
+static const char *holder(const Numbering *numbering, const unsigned value) {
+    for (size_t i = 0; i < numbering->nameCount; i++) {
+        if (numbering->names[i].value == value) return numbering->names[i].name;
+    }
+    return nullptr;
+}
+
+static ErrorType assign(Numbering *numbering, const char *name, const unsigned value) {
+    ValueName *known = findName(numbering, name);
+    if (known != nullptr) {
+        known->value = value;
+        return ERROR_OK;
+    }
+    if (!reserve((void **) &numbering->names, &numbering->nameCapacity, numbering->nameCount, sizeof(ValueName))) {
+        return ERROR_OTHER;
+    }
+    char *copy = strdup(name);
+    if (copy == nullptr) return ERROR_OTHER;
+    numbering->names[numbering->nameCount++] = (ValueName){.name = copy, .value = value};
+    return ERROR_OK;
+}
+
+static ErrorType valueOf(Numbering *numbering, const char *name, unsigned *value) {
+    const ValueName *known = findName(numbering, name);
+    if (known != nullptr) {
+        *value = known->value;
+        return ERROR_OK;
+    }
+    *value = ++numbering->valueCount;
+    return assign(numbering, name, *value);
+}
+
+// Variables of frame (GF@, LF@ or TF@) may have changed behind the block's back
+static void forget(Numbering *numbering, const char *frame) {
+    for (size_t i = 0; i < numbering->nameCount;) {
+        if (strncmp(numbering->names[i].name, frame, 3) == 0) {
+            free(numbering->names[i].name);
+            numbering->names[i] = numbering->names[--numbering->nameCount];
+        } else {
+            i++;
+        }
+    }
+}
+
+static void reset(Numbering *numbering) {
+    for (size_t i = 0; i < numbering->nameCount; i++) free(numbering->names[i].name);
+    numbering->nameCount = 0;
+    numbering->expressionCount = 0;
+}
+
+static ErrorType numberMove(Numbering *numbering, InstrList *code, const size_t index, unsigned long *reused) {
+    const Instr *instr = &code->items[index];
+    unsigned value;
+    ErrorType error = valueOf(numbering, instr->operands[1], &value);
+    if (error != ERROR_OK) return error;
+    const ValueName *target = findName(numbering, instr->operands[0]);
+    if (target != nullptr && target->value == value) {
+        (*reused)++;
+        return InstrList_Set(code, index, OP_NOP, nullptr, nullptr);
+    }
+    return assign(numbering, instr->operands[0], value);
+}
+
+static ErrorType numberPure(Numbering *numbering, InstrList *code, const size_t index, unsigned long *reused) {
+    const Instr *instr = &code->items[index];
+    Expression key = {.opcode = instr->opcode};
+    ErrorType error = valueOf(numbering, instr->operands[1], &key.left);
+    if (error == ERROR_OK && instr->operands[2] != nullptr) error = valueOf(numbering, instr->operands[2], &key.right);
+    if (error != ERROR_OK) return error;
+    if (isCommutative(key.opcode) && key.left > key.right) {
+        const unsigned swap = key.left;
+        key.left = key.right;
+        key.right = swap;
+    }
+
+    for (size_t i = 0; i < numbering->expressionCount; i++) {
+        const Expression *known = &numbering->expressions[i];
+        if (known->opcode != key.opcode || known->left != key.left || known->right != key.right) continue;
+        const ValueName *target = findName(numbering, instr->operands[0]);
+        if (target != nullptr && target->value == known->value) {
+            (*reused)++;
+            return InstrList_Set(code, index, OP_NOP, nullptr, nullptr);
+        }
+        const char *source = holder(numbering, known->value);
+        if (source != nullptr) {
+            (*reused)++;
+            error = InstrList_Set(code, index, OP_MOVE, instr->operands[0], source);
+            if (error != ERROR_OK) return error;
+        }
+        return assign(numbering, code->items[index].operands[0], known->value);
+    }
+
+    if (!reserve((void **) &numbering->expressions, &numbering->expressionCapacity, numbering->expressionCount,
+                 sizeof(Expression))) {
+        return ERROR_OTHER;
+    }
+    key.value = ++numbering->valueCount;
+    numbering->expressions[numbering->expressionCount++] = key;
+    return assign(numbering, instr->operands[0], key.value);
+}
+
+static ErrorType number(Numbering *numbering, InstrList *code, const size_t index, unsigned long *reused) {
+    const Instr *instr = &code->items[index];
+    switch (instr->opcode) {
+        case OP_MOVE:
+            return numberMove(numbering, code, index, reused);
+        case OP_CALL:
+            forget(numbering, "GF@");
+            forget(numbering, "TF@");
+            return ERROR_OK;
+        case OP_CREATEFRAME:
+            forget(numbering, "TF@");
+            return ERROR_OK;
+        case OP_PUSHFRAME:
+        case OP_POPFRAME:
+            forget(numbering, "LF@");
+            forget(numbering, "TF@");
+            return ERROR_OK;
+        default:
+            if (isPure(instr->opcode)) return numberPure(numbering, code, index, reused);
+            if (!Opcode_WritesFirst(instr->opcode)) return ERROR_OK;
+            // anything else assigns a value nothing else is known to hold
+            return assign(numbering, instr->operands[0], ++numbering->valueCount);
+    }
+}
+
+ErrorType Lvn_Function(InstrList *code, const Cfg *cfg, unsigned long *reused) {
+    Numbering numbering = {};
+    ErrorType error = ERROR_OK;
+    for (size_t b = 0; b < cfg->blockCount && error == ERROR_OK; b++) {
+        const BasicBlock *block = &cfg->blocks[b];
+        reset(&numbering);
+        for (size_t i = block->first; i < block->first + block->count && error == ERROR_OK; i++) {
+            error = number(&numbering, code, i, reused);
+        }
+    }
+    reset(&numbering);
+    free(numbering.names);
+    free(numbering.expressions);
+    InstrList_Compact(code);
+    return error;
+}
@@ -0,0 +1,22 @@
+﻿#ifndef IFJCODE25_LVN_H
+#define IFJCODE25_LVN_H
+
+#include "cfg.h"
+#include "error.h"
+#include "instr.h"
+
+/*
+ * Local value numbering over the basic blocks of three-address code. Every
+ * variable and constant gets the number of the value it holds; a pure
+ * instruction (arithmetic, comparison, TYPE, conversions, STRLEN, ...) whose
+ * operation was already computed on the same value numbers becomes a MOVE from
+ * a variable still holding the result, or disappears if its target already
+ * holds it, and so does a MOVE of a value the target already has.
+ *
+ * Assignments only renumber their target. CALL forgets GF@ and TF@ variables,
+ * since a setter or any other function may change the globals, and frame
+ * instructions forget the frames they replace.
+ */
+ErrorType Lvn_Function(InstrList *code, const Cfg *cfg, unsigned long *reused);
+
+#endif
@@ -0,0 +1,178 @@
+﻿#include "parallel.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct Unit {
+    char *text; // generated code of one function, owned
+    size_t size;
+    char **globals; // GF@ variables it uses in order of first use, owned
+    size_t globalCount;
+    ErrorType error;
+} Unit;
+
+typedef struct Pool {
+    const ASTNode *root;
+    Unit *units; // one per function of root
+    size_t count;
+    atomic_size_t next; // first function no worker took yet
+    atomic_bool failed;
+} Pool;
+
+typedef struct Worker {
+    Pool *pool;
+    Codegen *gen;
+} Worker;
+
+static double now(void) {
+    struct timespec time;
+    if (timespec_get(&time, TIME_UTC) == 0) return 0.0;
+    return (double) time.tv_sec + (double) time.tv_nsec / 1e9;
+}
+
+static ErrorType keepGlobals(const Codegen *gen, Unit *unit) {
+    const Symtable *globals = gen->globals;
+    if (globals->entryCount == 0) return ERROR_OK;
+    unit->globals = calloc(globals->entryCount, sizeof(char *));
+    if (unit->globals == nullptr) return ERROR_OTHER;
+    for (; unit->globalCount < globals->entryCount; unit->globalCount++) {
+        unit->globals[unit->globalCount] = strdup(globals->entries[unit->globalCount].name);
+        if (unit->globals[unit->globalCount] == nullptr) return ERROR_OTHER;
+    }
+    return ERROR_OK;
+}
+
+static ErrorType generateUnit(Codegen *gen, const ASTNode *function, Unit *unit) {
+    FILE *output = open_memstream(&unit->text, &unit->size);
+    if (output == nullptr) return ERROR_OTHER;
+    gen->output = output;
+    // only the globals of this function, the ones seen before are merged already
+    Symtable_Clear(gen->globals);
+    ErrorType error = Codegen_Function(gen, function);
+    if (error == ERROR_OK && ferror(output)) error = ERROR_OTHER;
+    gen->output = nullptr;
+    if (fclose(output) != 0 && error == ERROR_OK) error = ERROR_OTHER;
+    if (error != ERROR_OK) return error;
+    return keepGlobals(gen, unit);
+}
+
+static void *work(void *argument) {
+    const Worker *worker = argument;
+    Pool *pool = worker->pool;
+    while (!atomic_load(&pool->failed)) {
+        const size_t index = atomic_fetch_add(&pool->next, 1);
+        if (index >= pool->count) break;
+        Unit *unit = &pool->units[index];
+        unit->error = generateUnit(worker->gen, ASTNode_child(pool->root, index), unit);
+        // the functions after it are not written anyway
+        if (unit->error != ERROR_OK) atomic_store(&pool->failed, true);
+    }
+    return nullptr;
+}
+
+static Codegen *createWorker(const Codegen *gen) {
+    Codegen *worker = Codegen_ctor(nullptr);
+    if (worker == nullptr) return nullptr;
+    worker->accumulate = gen->accumulate;
+    worker->optimize = gen->optimize;
+    return worker;
+}
+
+static ErrorType mergeStrings(StringPool *into, const StringPool *from) {
+    for (size_t i = 0; i < from->values->entryCount; i++) {
+        if (StringPool_Encode(into, from->values->entries[i].name) == nullptr) return ERROR_OTHER;
+    }
+    into->reused += from->reused;
+    return ERROR_OK;
+}
+
+static void mergeCounters(Codegen *into, const Codegen *from) {
+    into->inbuilts |= from->inbuilts;
+    into->helpers |= from->helpers;
+    into->typeChecks += from->typeChecks;
+    into->typeChecksElided += from->typeChecksElided;
+    into->frameLocals += from->frameLocals;
+    into->frameSlots += from->frameSlots;
+    into->unreachableRemoved += from->unreachableRemoved;
+    into->stackSaved += from->stackSaved;
+    into->valuesReused += from->valuesReused;
+    into->tailCalls += from->tailCalls;
+    into->accumulated += from->accumulated;
+    into->loopsVersioned += from->loopsVersioned;
+    into->literalsJoined += from->literalsJoined;
+    into->helperCalls += from->helperCalls;
+    into->inbuiltsLowered += from->inbuiltsLowered;
+    into->writesMerged += from->writesMerged;
+    into->seconds += from->seconds;
+    into->layout.moved += from->layout.moved;
+    into->layout.shared += from->layout.shared;
+    for (PeepholeRule rule = 0; rule < PEEPHOLE_RULE_COUNT; rule++) {
+        into->peephole.removed[rule] += from->peephole.removed[rule];
+    }
+}
+
+// Writes the functions out in source order, up to the first one that failed
+static ErrorType mergeUnits(Codegen *gen, const Pool *pool) {
+    for (size_t i = 0; i < pool->count; i++) {
+        const Unit *unit = &pool->units[i];
+        if (unit->error != ERROR_OK) return unit->error;
+        const double start = now();
+        if (fwrite(unit->text, 1, unit->size, gen->output) != unit->size) return ERROR_OTHER;
+        gen->bytesWritten += unit->size;
+        gen->seconds += now() - start;
+        for (size_t g = 0; g < unit->globalCount; g++) {
+            const ErrorType error = Symtable_Declare(gen->globals, unit->globals[g], nullptr);
+            if (error != ERROR_OK && error != ERROR_SEMANTIC_REDEFINITION) return error;
+        }
+    }
+    return ERROR_OK;
+}
+
+static ErrorType runWorkers(Worker *workers, const unsigned jobs) {
+    pthread_t *threads = calloc(jobs, sizeof(pthread_t));
+    if (threads == nullptr) return ERROR_OTHER;
+    // the calling thread is the first worker, so a thread that cannot be started only costs speed
+    unsigned started = 0;
+    for (unsigned i = 1; i < jobs; i++) {
+        if (pthread_create(&threads[started], nullptr, work, &workers[i]) == 0) started++;
+    }
+    work(&workers[0]);
+    for (unsigned i = 0; i < started; i++) pthread_join(threads[i], nullptr);
+    free(threads);
+    return ERROR_OK;
+}
+
+ErrorType Parallel_Codegen(Codegen *gen, const ASTNode *root, unsigned jobs) {
+    Pool pool = {.root = root, .count = ASTNode_childCount(root)};
+    atomic_init(&pool.next, 0);
+    atomic_init(&pool.failed, false);
+    if (jobs > pool.count) jobs = pool.count > 0 ? (unsigned) pool.count : 1;
+    pool.units = calloc(pool.count > 0 ? pool.count : 1, sizeof(Unit));
+    Worker *workers = calloc(jobs, sizeof(Worker));
+
+    ErrorType error = pool.units != nullptr && workers != nullptr ? ERROR_OK : ERROR_OTHER;
+    for (unsigned i = 0; i < jobs && error == ERROR_OK; i++) {
+        workers[i] = (Worker){.pool = &pool, .gen = createWorker(gen)};
+        if (workers[i].gen == nullptr) error = ERROR_OTHER;
+    }
+    if (error == ERROR_OK) error = runWorkers(workers, jobs);
+    if (error == ERROR_OK) error = mergeUnits(gen, &pool);
+    for (unsigned i = 0; i < jobs && workers != nullptr; i++) {
+        if (workers[i].gen == nullptr) continue;
+        if (error == ERROR_OK) error = mergeStrings(gen->strings, workers[i].gen->strings);
+        mergeCounters(gen, workers[i].gen);
+        Codegen_dtor(workers[i].gen);
+    }
+
+    for (size_t i = 0; i < pool.count && pool.units != nullptr; i++) {
+        free(pool.units[i].text);
+        for (size_t g = 0; g < pool.units[i].globalCount; g++) free(pool.units[i].globals[g]);
+        free(pool.units[i].globals);
+    }
+    free(pool.units);
+    free(workers);
+    return error;
+}
@@ -0,0 +1,20 @@
+﻿#ifndef IFJCODE25_PARALLEL_H
+#define IFJCODE25_PARALLEL_H
+
+#include "codegen.h"
+#include "error.h"
+#include "parser.h"
+
+/*
+ * Code generation of an analysed program on up to jobs threads. Each worker
+ * has a Codegen of its own and takes the functions of root in turn, writing
+ * each into a separate buffer; labels are numbered per function, so a
+ * function's text does not depend on the worker. The buffers are appended to
+ * gen's output in source order and the globals, runtime routines, string
+ * literals and statistics of the workers are merged into gen, so the result is
+ * the same as calling Codegen_Function on every function in turn. On an error
+ * only the functions before the first failing one are written.
+ */
+ErrorType Parallel_Codegen(Codegen *gen, const ASTNode *root, unsigned jobs);
+
+#endif
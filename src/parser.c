@@ -1,15 +1,604 @@
 ﻿#include "parser.h"
 #include <stdlib.h>
+#include <string.h>
 
+#include "lexer.h"
 #include "list.h"
 
-ASTNode *ASTNode_ctor();
+#define AST_MIN_CHILDREN 4
 
+ASTNode *ASTNode_ctor(const Token token) {
+    ASTNode *node = malloc(sizeof(ASTNode));
+    if (node == nullptr) return nullptr;
+    node->token = token;
+    node->children = nullptr;
+    node->type = VT_ANY;
+    return node;
+}
+
+ASTNode *ASTNode_addChild(ASTNode *parent, const ASTNode *child) {
+    if (parent == nullptr || child == nullptr) return nullptr;
+    if (parent->children == nullptr) {
+        parent->children = List_ctor(AST_MIN_CHILDREN);
+        if (parent->children == nullptr) return nullptr;
+    }
+    const size_t count = parent->children->count;
+    List_Add(parent->children, child);
+    if (parent->children->count == count) return nullptr;
+    return (ASTNode *) child;
+}
+
+size_t ASTNode_childCount(const ASTNode *node) {
+    return node->children ? node->children->count : 0;
+}
+
+ASTNode *ASTNode_child(const ASTNode *node, const size_t index) {
+    if (index >= ASTNode_childCount(node)) return nullptr;
+    return node->children->data[index];
+}
+
+ASTNode *ASTNode_clone(const ASTNode *node) {
+    Token token = node->token;
+    if (token.type == TKTYPE_IDENTIFIER || token.type == TKTYPE_VARIABLE) {
+        if ((token.identifier = strdup(token.identifier)) == nullptr) return nullptr;
+    } else if (token.type == TKTYPE_LITERAL_STRING) {
+        if ((token.string_value = strdup(token.string_value)) == nullptr) return nullptr;
+    }
+    ASTNode *copy = ASTNode_ctor(token);
+    if (copy == nullptr) {
+        FreeToken(&token);
+        return nullptr;
+    }
+    copy->type = node->type;
+    for (size_t i = 0; i < ASTNode_childCount(node); i++) {
+        ASTNode *child = ASTNode_clone(ASTNode_child(node, i));
+        if (ASTNode_addChild(copy, child) == nullptr) {
+            ASTNode_dtor(child);
+            ASTNode_dtor(copy);
+            return nullptr;
+        }
+    }
+    return copy;
+}
 
 void ASTNode_dtor(ASTNode *node) {
-    if (node == NULL) return;
+    if (node == nullptr) return;
     if (node->children) {
         List_dtor(node->children);
     }
+    FreeToken(&node->token);
     free(node);
 }
+
+// ---------------------------------------------------------------------------
+// Token stream
+
+static bool isPunctuation(const Token *token, const PUNCTUATION_TYPE type) {
+    return token->type == TKTYPE_PUNCTUATION && token->punctuation_type == type;
+}
+
+static bool isKeyword(const Token *token, const KEYWORD_TYPE type) {
+    return token->type == TKTYPE_KEYWORD && token->keyword_type == type;
+}
+
+static bool isOperator(const Token *token, const OPERATOR_TYPE type) {
+    return token->type == TKTYPE_OPERATOR && token->operator_type == type;
+}
+
+static ErrorType advance(Parser *parser) {
+    FreeToken(&parser->token);
+    const ErrorOrToken next = GetNextToken(parser->source);
+    if (next.isError) {
+        parser->token = (Token){.type = TKTYPE_EOF};
+        return next.errorType;
+    }
+    parser->token = next.token;
+    return ERROR_OK;
+}
+
+// Moves the current token out of the parser, the next advance won't free it
+static Token take(Parser *parser) {
+    const Token token = parser->token;
+    parser->token = (Token){.type = TKTYPE_EOF};
+    return token;
+}
+
+static ErrorType expectPunctuation(Parser *parser, const PUNCTUATION_TYPE type) {
+    if (!isPunctuation(&parser->token, type)) return ERROR_SYNTAX;
+    return advance(parser);
+}
+
+// Creates a node from the current token and advances past it
+static ErrorType takeNode(Parser *parser, ASTNode **node) {
+    Token token = take(parser);
+    *node = ASTNode_ctor(token);
+    if (*node == nullptr) {
+        FreeToken(&token);
+        return ERROR_OTHER;
+    }
+    return advance(parser);
+}
+
+static ErrorType addChild(ASTNode *parent, ASTNode *child) {
+    if (ASTNode_addChild(parent, child) == nullptr) {
+        ASTNode_dtor(child);
+        return ERROR_OTHER;
+    }
+    return ERROR_OK;
+}
+
+// ---------------------------------------------------------------------------
+// Expressions (operator precedence)
+
+static ErrorType parseExpression(Parser *parser, ASTNode **expression);
+
+static int precedence(const Token *token) {
+    if (isKeyword(token, KWTYPE_IS)) return 4;
+    if (token->type != TKTYPE_OPERATOR) return -1;
+    switch (token->operator_type) {
+        case OPTYPE_OR:
+            return 1;
+        case OPTYPE_AND:
+            return 2;
+        case OPTYPE_EQUAL:
+        case OPTYPE_NOTEQUAL:
+            return 3;
+        case OPTYPE_LESS:
+        case OPTYPE_GREATER:
+        case OPTYPE_LESSEQUAL:
+        case OPTYPE_GREATEREQUAL:
+            return 5;
+        case OPTYPE_PLUS:
+        case OPTYPE_MINUS:
+            return 6;
+        case OPTYPE_MULTIPLY:
+        case OPTYPE_DIVIDE:
+            return 7;
+        case OPTYPE_NOT:
+            return 8;
+        default:
+            return -1;
+    }
+}
+
+static bool isBinaryOperator(const Token *token) {
+    return precedence(token) >= 0 && !isOperator(token, OPTYPE_NOT);
+}
+
+static bool canStartExpression(const Token *token) {
+    switch (token->type) {
+        case TKTYPE_IDENTIFIER:
+        case TKTYPE_INBUILTFUNCTION:
+        case TKTYPE_LITERAL_INT:
+        case TKTYPE_LITERAL_FLOAT:
+        case TKTYPE_LITERAL_STRING:
+        case TKTYPE_LITERAL_NIL:
+            return true;
+        case TKTYPE_KEYWORD:
+            return token->keyword_type == KWTYPE_NULL;
+        case TKTYPE_OPERATOR:
+            return token->operator_type == OPTYPE_NOT;
+        case TKTYPE_PUNCTUATION:
+            return token->punctuation_type == PTTYPE_OPENPARENTHESIS;
+        default:
+            return false;
+    }
+}
+
+// "( ARGS )" after a callee, the callee becomes the first child of the call node
+static ErrorType parseCall(Parser *parser, ASTNode *callee, ASTNode **call) {
+    ErrorType error;
+    Token token = take(parser);
+    *call = ASTNode_ctor(token);
+    if (*call == nullptr) {
+        ASTNode_dtor(callee);
+        return ERROR_OTHER;
+    }
+    if ((error = addChild(*call, callee)) != ERROR_OK) return error;
+    if ((error = advance(parser)) != ERROR_OK) return error;
+
+    if (isPunctuation(&parser->token, PTTYPE_CLOSEPARENTHESIS)) {
+        return advance(parser);
+    }
+    for (;;) {
+        ASTNode *argument = nullptr;
+        if ((error = parseExpression(parser, &argument)) != ERROR_OK) return error;
+        if ((error = addChild(*call, argument)) != ERROR_OK) return error;
+        if (isPunctuation(&parser->token, PTTYPE_COMMA)) {
+            if ((error = advance(parser)) != ERROR_OK) return error;
+            continue;
+        }
+        return expectPunctuation(parser, PTTYPE_CLOSEPARENTHESIS);
+    }
+}
+
+static ErrorType parseTerm(Parser *parser, ASTNode **term) {
+    ErrorType error;
+    switch (parser->token.type) {
+        case TKTYPE_IDENTIFIER:
+            if ((error = takeNode(parser, term)) != ERROR_OK) return error;
+            if (isPunctuation(&parser->token, PTTYPE_OPENPARENTHESIS)) {
+                return parseCall(parser, *term, term);
+            }
+            return ERROR_OK;
+        case TKTYPE_INBUILTFUNCTION:
+            if ((error = takeNode(parser, term)) != ERROR_OK) return error;
+            if (!isPunctuation(&parser->token, PTTYPE_OPENPARENTHESIS)) return ERROR_SYNTAX;
+            return parseCall(parser, *term, term);
+        case TKTYPE_KEYWORD:
+            if (parser->token.keyword_type != KWTYPE_NULL) return ERROR_SYNTAX;
+            parser->token = (Token){.type = TKTYPE_LITERAL_NIL};
+            return takeNode(parser, term);
+        case TKTYPE_LITERAL_INT:
+        case TKTYPE_LITERAL_FLOAT:
+        case TKTYPE_LITERAL_STRING:
+        case TKTYPE_LITERAL_NIL:
+            return takeNode(parser, term);
+        default:
+            return ERROR_SYNTAX;
+    }
+}
+
+// Pops the operator on top of the stack together with its operands and pushes the result
+static ErrorType reduce(List *operands, List *operators) {
+    ASTNode *operator = operators->data[--operators->count];
+    const size_t arity = isOperator(&operator->token, OPTYPE_NOT) ? 1 : 2;
+    if (operands->count < arity) {
+        ASTNode_dtor(operator);
+        return ERROR_SYNTAX;
+    }
+    operands->count -= arity;
+    for (size_t i = 0; i < arity; i++) {
+        if (ASTNode_addChild(operator, operands->data[operands->count + i]) == nullptr) {
+            for (size_t j = i; j < arity; j++) ASTNode_dtor(operands->data[operands->count + j]);
+            ASTNode_dtor(operator);
+            return ERROR_OTHER;
+        }
+    }
+    List_Add(operands, operator);
+    return ERROR_OK;
+}
+
+static bool isMarker(const ASTNode *node) {
+    return isPunctuation(&node->token, PTTYPE_OPENPARENTHESIS);
+}
+
+static ErrorType shiftOperator(Parser *parser, List *operators) {
+    ASTNode *node = nullptr;
+    const ErrorType error = takeNode(parser, &node);
+    if (node != nullptr) List_Add(operators, node);
+    return error;
+}
+
+static ErrorType parseExpressionStacks(Parser *parser, List *operands, List *operators) {
+    ErrorType error;
+    bool expectOperand = true;
+    size_t openParentheses = 0;
+
+    for (;;) {
+        const Token *token = &parser->token;
+        if (expectOperand) {
+            if (isPunctuation(token, PTTYPE_OPENPARENTHESIS)) {
+                openParentheses++;
+                if ((error = shiftOperator(parser, operators)) != ERROR_OK) return error;
+            } else if (isOperator(token, OPTYPE_NOT)) {
+                if ((error = shiftOperator(parser, operators)) != ERROR_OK) return error;
+            } else {
+                ASTNode *term = nullptr;
+                error = parseTerm(parser, &term);
+                if (term != nullptr) List_Add(operands, term);
+                if (error != ERROR_OK) return error;
+                expectOperand = false;
+            }
+            continue;
+        }
+
+        if (isBinaryOperator(token)) {
+            const int current = precedence(token);
+            while (operators->count > 0 && !isMarker(operators->data[operators->count - 1]) &&
+                   precedence(&operators->data[operators->count - 1]->token) >= current) {
+                if ((error = reduce(operands, operators)) != ERROR_OK) return error;
+            }
+            const bool typeTest = isKeyword(token, KWTYPE_IS);
+            if ((error = shiftOperator(parser, operators)) != ERROR_OK) return error;
+            if (typeTest) {
+                // the right operand of "is" is a type name
+                if (!isKeyword(&parser->token, KWTYPE_NUM) && !isKeyword(&parser->token, KWTYPE_STRING) &&
+                    !isKeyword(&parser->token, KWTYPE_NULL)) {
+                    return ERROR_SYNTAX;
+                }
+                ASTNode *type = nullptr;
+                error = takeNode(parser, &type);
+                if (type != nullptr) List_Add(operands, type);
+                if (error != ERROR_OK) return error;
+            } else {
+                expectOperand = true;
+            }
+            continue;
+        }
+
+        if (isPunctuation(token, PTTYPE_CLOSEPARENTHESIS) && openParentheses > 0) {
+            while (operators->count > 0 && !isMarker(operators->data[operators->count - 1])) {
+                if ((error = reduce(operands, operators)) != ERROR_OK) return error;
+            }
+            ASTNode_dtor(operators->data[--operators->count]);
+            openParentheses--;
+            if ((error = advance(parser)) != ERROR_OK) return error;
+            continue;
+        }
+        break;
+    }
+
+    if (openParentheses > 0) return ERROR_SYNTAX;
+    while (operators->count > 0) {
+        if ((error = reduce(operands, operators)) != ERROR_OK) return error;
+    }
+    return operands->count == 1 ? ERROR_OK : ERROR_SYNTAX;
+}
+
+static ErrorType parseExpression(Parser *parser, ASTNode **expression) {
+    List *operands = List_ctor(AST_MIN_CHILDREN);
+    List *operators = List_ctor(AST_MIN_CHILDREN);
+    ErrorType error = ERROR_OTHER;
+    if (operands != nullptr && operators != nullptr) {
+        error = parseExpressionStacks(parser, operands, operators);
+        if (error == ERROR_OK) {
+            *expression = operands->data[--operands->count];
+        }
+    }
+    if (operands != nullptr) List_dtor(operands);
+    if (operators != nullptr) List_dtor(operators);
+    return error;
+}
+
+// ---------------------------------------------------------------------------
+// Statements (recursive descent)
+
+static ErrorType parseBlock(Parser *parser, ASTNode **block);
+
+static ErrorType parseStatement(Parser *parser, ASTNode **statement) {
+    ErrorType error;
+    ASTNode *child = nullptr;
+    const Token *token = &parser->token;
+
+    if (isPunctuation(token, PTTYPE_OPENBRACE)) {
+        return parseBlock(parser, statement);
+    }
+
+    if (token->type == TKTYPE_INBUILTFUNCTION) {
+        return parseTerm(parser, statement);
+    }
+
+    if (token->type == TKTYPE_IDENTIFIER) {
+        ASTNode *target = nullptr;
+        if ((error = takeNode(parser, &target)) != ERROR_OK) {
+            ASTNode_dtor(target);
+            return error;
+        }
+        if (isPunctuation(&parser->token, PTTYPE_OPENPARENTHESIS)) {
+            return parseCall(parser, target, statement);
+        }
+        if (!isOperator(&parser->token, OPTYPE_ASSIGN)) {
+            ASTNode_dtor(target);
+            return ERROR_SYNTAX;
+        }
+        if ((error = takeNode(parser, statement)) != ERROR_OK) {
+            ASTNode_dtor(target);
+            return error;
+        }
+        if ((error = addChild(*statement, target)) != ERROR_OK) return error;
+        if ((error = parseExpression(parser, &child)) != ERROR_OK) return error;
+        return addChild(*statement, child);
+    }
+
+    if (token->type != TKTYPE_KEYWORD) return ERROR_SYNTAX;
+
+    switch (token->keyword_type) {
+        case KWTYPE_VAR:
+            if ((error = takeNode(parser, statement)) != ERROR_OK) return error;
+            if (parser->token.type != TKTYPE_IDENTIFIER) return ERROR_SYNTAX;
+            if ((error = takeNode(parser, &child)) != ERROR_OK) return error;
+            if ((error = addChild(*statement, child)) != ERROR_OK) return error;
+            if (isOperator(&parser->token, OPTYPE_ASSIGN)) {
+                if ((error = advance(parser)) != ERROR_OK) return error;
+                if ((error = parseExpression(parser, &child)) != ERROR_OK) return error;
+                return addChild(*statement, child);
+            }
+            return ERROR_OK;
+
+        case KWTYPE_IF:
+        case KWTYPE_WHILE: {
+            const bool isIf = token->keyword_type == KWTYPE_IF;
+            if ((error = takeNode(parser, statement)) != ERROR_OK) return error;
+            if ((error = expectPunctuation(parser, PTTYPE_OPENPARENTHESIS)) != ERROR_OK) return error;
+            if ((error = parseExpression(parser, &child)) != ERROR_OK) return error;
+            if ((error = addChild(*statement, child)) != ERROR_OK) return error;
+            if ((error = expectPunctuation(parser, PTTYPE_CLOSEPARENTHESIS)) != ERROR_OK) return error;
+            if ((error = parseBlock(parser, &child)) != ERROR_OK) return error;
+            if ((error = addChild(*statement, child)) != ERROR_OK) return error;
+            if (isIf && isKeyword(&parser->token, KWTYPE_ELSE)) {
+                if ((error = advance(parser)) != ERROR_OK) return error;
+                if ((error = parseBlock(parser, &child)) != ERROR_OK) return error;
+                return addChild(*statement, child);
+            }
+            return ERROR_OK;
+        }
+
+        case KWTYPE_RETURN:
+            if ((error = takeNode(parser, statement)) != ERROR_OK) return error;
+            if (!canStartExpression(&parser->token)) return ERROR_OK;
+            if ((error = parseExpression(parser, &child)) != ERROR_OK) return error;
+            return addChild(*statement, child);
+
+        default:
+            return ERROR_SYNTAX;
+    }
+}
+
+static ErrorType parseBlock(Parser *parser, ASTNode **block) {
+    ErrorType error;
+    if (!isPunctuation(&parser->token, PTTYPE_OPENBRACE)) return ERROR_SYNTAX;
+    if ((error = takeNode(parser, block)) != ERROR_OK) return error;
+
+    while (!isPunctuation(&parser->token, PTTYPE_CLOSEBRACE)) {
+        if (parser->token.type == TKTYPE_EOF) return ERROR_SYNTAX;
+        ASTNode *statement = nullptr;
+        error = parseStatement(parser, &statement);
+        if (statement != nullptr && addChild(*block, statement) != ERROR_OK) return ERROR_OTHER;
+        if (error != ERROR_OK) return error;
+    }
+    return advance(parser);
+}
+
+// ---------------------------------------------------------------------------
+// Functions and program skeleton
+
+static ErrorType parseParams(Parser *parser, ASTNode *params) {
+    ErrorType error;
+    if (isPunctuation(&parser->token, PTTYPE_CLOSEPARENTHESIS)) {
+        return advance(parser);
+    }
+    for (;;) {
+        if (parser->token.type != TKTYPE_IDENTIFIER) return ERROR_SYNTAX;
+        ASTNode *param = nullptr;
+        if ((error = takeNode(parser, &param)) != ERROR_OK) {
+            ASTNode_dtor(param);
+            return error;
+        }
+        if ((error = addChild(params, param)) != ERROR_OK) return error;
+        if (isPunctuation(&parser->token, PTTYPE_COMMA)) {
+            if ((error = advance(parser)) != ERROR_OK) return error;
+            continue;
+        }
+        return expectPunctuation(parser, PTTYPE_CLOSEPARENTHESIS);
+    }
+}
+
+static ErrorType parseFunction(Parser *parser, ASTNode *function) {
+    ErrorType error;
+    ASTNode *child = nullptr;
+
+    if (parser->token.type != TKTYPE_IDENTIFIER) return ERROR_SYNTAX;
+    bool setter = false;
+    char *name = (char *) parser->token.identifier;
+    const size_t length = strlen(name);
+    if (length > 1 && name[length - 1] == '=') {
+        name[length - 1] = '\0';
+        setter = true;
+    }
+    if ((error = takeNode(parser, &child)) != ERROR_OK) {
+        ASTNode_dtor(child);
+        return error;
+    }
+    if ((error = addChild(function, child)) != ERROR_OK) return error;
+
+    if (!setter && isOperator(&parser->token, OPTYPE_ASSIGN)) {
+        setter = true;
+        if ((error = advance(parser)) != ERROR_OK) return error;
+    }
+
+    if (setter) {
+        if ((error = expectPunctuation(parser, PTTYPE_OPENPARENTHESIS)) != ERROR_OK) return error;
+        child = ASTNode_ctor((Token){.type = TKTYPE_OPERATOR, .operator_type = OPTYPE_ASSIGN});
+        if (child == nullptr) return ERROR_OTHER;
+        if ((error = addChild(function, child)) != ERROR_OK) return error;
+        if ((error = parseParams(parser, child)) != ERROR_OK) return error;
+        if (ASTNode_childCount(child) != 1) return ERROR_SYNTAX;
+    } else if (isPunctuation(&parser->token, PTTYPE_OPENPARENTHESIS)) {
+        if ((error = takeNode(parser, &child)) != ERROR_OK) {
+            ASTNode_dtor(child);
+            return error;
+        }
+        if ((error = addChild(function, child)) != ERROR_OK) return error;
+        if ((error = parseParams(parser, child)) != ERROR_OK) return error;
+    }
+
+    if ((error = parseBlock(parser, &child)) != ERROR_OK) {
+        ASTNode_dtor(child);
+        return error;
+    }
+    return addChild(function, child);
+}
+
+static ErrorType expectIdentifier(Parser *parser, const char *name) {
+    if (parser->token.type != TKTYPE_IDENTIFIER || strcmp(parser->token.identifier, name) != 0) {
+        return ERROR_SYNTAX;
+    }
+    return advance(parser);
+}
+
+ErrorType Parser_Begin(Parser *parser, FILE *source) {
+    ErrorType error;
+    parser->source = source;
+    parser->token = (Token){.type = TKTYPE_EOF};
+    if ((error = advance(parser)) != ERROR_OK) return error;
+
+    // import "ifj25" for Ifj
+    if (!isKeyword(&parser->token, KWTYPE_IMPORT)) return ERROR_SYNTAX;
+    if ((error = advance(parser)) != ERROR_OK) return error;
+    if (parser->token.type != TKTYPE_LITERAL_STRING || strcmp(parser->token.string_value, "ifj25") != 0) {
+        return ERROR_SYNTAX;
+    }
+    if ((error = advance(parser)) != ERROR_OK) return error;
+    if (!isKeyword(&parser->token, KWTYPE_FOR)) return ERROR_SYNTAX;
+    if ((error = advance(parser)) != ERROR_OK) return error;
+    if ((error = expectIdentifier(parser, "Ifj")) != ERROR_OK) return error;
+
+    // class Program {
+    if (!isKeyword(&parser->token, KWTYPE_CLASS)) return ERROR_SYNTAX;
+    if ((error = advance(parser)) != ERROR_OK) return error;
+    if ((error = expectIdentifier(parser, "Program")) != ERROR_OK) return error;
+    return expectPunctuation(parser, PTTYPE_OPENBRACE);
+}
+
+ErrorType Parser_NextFunction(Parser *parser, ASTNode **function) {
+    ErrorType error;
+    *function = nullptr;
+
+    if (isPunctuation(&parser->token, PTTYPE_CLOSEBRACE)) {
+        if ((error = advance(parser)) != ERROR_OK) return error;
+        return parser->token.type == TKTYPE_EOF ? ERROR_OK : ERROR_SYNTAX;
+    }
+    if (!isKeyword(&parser->token, KWTYPE_STATIC)) return ERROR_SYNTAX;
+
+    ASTNode *node = nullptr;
+    if ((error = takeNode(parser, &node)) != ERROR_OK) {
+        ASTNode_dtor(node);
+        return error;
+    }
+    if ((error = parseFunction(parser, node)) != ERROR_OK) {
+        ASTNode_dtor(node);
+        return error;
+    }
+    *function = node;
+    return ERROR_OK;
+}
+
+void Parser_End(Parser *parser) {
+    FreeToken(&parser->token);
+    parser->token = (Token){.type = TKTYPE_EOF};
+}
+
+ASTNode *parse(FILE *source, ErrorType *error) {
+    Parser parser;
+    ASTNode *root = ASTNode_ctor((Token){.type = TKTYPE_KEYWORD, .keyword_type = KWTYPE_CLASS});
+    if (root == nullptr) {
+        *error = ERROR_OTHER;
+        return nullptr;
+    }
+
+    *error = Parser_Begin(&parser, source);
+    while (*error == ERROR_OK) {
+        ASTNode *function = nullptr;
+        *error = Parser_NextFunction(&parser, &function);
+        if (*error != ERROR_OK || function == nullptr) break;
+        *error = addChild(root, function);
+    }
+    Parser_End(&parser);
+
+    if (*error != ERROR_OK) {
+        ASTNode_dtor(root);
+        return nullptr;
+    }
+    return root;
+}
@@ -1,23 +1,86 @@
 ﻿#ifndef IFJCODE25_PARSER_H
 #define IFJCODE25_PARSER_H
 
+#include <stdio.h>
+
 // Forward deklarace List
 struct List;
 typedef struct List List;
 
+#include "error.h"
 #include "token.h"
 
+/*
+ * AST nodes are tagged by their token:
+ *
+ *   program      KEYWORD CLASS         functions
+ *   function     KEYWORD STATIC        IDENTIFIER name, PUNCT '(' params | OPERATOR ASSIGN param (setter)
+ *                                      | nothing (getter), PUNCT '{' body
+ *   block        PUNCT '{'             statements
+ *   declaration  KEYWORD VAR           IDENTIFIER
+ *   assignment   OPERATOR ASSIGN       IDENTIFIER target, value
+ *   if           KEYWORD IF            condition, block, [else block]
+ *   while        KEYWORD WHILE         condition, block, [KEYWORD WHILE int copy, VARIABLE guarded locals]
+ *   return       KEYWORD RETURN        [value]
+ *   call         PUNCT '('             IDENTIFIER | INBUILTFUNCTION callee, arguments
+ *   binary       OPERATOR              left, right (OPTYPE_NOT has a single operand)
+ *   type test    KEYWORD IS            value, KEYWORD NUM | STRING | NULL
+ *   literal      LITERAL_*             -
+ *   inlined call KEYWORD STATIC        PUNCT '(' params, arguments, PUNCT '{' body (expression or statement)
+ *
+ * Semantic analysis retags identifiers that name local or global variables as
+ * TKTYPE_VARIABLE (renamed to their frame name); identifiers left as
+ * TKTYPE_IDENTIFIER in an expression are getter calls and as an assignment target
+ * setter calls.
+ */
+
+// Set of runtime types an expression may evaluate to, narrowed by type inference
+typedef enum ValueType {
+    VT_NONE = 0, // unreachable
+    VT_INT = 1,
+    VT_FLOAT = 2,
+    VT_STRING = 4,
+    VT_NIL = 8,
+    VT_BOOL = 16,
+    VT_NUM = VT_INT | VT_FLOAT,
+    VT_ANY = VT_NUM | VT_STRING | VT_NIL | VT_BOOL,
+} ValueType;
+
 typedef struct ASTNode {
     Token token;
     List *children;
+    ValueType type; // VT_ANY until inferred
 } ASTNode;
 
 ASTNode *ASTNode_ctor(const Token token);
 
 ASTNode *ASTNode_addChild(ASTNode *parent, const ASTNode *child);
 
+size_t ASTNode_childCount(const ASTNode *node);
+
+ASTNode *ASTNode_child(const ASTNode *node, size_t index);
+
+// Deep copy, including the token's strings and the inferred types
+ASTNode *ASTNode_clone(const ASTNode *node);
+
 void ASTNode_dtor(ASTNode *node);
 
-ASTNode *parse();
+/*
+ * Streaming parser: Parser_Begin consumes the prolog and the class header,
+ * every Parser_NextFunction call then returns one function definition until
+ * it yields nullptr at the closing brace of the class.
+ */
+typedef struct Parser {
+    FILE *source;
+    Token token;
+} Parser;
+
+ErrorType Parser_Begin(Parser *parser, FILE *source);
+
+ErrorType Parser_NextFunction(Parser *parser, ASTNode **function);
+
+void Parser_End(Parser *parser);
+
+ASTNode *parse(FILE *source, ErrorType *error);
 
 #endif
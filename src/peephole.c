@@ -0,0 +1,188 @@
+﻿#include "peephole.h"
+
+#include <string.h>
+
+#include "symtable.h"
+
+static const char *const RULE_NAMES[PEEPHOLE_RULE_COUNT] = {
+    [PEEPHOLE_PUSH_POP] = "push-pop",
+    [PEEPHOLE_MOVE_BACK] = "move-back",
+    [PEEPHOLE_SELF_MOVE] = "self-move",
+    [PEEPHOLE_JUMP_NEXT] = "jump-next",
+    [PEEPHOLE_UNREACHABLE] = "unreachable",
+    [PEEPHOLE_UNUSED_LABEL] = "unused-label",
+    [PEEPHOLE_REPLACED_FRAME] = "replaced-frame",
+};
+
+const char *Peephole_RuleName(const PeepholeRule rule) {
+    return rule < PEEPHOLE_RULE_COUNT ? RULE_NAMES[rule] : "";
+}
+
+typedef struct Window {
+    InstrList *code;
+    const Symtable *targets; // labels some instruction jumps to or calls
+} Window;
+
+// Index of the next instruction after index that was not removed
+static size_t next(const InstrList *code, size_t index) {
+    do {
+        index++;
+    } while (index < code->count && code->items[index].opcode == OP_NOP);
+    return index;
+}
+
+static bool is(const InstrList *code, const size_t index, const Opcode opcode) {
+    return index < code->count && code->items[index].opcode == opcode;
+}
+
+static const char *operand(const InstrList *code, const size_t index, const size_t which) {
+    return code->items[index].operands[which];
+}
+
+static bool same(const char *a, const char *b) {
+    return a != nullptr && b != nullptr && strcmp(a, b) == 0;
+}
+
+static ErrorType removeAt(InstrList *code, const size_t index) {
+    return InstrList_Set(code, index, OP_NOP, nullptr, nullptr);
+}
+
+// Each rule looks at the instruction at index and what follows; it returns how many instructions it removed
+
+static ErrorType pushPop(const Window *window, const size_t index, unsigned *removed) {
+    InstrList *code = window->code;
+    const size_t pop = next(code, index);
+    if (!is(code, index, OP_PUSHS) || !is(code, pop, OP_POPS)) return ERROR_OK;
+    const char *value = operand(code, index, 0);
+    const char *target = operand(code, pop, 0);
+    ErrorType error;
+    if (same(value, target)) {
+        if ((error = removeAt(code, index)) != ERROR_OK) return error;
+        *removed = 2;
+    } else {
+        if ((error = InstrList_Set(code, index, OP_MOVE, target, value)) != ERROR_OK) return error;
+        *removed = 1;
+    }
+    return removeAt(code, pop);
+}
+
+static ErrorType moveBack(const Window *window, const size_t index, unsigned *removed) {
+    InstrList *code = window->code;
+    const size_t back = next(code, index);
+    if (!is(code, index, OP_MOVE) || !is(code, back, OP_MOVE)) return ERROR_OK;
+    if (!same(operand(code, index, 0), operand(code, back, 1)) ||
+        !same(operand(code, index, 1), operand(code, back, 0))) {
+        return ERROR_OK;
+    }
+    *removed = 1;
+    return removeAt(code, back);
+}
+
+static ErrorType selfMove(const Window *window, const size_t index, unsigned *removed) {
+    InstrList *code = window->code;
+    if (!is(code, index, OP_MOVE) || !same(operand(code, index, 0), operand(code, index, 1))) return ERROR_OK;
+    *removed = 1;
+    return removeAt(code, index);
+}
+
+static ErrorType jumpNext(const Window *window, const size_t index, unsigned *removed) {
+    InstrList *code = window->code;
+    if (!is(code, index, OP_JUMP)) return ERROR_OK;
+    for (size_t label = next(code, index); is(code, label, OP_LABEL); label = next(code, label)) {
+        if (same(operand(code, label, 0), operand(code, index, 0))) {
+            *removed = 1;
+            return removeAt(code, index);
+        }
+    }
+    return ERROR_OK;
+}
+
+static ErrorType unreachable(const Window *window, const size_t index, unsigned *removed) {
+    InstrList *code = window->code;
+    if (!is(code, index, OP_JUMP) && !is(code, index, OP_EXIT) && !is(code, index, OP_RETURN)) return ERROR_OK;
+    for (size_t dead = next(code, index); dead < code->count && !is(code, dead, OP_LABEL); dead = next(code, dead)) {
+        const ErrorType error = removeAt(code, dead);
+        if (error != ERROR_OK) return error;
+        (*removed)++;
+    }
+    return ERROR_OK;
+}
+
+static ErrorType unusedLabel(const Window *window, const size_t index, unsigned *removed) {
+    InstrList *code = window->code;
+    if (!is(code, index, OP_LABEL)) return ERROR_OK;
+    const char *label = operand(code, index, 0);
+    // function entry points are called from elsewhere
+    if (strchr(label, '%') == nullptr || Symtable_Lookup(window->targets, label, nullptr) == ERROR_OK) {
+        return ERROR_OK;
+    }
+    *removed = 1;
+    return removeAt(code, index);
+}
+
+static ErrorType replacedFrame(const Window *window, const size_t index, unsigned *removed) {
+    InstrList *code = window->code;
+    if (!is(code, index, OP_CREATEFRAME) || !is(code, next(code, index), OP_CREATEFRAME)) return ERROR_OK;
+    *removed = 1;
+    return removeAt(code, index);
+}
+
+typedef ErrorType (*Rule)(const Window *window, size_t index, unsigned *removed);
+
+static const Rule RULES[PEEPHOLE_RULE_COUNT] = {
+    [PEEPHOLE_PUSH_POP] = pushPop,
+    [PEEPHOLE_MOVE_BACK] = moveBack,
+    [PEEPHOLE_SELF_MOVE] = selfMove,
+    [PEEPHOLE_JUMP_NEXT] = jumpNext,
+    [PEEPHOLE_UNREACHABLE] = unreachable,
+    [PEEPHOLE_UNUSED_LABEL] = unusedLabel,
+    [PEEPHOLE_REPLACED_FRAME] = replacedFrame,
+};
+
+static ErrorType collectTargets(const InstrList *code, Symtable *targets) {
+    Symtable_Clear(targets);
+    for (size_t i = 0; i < code->count; i++) {
+        switch (code->items[i].opcode) {
+            case OP_JUMP:
+            case OP_JUMPIFEQ:
+            case OP_JUMPIFNEQ:
+            case OP_JUMPIFEQS:
+            case OP_JUMPIFNEQS:
+            case OP_CALL: {
+                const ErrorType error = Symtable_Declare(targets, code->items[i].operands[0], nullptr);
+                if (error != ERROR_OK && error != ERROR_SEMANTIC_REDEFINITION) return error;
+                break;
+            }
+            default:
+                break;
+        }
+    }
+    return ERROR_OK;
+}
+
+ErrorType Peephole_Run(InstrList *code, PeepholeStats *stats) {
+    Symtable *targets = Symtable_ctor(0);
+    if (targets == nullptr) return ERROR_OTHER;
+    const Window window = {.code = code, .targets = targets};
+
+    ErrorType error = ERROR_OK;
+    bool changed = true;
+    while (changed && error == ERROR_OK) {
+        changed = false;
+        error = collectTargets(code, targets);
+        for (size_t i = 0; i < code->count && error == ERROR_OK; i++) {
+            for (PeepholeRule rule = 0; rule < PEEPHOLE_RULE_COUNT && error == ERROR_OK; rule++) {
+                if (code->items[i].opcode == OP_NOP) break;
+                unsigned removed = 0;
+                error = RULES[rule](&window, i, &removed);
+                if (removed == 0) continue;
+                stats->removed[rule] += removed;
+                changed = true;
+            }
+        }
+        InstrList_Compact(code);
+    }
+
+    Symtable_dtor(targets);
+    return error;
+}
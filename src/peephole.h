@@ -0,0 +1,31 @@
+﻿#ifndef IFJCODE25_PEEPHOLE_H
+#define IFJCODE25_PEEPHOLE_H
+
+#include "error.h"
+#include "instr.h"
+
+typedef enum PeepholeRule {
+    PEEPHOLE_PUSH_POP,        // PUSHS x, POPS y        -> MOVE y x (nothing if x is y)
+    PEEPHOLE_MOVE_BACK,       // MOVE a b, MOVE b a     -> MOVE a b
+    PEEPHOLE_SELF_MOVE,       // MOVE a a               -> nothing
+    PEEPHOLE_JUMP_NEXT,       // JUMP L, LABEL.. L      -> LABEL.. L
+    PEEPHOLE_UNREACHABLE,     // JUMP/EXIT/RETURN, x..  -> up to the next LABEL
+    PEEPHOLE_UNUSED_LABEL,    // internal LABEL nobody jumps to
+    PEEPHOLE_REPLACED_FRAME,  // CREATEFRAME, CREATEFRAME
+    PEEPHOLE_RULE_COUNT
+} PeepholeRule;
+
+typedef struct PeepholeStats {
+    unsigned long removed[PEEPHOLE_RULE_COUNT]; // instructions removed by each rule
+} PeepholeStats;
+
+const char *Peephole_RuleName(PeepholeRule rule);
+
+/*
+ * Rewrites one function's instructions with a small window of pattern rules
+ * until none applies. Internal labels (those with a '%') must only be used
+ * inside the list.
+ */
+ErrorType Peephole_Run(InstrList *code, PeepholeStats *stats);
+
+#endif
@@ -0,0 +1,124 @@
+﻿#include "prescan.h"
+
+#include <string.h>
+
+#include "lexer.h"
+#include "token.h"
+
+static bool isPunctuation(const Token *token, const PUNCTUATION_TYPE type) {
+    return token->type == TKTYPE_PUNCTUATION && token->punctuation_type == type;
+}
+
+static ErrorType nextToken(FILE *source, Token *token) {
+    const ErrorOrToken next = GetNextToken(source);
+    if (next.isError) return next.errorType;
+    *token = next.token;
+    return ERROR_OK;
+}
+
+// Counts the parameters of "( id, id, ... )" up to and including the closing parenthesis
+static ErrorType scanParams(FILE *source, unsigned *arity) {
+    Token token;
+    bool expectIdentifier = false;
+    *arity = 0;
+    for (;;) {
+        const ErrorType error = nextToken(source, &token);
+        if (error != ERROR_OK) return error;
+
+        if (token.type == TKTYPE_IDENTIFIER) {
+            FreeToken(&token);
+            if (*arity > 0 && !expectIdentifier) return ERROR_SYNTAX;
+            (*arity)++;
+            expectIdentifier = false;
+        } else if (isPunctuation(&token, PTTYPE_COMMA)) {
+            if (*arity == 0 || expectIdentifier) return ERROR_SYNTAX;
+            expectIdentifier = true;
+        } else if (isPunctuation(&token, PTTYPE_CLOSEPARENTHESIS)) {
+            return expectIdentifier ? ERROR_SYNTAX : ERROR_OK;
+        } else {
+            FreeToken(&token);
+            return ERROR_SYNTAX;
+        }
+    }
+}
+
+// Reads one header after "static", including the opening brace of its body
+static ErrorType scanHeader(FILE *source, FunctionTable *functions) {
+    Token name;
+    Token token;
+    ErrorType error = nextToken(source, &name);
+    if (error != ERROR_OK) return error;
+    if (name.type != TKTYPE_IDENTIFIER) {
+        FreeToken(&name);
+        return ERROR_SYNTAX;
+    }
+
+    // the lexer glues '=' of "id=(" to the identifier
+    char *id = (char *) name.identifier;
+    const size_t length = strlen(id);
+    FunctionKind kind = FNKIND_FUNCTION;
+    if (length > 1 && id[length - 1] == '=') {
+        id[length - 1] = '\0';
+        kind = FNKIND_SETTER;
+    }
+
+    error = nextToken(source, &token);
+    if (error == ERROR_OK && kind == FNKIND_FUNCTION &&
+        token.type == TKTYPE_OPERATOR && token.operator_type == OPTYPE_ASSIGN) {
+        kind = FNKIND_SETTER;
+        error = nextToken(source, &token);
+    }
+
+    unsigned arity = 0;
+    if (error == ERROR_OK) {
+        if (isPunctuation(&token, PTTYPE_OPENPARENTHESIS)) {
+            error = scanParams(source, &arity);
+            if (error == ERROR_OK && kind == FNKIND_SETTER && arity != 1) error = ERROR_SYNTAX;
+            if (error == ERROR_OK) error = nextToken(source, &token);
+            if (error == ERROR_OK && !isPunctuation(&token, PTTYPE_OPENBRACE)) {
+                FreeToken(&token);
+                error = ERROR_SYNTAX;
+            }
+        } else if (isPunctuation(&token, PTTYPE_OPENBRACE) && kind == FNKIND_FUNCTION) {
+            kind = FNKIND_GETTER;
+        } else {
+            FreeToken(&token);
+            error = ERROR_SYNTAX;
+        }
+    }
+
+    if (error == ERROR_OK) {
+        error = FunctionTable_Define(functions, id, kind, arity);
+    }
+    FreeToken(&name);
+    return error;
+}
+
+ErrorType Prescan(FILE *source, FunctionTable *functions) {
+    unsigned depth = 0;
+    for (;;) {
+        Token token;
+        ErrorType error = nextToken(source, &token);
+        if (error != ERROR_OK) return error;
+        if (token.type == TKTYPE_EOF) break;
+
+        if (isPunctuation(&token, PTTYPE_OPENBRACE)) {
+            depth++;
+        } else if (isPunctuation(&token, PTTYPE_CLOSEBRACE)) {
+            if (depth == 0) return ERROR_SYNTAX;
+            depth--;
+        } else if (token.type == TKTYPE_KEYWORD && token.keyword_type == KWTYPE_STATIC) {
+            // headers are only allowed directly in the class body
+            if (depth != 1) return ERROR_SYNTAX;
+            error = scanHeader(source, functions);
+            if (error != ERROR_OK) return error;
+            depth++;
+        }
+        FreeToken(&token);
+    }
+
+    // the entry point is the parameterless main
+    return FunctionTable_CheckCall(functions, "main", FNKIND_FUNCTION, 0) == ERROR_OK
+               ? ERROR_OK
+               : ERROR_SEMANTIC_USEOFUNDEFINED;
+}
@@ -0,0 +1,17 @@
+﻿#ifndef IFJCODE25_PRESCAN_H
+#define IFJCODE25_PRESCAN_H
+
+#include <stdio.h>
+
+#include "error.h"
+#include "symtable.h"
+
+/*
+ * Fast pass over the token stream that only looks at function headers
+ * (static id (PARAMS), static id, static id=(id)) and fills the function table.
+ * Bodies are skipped by brace counting, so the main pass can check every call
+ * (including forward ones) as soon as it is parsed. The caller rewinds source.
+ */
+ErrorType Prescan(FILE *source, FunctionTable *functions);
+
+#endif
@@ -0,0 +1,254 @@
+﻿#include "semantic.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "format.h"
+
+typedef struct Checker {
+    const FunctionTable *functions;
+    Symtable *locals;
+} Checker;
+
+static bool isGlobalName(const char *name) {
+    return name[0] == '_' && name[1] == '_';
+}
+
+static const ASTNode *functionBody(const ASTNode *function) {
+    return ASTNode_child(function, ASTNode_childCount(function) - 1);
+}
+
+FunctionKind Semantic_FunctionKind(const ASTNode *function, unsigned *arity) {
+    *arity = 0;
+    if (ASTNode_childCount(function) == 2) return FNKIND_GETTER;
+    const ASTNode *params = ASTNode_child(function, 1);
+    *arity = (unsigned) ASTNode_childCount(params);
+    return params->token.type == TKTYPE_OPERATOR ? FNKIND_SETTER : FNKIND_FUNCTION;
+}
+
+ErrorType Semantic_DefineFunction(FunctionTable *functions, const ASTNode *function) {
+    unsigned arity;
+    const FunctionKind kind = Semantic_FunctionKind(function, &arity);
+    return FunctionTable_Define(functions, ASTNode_child(function, 0)->token.identifier, kind, arity);
+}
+
+// Turns an identifier node into a variable node holding its frame name
+static ErrorType retag(ASTNode *node, const char *frame, const unsigned id) {
+    const char *name = node->token.identifier;
+    const size_t frameLength = strlen(frame);
+    const size_t nameLength = strlen(name);
+    char *variable = malloc(frameLength + nameLength + 2 + FORMAT_NUMBER_MAX);
+    if (variable == nullptr) return ERROR_OTHER;
+    memcpy(variable, frame, frameLength);
+    variable[frameLength] = '@';
+    char *end = variable + frameLength + 1;
+    memcpy(end, name, nameLength);
+    end += nameLength;
+    if (id) {
+        *end++ = '$';
+        Format_Unsigned(end, id);
+    } else {
+        *end = '\0';
+    }
+    free((char *) name);
+    node->token = (Token){.type = TKTYPE_VARIABLE, .identifier = variable};
+    return ERROR_OK;
+}
+
+static ErrorType declare(const Checker *checker, ASTNode *identifier) {
+    unsigned id;
+    const ErrorType error = Symtable_Declare(checker->locals, identifier->token.identifier, &id);
+    if (error != ERROR_OK) return error;
+    return retag(identifier, "LF", id);
+}
+
+// Resolves a name used as a value or as an assignment target
+static ErrorType resolve(const Checker *checker, ASTNode *identifier, const FunctionKind accessor) {
+    const char *name = identifier->token.identifier;
+    if (isGlobalName(name)) return retag(identifier, "GF", 0);
+    unsigned id;
+    if (Symtable_Lookup(checker->locals, name, &id) == ERROR_OK) return retag(identifier, "LF", id);
+    return FunctionTable_CheckCall(checker->functions, name, accessor, 0);
+}
+
+static bool isLiteral(const ASTNode *node) {
+    switch (node->token.type) {
+        case TKTYPE_LITERAL_INT:
+        case TKTYPE_LITERAL_FLOAT:
+        case TKTYPE_LITERAL_STRING:
+        case TKTYPE_LITERAL_NIL:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool isNumberLiteral(const ASTNode *node) {
+    return node->token.type == TKTYPE_LITERAL_INT || node->token.type == TKTYPE_LITERAL_FLOAT;
+}
+
+static bool isIntegralLiteral(const ASTNode *node) {
+    if (node->token.type == TKTYPE_LITERAL_INT) return true;
+    const double value = node->token.float_value;
+    return node->token.type == TKTYPE_LITERAL_FLOAT && value == (double) (long long) value;
+}
+
+// Type errors that are visible on literal operands alone
+static ErrorType checkLiteralOperands(const ASTNode *operator) {
+    if (operator->token.type != TKTYPE_OPERATOR) return ERROR_OK;
+    const ASTNode *left = ASTNode_child(operator, 0);
+    const ASTNode *right = ASTNode_child(operator, 1);
+    if (right == nullptr) return ERROR_OK;
+    const bool leftString = left->token.type == TKTYPE_LITERAL_STRING;
+    const bool rightString = right->token.type == TKTYPE_LITERAL_STRING;
+    const bool anyNil = left->token.type == TKTYPE_LITERAL_NIL || right->token.type == TKTYPE_LITERAL_NIL;
+
+    switch (operator->token.operator_type) {
+        case OPTYPE_PLUS:
+            if (anyNil) return ERROR_SEMANTIC_STATIC_UNEXPECTEDTYPE;
+            if ((leftString && isNumberLiteral(right)) || (rightString && isNumberLiteral(left))) {
+                return ERROR_SEMANTIC_STATIC_UNEXPECTEDTYPE;
+            }
+            return ERROR_OK;
+        case OPTYPE_MULTIPLY:
+            if (anyNil || rightString) return ERROR_SEMANTIC_STATIC_UNEXPECTEDTYPE;
+            if (leftString && isNumberLiteral(right) && !isIntegralLiteral(right)) {
+                return ERROR_SEMANTIC_STATIC_UNEXPECTEDTYPE;
+            }
+            return ERROR_OK;
+        case OPTYPE_MINUS:
+        case OPTYPE_DIVIDE:
+        case OPTYPE_LESS:
+        case OPTYPE_GREATER:
+        case OPTYPE_LESSEQUAL:
+        case OPTYPE_GREATEREQUAL:
+            if ((isLiteral(left) && !isNumberLiteral(left)) || (isLiteral(right) && !isNumberLiteral(right))) {
+                return ERROR_SEMANTIC_STATIC_UNEXPECTEDTYPE;
+            }
+            return ERROR_OK;
+        default:
+            return ERROR_OK;
+    }
+}
+
+static ErrorType checkExpression(const Checker *checker, ASTNode *expression);
+
+static ErrorType checkInbuiltCall(const ASTNode *call) {
+    const size_t argumentCount = ASTNode_childCount(call) - 1;
+    size_t expected = 1;
+    switch (ASTNode_child(call, 0)->token.inbuilt_function_type) {
+        case INBUILT_READNUM:
+            expected = 0;
+            break;
+        case INBUILT_FLOOR: {
+            // floor only takes a Num, literals of other types are caught here
+            const ASTNode *argument = ASTNode_child(call, 1);
+            if (argument != nullptr && isLiteral(argument) && !isNumberLiteral(argument)) {
+                return ERROR_SEMANTIC_STATIC_UNEXPECTEDPARAMETER;
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    return argumentCount == expected ? ERROR_OK : ERROR_SEMANTIC_STATIC_UNEXPECTEDPARAMETER;
+}
+
+static ErrorType checkCall(const Checker *checker, ASTNode *call) {
+    ErrorType error;
+    const size_t count = ASTNode_childCount(call);
+    for (size_t i = 1; i < count; i++) {
+        if ((error = checkExpression(checker, ASTNode_child(call, i))) != ERROR_OK) return error;
+    }
+    const ASTNode *callee = ASTNode_child(call, 0);
+    if (callee->token.type == TKTYPE_INBUILTFUNCTION) return checkInbuiltCall(call);
+    return FunctionTable_CheckCall(checker->functions, callee->token.identifier, FNKIND_FUNCTION,
+                                   (unsigned) (count - 1));
+}
+
+static ErrorType checkExpression(const Checker *checker, ASTNode *expression) {
+    ErrorType error;
+    switch (expression->token.type) {
+        case TKTYPE_IDENTIFIER:
+            return resolve(checker, expression, FNKIND_GETTER);
+        case TKTYPE_PUNCTUATION:
+            return checkCall(checker, expression);
+        case TKTYPE_OPERATOR:
+            for (size_t i = 0; i < ASTNode_childCount(expression); i++) {
+                if ((error = checkExpression(checker, ASTNode_child(expression, i))) != ERROR_OK) return error;
+            }
+            return checkLiteralOperands(expression);
+        case TKTYPE_KEYWORD:
+            // type test, the right operand is a type name
+            if (expression->token.keyword_type == KWTYPE_IS) {
+                return checkExpression(checker, ASTNode_child(expression, 0));
+            }
+            return ERROR_OK;
+        default:
+            return ERROR_OK;
+    }
+}
+
+static ErrorType checkBlock(const Checker *checker, const ASTNode *block, bool ownScope);
+
+static ErrorType checkStatement(const Checker *checker, ASTNode *statement) {
+    ErrorType error;
+    const Token *token = &statement->token;
+
+    if (token->type == TKTYPE_PUNCTUATION) {
+        if (token->punctuation_type == PTTYPE_OPENBRACE) return checkBlock(checker, statement, true);
+        return checkCall(checker, statement);
+    }
+
+    if (token->type == TKTYPE_OPERATOR) {
+        // assignment, the value is checked first so the target may be a setter
+        if ((error = checkExpression(checker, ASTNode_child(statement, 1))) != ERROR_OK) return error;
+        return resolve(checker, ASTNode_child(statement, 0), FNKIND_SETTER);
+    }
+
+    switch (token->keyword_type) {
+        case KWTYPE_VAR:
+            // "var x = x" reads the outer x, so the initializer goes first
+            if (ASTNode_childCount(statement) > 1) {
+                if ((error = checkExpression(checker, ASTNode_child(statement, 1))) != ERROR_OK) return error;
+            }
+            return declare(checker, ASTNode_child(statement, 0));
+        case KWTYPE_IF:
+        case KWTYPE_WHILE:
+            if ((error = checkExpression(checker, ASTNode_child(statement, 0))) != ERROR_OK) return error;
+            for (size_t i = 1; i < ASTNode_childCount(statement); i++) {
+                if ((error = checkBlock(checker, ASTNode_child(statement, i), true)) != ERROR_OK) return error;
+            }
+            return ERROR_OK;
+        case KWTYPE_RETURN:
+            if (ASTNode_childCount(statement) == 0) return ERROR_OK;
+            return checkExpression(checker, ASTNode_child(statement, 0));
+        default:
+            return ERROR_SEMANTIC_OTHER;
+    }
+}
+
+static ErrorType checkBlock(const Checker *checker, const ASTNode *block, const bool ownScope) {
+    ErrorType error = ERROR_OK;
+    if (ownScope && (error = Symtable_PushScope(checker->locals)) != ERROR_OK) return error;
+    for (size_t i = 0; i < ASTNode_childCount(block) && error == ERROR_OK; i++) {
+        error = checkStatement(checker, ASTNode_child(block, i));
+    }
+    if (ownScope) Symtable_PopScope(checker->locals);
+    return error;
+}
+
+ErrorType Semantic_CheckFunction(ASTNode *function, const FunctionTable *functions, Symtable *locals) {
+    ErrorType error;
+    const Checker checker = {.functions = functions, .locals = locals};
+
+    // parameters share the scope of the top level of the body
+    unsigned arity;
+    if (Semantic_FunctionKind(function, &arity) != FNKIND_GETTER) {
+        const ASTNode *params = ASTNode_child(function, 1);
+        for (size_t i = 0; i < arity; i++) {
+            if ((error = declare(&checker, ASTNode_child(params, i))) != ERROR_OK) return error;
+        }
+    }
+    return checkBlock(&checker, functionBody(function), false);
+}
@@ -0,0 +1,26 @@
+﻿#ifndef IFJCODE25_SEMANTIC_H
+#define IFJCODE25_SEMANTIC_H
+
+#include "error.h"
+#include "parser.h"
+#include "symtable.h"
+
+/*
+ * Kind and arity of a function definition node (KEYWORD STATIC).
+ */
+FunctionKind Semantic_FunctionKind(const ASTNode *function, unsigned *arity);
+
+/*
+ * Records the header of a parsed function; used when the whole program is
+ * parsed up front instead of running Prescan.
+ */
+ErrorType Semantic_DefineFunction(FunctionTable *functions, const ASTNode *function);
+
+/*
+ * Checks one function body against the function table and rewrites its variable
+ * identifiers in place to TKTYPE_VARIABLE with the frame name (LF@name$id for
+ * locals, GF@__name for globals). locals must be empty and is left dirty.
+ */
+ErrorType Semantic_CheckFunction(ASTNode *function, const FunctionTable *functions, Symtable *locals);
+
+#endif
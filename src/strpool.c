@@ -0,0 +1,59 @@
+﻿#include "strpool.h"
+
+#include <stdlib.h>
+
+#include "format.h"
+
+static bool reserve(void **data, size_t *capacity, const size_t count, const size_t size) {
+    if (count < *capacity) return true;
+    const size_t newCapacity = *capacity ? *capacity * 2 : 16;
+    void *grown = realloc(*data, newCapacity * size);
+    if (grown == nullptr) return false;
+    *data = grown;
+    *capacity = newCapacity;
+    return true;
+}
+
+StringPool *StringPool_ctor(void) {
+    StringPool *pool = calloc(1, sizeof(StringPool));
+    if (pool == nullptr) return nullptr;
+    pool->values = Symtable_ctor(0);
+    if (pool->values == nullptr) {
+        free(pool);
+        return nullptr;
+    }
+    return pool;
+}
+
+const char *StringPool_Encode(StringPool *pool, const char *value) {
+    unsigned id;
+    if (Symtable_Lookup(pool->values, value, &id) == ERROR_OK) {
+        pool->reused++;
+        return pool->encoded[id - 1];
+    }
+    if (!reserve((void **) &pool->encoded, &pool->capacity, pool->count, sizeof(char *))) return nullptr;
+    char *encoded = malloc(Format_StringSize(value));
+    if (encoded == nullptr) return nullptr;
+    Format_String(encoded, value);
+    if (Symtable_Declare(pool->values, value, &id) != ERROR_OK) {
+        free(encoded);
+        return nullptr;
+    }
+    pool->encoded[pool->count++] = encoded;
+    return encoded;
+}
+
+void StringPool_Clear(StringPool *pool) {
+    for (size_t i = 0; i < pool->count; i++) free(pool->encoded[i]);
+    pool->cleared += pool->count;
+    pool->count = 0;
+    Symtable_Clear(pool->values);
+}
+
+void StringPool_dtor(StringPool *pool) {
+    if (pool == nullptr) return;
+    for (size_t i = 0; i < pool->count; i++) free(pool->encoded[i]);
+    free(pool->encoded);
+    Symtable_dtor(pool->values);
+    free(pool);
+}
@@ -0,0 +1,32 @@
+﻿#ifndef IFJCODE25_STRPOOL_H
+#define IFJCODE25_STRPOOL_H
+
+#include "symtable.h"
+
+/*
+ * String literals of the whole program in their IFJcode25 form
+ * (string@ with escapes). Each distinct value is escaped once, later uses get
+ * the same encoded text back. StringPool_Clear forgets them, which keeps the
+ * pool bounded when only one function is compiled at a time.
+ */
+typedef struct StringPool {
+    Symtable *values; // literal value -> index + 1 into encoded
+    char **encoded;
+    size_t count;
+    size_t capacity;
+
+    unsigned long reused; // lookups answered from the pool
+    size_t cleared;       // values encoded before the last StringPool_Clear
+} StringPool;
+
+StringPool *StringPool_ctor(void);
+
+// The encoded form of value, owned by the pool; nullptr when out of memory
+const char *StringPool_Encode(StringPool *pool, const char *value);
+
+// Drops every encoded value, texts handed out before become invalid
+void StringPool_Clear(StringPool *pool);
+
+void StringPool_dtor(StringPool *pool);
+
+#endif
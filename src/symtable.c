@@ -0,0 +1,288 @@
+﻿#include "symtable.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SYMTABLE_MIN_CAPACITY 16
+
+// FNV-1a
+static uint64_t hashName(const char *name) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (const unsigned char *p = (const unsigned char *) name; *p; p++) {
+        hash ^= *p;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// bucketCount is always a power of two, so the probe sequence can use a mask
+static size_t findBucket(const Symtable *table, const char *name) {
+    const size_t mask = table->bucketCount - 1;
+    size_t bucket = (size_t) hashName(name) & mask;
+    while (table->buckets[bucket] != 0) {
+        const SymtableEntry *entry = &table->entries[table->buckets[bucket] - 1];
+        if (strcmp(entry->name, name) == 0) {
+            return bucket;
+        }
+        bucket = (bucket + 1) & mask;
+    }
+    return bucket;
+}
+
+static bool rehash(Symtable *table, const size_t bucketCount) {
+    size_t *buckets = calloc(bucketCount, sizeof(size_t));
+    if (buckets == nullptr) return false;
+    free(table->buckets);
+    table->buckets = buckets;
+    table->bucketCount = bucketCount;
+    for (size_t i = 0; i < table->entryCount; i++) {
+        table->buckets[findBucket(table, table->entries[i].name)] = i + 1;
+    }
+    return true;
+}
+
+Symtable *Symtable_ctor(const size_t capacity) {
+    size_t cap = SYMTABLE_MIN_CAPACITY;
+    while (cap < capacity) cap *= 2;
+
+    Symtable *table = calloc(1, sizeof(Symtable));
+    if (table == nullptr) return nullptr;
+    table->entries = malloc(cap * sizeof(SymtableEntry));
+    table->buckets = calloc(cap * 2, sizeof(size_t));
+    table->undo = malloc(cap * sizeof(SymtableUndo));
+    table->scopes = malloc(SYMTABLE_MIN_CAPACITY * sizeof(size_t));
+    if (table->entries == nullptr || table->buckets == nullptr || table->undo == nullptr ||
+        table->scopes == nullptr) {
+        Symtable_dtor(table);
+        return nullptr;
+    }
+    table->entryCapacity = cap;
+    table->bucketCount = cap * 2;
+    table->undoCapacity = cap;
+    table->scopeCapacity = SYMTABLE_MIN_CAPACITY;
+    return table;
+}
+
+ErrorType Symtable_PushScope(Symtable *table) {
+    if (table->scopeCount == table->scopeCapacity) {
+        const size_t newCapacity = table->scopeCapacity * 2;
+        size_t *scopes = realloc(table->scopes, newCapacity * sizeof(size_t));
+        if (scopes == nullptr) return ERROR_OTHER;
+        table->scopes = scopes;
+        table->scopeCapacity = newCapacity;
+    }
+    table->scopes[table->scopeCount++] = table->undoCount;
+    return ERROR_OK;
+}
+
+void Symtable_PopScope(Symtable *table) {
+    if (table->scopeCount == 0) return;
+    const size_t mark = table->scopes[--table->scopeCount];
+    while (table->undoCount > mark) {
+        const SymtableUndo *undo = &table->undo[--table->undoCount];
+        table->entries[undo->entry].depth = undo->depth;
+        table->entries[undo->entry].id = undo->id;
+    }
+}
+
+ErrorType Symtable_Declare(Symtable *table, const char *name, unsigned *id) {
+    // the table lives at depth 1 even before the first PushScope (function parameters)
+    const unsigned depth = (unsigned) table->scopeCount + 1;
+
+    size_t bucket = findBucket(table, name);
+    size_t index;
+    if (table->buckets[bucket] != 0) {
+        index = table->buckets[bucket] - 1;
+        if (table->entries[index].depth == depth) {
+            return ERROR_SEMANTIC_REDEFINITION;
+        }
+    } else {
+        if (table->entryCount == table->entryCapacity) {
+            const size_t newCapacity = table->entryCapacity * 2;
+            SymtableEntry *entries = realloc(table->entries, newCapacity * sizeof(SymtableEntry));
+            if (entries == nullptr) return ERROR_OTHER;
+            table->entries = entries;
+            table->entryCapacity = newCapacity;
+        }
+        // keep the load factor at or below one half
+        if ((table->entryCount + 1) * 2 > table->bucketCount) {
+            if (!rehash(table, table->bucketCount * 2)) return ERROR_OTHER;
+            bucket = findBucket(table, name);
+        }
+        char *copy = strdup(name);
+        if (copy == nullptr) return ERROR_OTHER;
+        index = table->entryCount++;
+        table->entries[index] = (SymtableEntry){.name = copy, .depth = 0, .id = 0};
+        table->buckets[bucket] = index + 1;
+    }
+
+    if (table->undoCount == table->undoCapacity) {
+        const size_t newCapacity = table->undoCapacity * 2;
+        SymtableUndo *undo = realloc(table->undo, newCapacity * sizeof(SymtableUndo));
+        if (undo == nullptr) return ERROR_OTHER;
+        table->undo = undo;
+        table->undoCapacity = newCapacity;
+    }
+    SymtableEntry *entry = &table->entries[index];
+    table->undo[table->undoCount++] = (SymtableUndo){.entry = index, .depth = entry->depth, .id = entry->id};
+    entry->depth = depth;
+    entry->id = ++table->declarationCount;
+    if (id != nullptr) *id = entry->id;
+    return ERROR_OK;
+}
+
+ErrorType Symtable_Lookup(const Symtable *table, const char *name, unsigned *id) {
+    const size_t bucket = findBucket(table, name);
+    if (table->buckets[bucket] == 0) return ERROR_SEMANTIC_USEOFUNDEFINED;
+    const SymtableEntry *entry = &table->entries[table->buckets[bucket] - 1];
+    if (entry->depth == 0) return ERROR_SEMANTIC_USEOFUNDEFINED;
+    if (id != nullptr) *id = entry->id;
+    return ERROR_OK;
+}
+
+void Symtable_Clear(Symtable *table) {
+    for (size_t i = 0; i < table->entryCount; i++) {
+        free(table->entries[i].name);
+    }
+    memset(table->buckets, 0, table->bucketCount * sizeof(size_t));
+    table->entryCount = 0;
+    table->undoCount = 0;
+    table->scopeCount = 0;
+    table->declarationCount = 0;
+}
+
+void Symtable_dtor(Symtable *table) {
+    if (table == nullptr) return;
+    if (table->entries != nullptr && table->buckets != nullptr) {
+        Symtable_Clear(table);
+    }
+    free(table->entries);
+    free(table->buckets);
+    free(table->undo);
+    free(table->scopes);
+    free(table);
+}
+
+static size_t findFunctionBucket(const FunctionTable *table, const char *name) {
+    const size_t mask = table->bucketCount - 1;
+    size_t bucket = (size_t) hashName(name) & mask;
+    while (table->buckets[bucket] != 0) {
+        const FunctionTableEntry *entry = &table->entries[table->buckets[bucket] - 1];
+        if (strcmp(entry->name, name) == 0) {
+            return bucket;
+        }
+        bucket = (bucket + 1) & mask;
+    }
+    return bucket;
+}
+
+static bool hasArity(const FunctionTableEntry *entry, const unsigned arity) {
+    for (size_t i = 0; i < entry->arityCount; i++) {
+        if (entry->arities[i] == arity) return true;
+    }
+    return false;
+}
+
+FunctionTable *FunctionTable_ctor(const size_t capacity) {
+    size_t cap = SYMTABLE_MIN_CAPACITY;
+    while (cap < capacity) cap *= 2;
+
+    FunctionTable *table = calloc(1, sizeof(FunctionTable));
+    if (table == nullptr) return nullptr;
+    table->entries = malloc(cap * sizeof(FunctionTableEntry));
+    table->buckets = calloc(cap * 2, sizeof(size_t));
+    if (table->entries == nullptr || table->buckets == nullptr) {
+        FunctionTable_dtor(table);
+        return nullptr;
+    }
+    table->entryCapacity = cap;
+    table->bucketCount = cap * 2;
+    return table;
+}
+
+ErrorType FunctionTable_Define(FunctionTable *table, const char *name, const FunctionKind kind,
+                               const unsigned arity) {
+    size_t bucket = findFunctionBucket(table, name);
+    if (table->buckets[bucket] == 0) {
+        if (table->entryCount == table->entryCapacity) {
+            const size_t newCapacity = table->entryCapacity * 2;
+            FunctionTableEntry *entries = realloc(table->entries, newCapacity * sizeof(FunctionTableEntry));
+            if (entries == nullptr) return ERROR_OTHER;
+            table->entries = entries;
+            table->entryCapacity = newCapacity;
+        }
+        if ((table->entryCount + 1) * 2 > table->bucketCount) {
+            const size_t bucketCount = table->bucketCount * 2;
+            size_t *buckets = calloc(bucketCount, sizeof(size_t));
+            if (buckets == nullptr) return ERROR_OTHER;
+            free(table->buckets);
+            table->buckets = buckets;
+            table->bucketCount = bucketCount;
+            for (size_t i = 0; i < table->entryCount; i++) {
+                table->buckets[findFunctionBucket(table, table->entries[i].name)] = i + 1;
+            }
+            bucket = findFunctionBucket(table, name);
+        }
+        char *copy = strdup(name);
+        if (copy == nullptr) return ERROR_OTHER;
+        table->entries[table->entryCount] = (FunctionTableEntry){.name = copy};
+        table->buckets[bucket] = ++table->entryCount;
+    }
+
+    FunctionTableEntry *entry = &table->entries[table->buckets[bucket] - 1];
+    switch (kind) {
+        case FNKIND_GETTER:
+            if (entry->hasGetter) return ERROR_SEMANTIC_REDEFINITION;
+            entry->hasGetter = true;
+            return ERROR_OK;
+        case FNKIND_SETTER:
+            if (entry->hasSetter) return ERROR_SEMANTIC_REDEFINITION;
+            entry->hasSetter = true;
+            return ERROR_OK;
+        case FNKIND_FUNCTION:
+        default:
+            break;
+    }
+    if (hasArity(entry, arity)) return ERROR_SEMANTIC_REDEFINITION;
+    if (entry->arityCount == entry->arityCapacity) {
+        const size_t newCapacity = entry->arityCapacity ? entry->arityCapacity * 2 : 2;
+        unsigned *arities = realloc(entry->arities, newCapacity * sizeof(unsigned));
+        if (arities == nullptr) return ERROR_OTHER;
+        entry->arities = arities;
+        entry->arityCapacity = newCapacity;
+    }
+    entry->arities[entry->arityCount++] = arity;
+    return ERROR_OK;
+}
+
+ErrorType FunctionTable_CheckCall(const FunctionTable *table, const char *name, const FunctionKind kind,
+                                  const unsigned arity) {
+    const size_t bucket = findFunctionBucket(table, name);
+    if (table->buckets[bucket] == 0) return ERROR_SEMANTIC_USEOFUNDEFINED;
+    const FunctionTableEntry *entry = &table->entries[table->buckets[bucket] - 1];
+    switch (kind) {
+        case FNKIND_GETTER:
+            return entry->hasGetter ? ERROR_OK : ERROR_SEMANTIC_USEOFUNDEFINED;
+        case FNKIND_SETTER:
+            return entry->hasSetter ? ERROR_OK : ERROR_SEMANTIC_USEOFUNDEFINED;
+        case FNKIND_FUNCTION:
+        default:
+            break;
+    }
+    if (entry->arityCount == 0) return ERROR_SEMANTIC_USEOFUNDEFINED;
+    return hasArity(entry, arity) ? ERROR_OK : ERROR_SEMANTIC_STATIC_UNEXPECTEDPARAMETER;
+}
+
+void FunctionTable_dtor(FunctionTable *table) {
+    if (table == nullptr) return;
+    if (table->entries != nullptr) {
+        for (size_t i = 0; i < table->entryCount; i++) {
+            free(table->entries[i].name);
+            free(table->entries[i].arities);
+        }
+    }
+    free(table->entries);
+    free(table->buckets);
+    free(table);
+}
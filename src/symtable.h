@@ -0,0 +1,100 @@
+﻿#ifndef IFJCODE25_SYMTABLE_H
+#define IFJCODE25_SYMTABLE_H
+
+#include <stddef.h>
+
+#include "error.h"
+
+/*
+ * Local variable table of a single function.
+ *
+ * All scopes share one flat hash table. Every name has exactly one entry holding
+ * its currently visible declaration; a shadowed declaration is pushed to the undo
+ * log and restored from it when the block closes, so opening or closing a scope
+ * never allocates.
+ */
+
+typedef struct SymtableEntry {
+    char *name;
+    unsigned depth; // depth of the visible declaration, 0 = not declared
+    unsigned id;    // declaration number within the function
+} SymtableEntry;
+
+typedef struct SymtableUndo {
+    size_t entry;
+    unsigned depth;
+    unsigned id;
+} SymtableUndo;
+
+typedef struct Symtable {
+    SymtableEntry *entries;
+    size_t entryCount;
+    size_t entryCapacity;
+
+    // indices into entries shifted by one, 0 = empty slot
+    size_t *buckets;
+    size_t bucketCount;
+
+    SymtableUndo *undo;
+    size_t undoCount;
+    size_t undoCapacity;
+
+    size_t *scopes; // undo log length at the time the scope was opened
+    size_t scopeCount;
+    size_t scopeCapacity;
+
+    unsigned declarationCount;
+} Symtable;
+
+Symtable *Symtable_ctor(size_t capacity);
+
+ErrorType Symtable_PushScope(Symtable *table);
+
+void Symtable_PopScope(Symtable *table);
+
+ErrorType Symtable_Declare(Symtable *table, const char *name, unsigned *id);
+
+ErrorType Symtable_Lookup(const Symtable *table, const char *name, unsigned *id);
+
+void Symtable_Clear(Symtable *table);
+
+void Symtable_dtor(Symtable *table);
+
+/*
+ * Table of user functions, filled by the pre-scan before any body is parsed.
+ * One entry per name: the getter, the setter and every overload by arity.
+ */
+
+typedef enum FunctionKind {
+    FNKIND_FUNCTION,
+    FNKIND_GETTER,
+    FNKIND_SETTER,
+} FunctionKind;
+
+typedef struct FunctionTableEntry {
+    char *name;
+    bool hasGetter;
+    bool hasSetter;
+    unsigned *arities;
+    size_t arityCount;
+    size_t arityCapacity;
+} FunctionTableEntry;
+
+typedef struct FunctionTable {
+    FunctionTableEntry *entries;
+    size_t entryCount;
+    size_t entryCapacity;
+
+    size_t *buckets;
+    size_t bucketCount;
+} FunctionTable;
+
+FunctionTable *FunctionTable_ctor(size_t capacity);
+
+ErrorType FunctionTable_Define(FunctionTable *table, const char *name, FunctionKind kind, unsigned arity);
+
+ErrorType FunctionTable_CheckCall(const FunctionTable *table, const char *name, FunctionKind kind, unsigned arity);
+
+void FunctionTable_dtor(FunctionTable *table);
+
+#endif
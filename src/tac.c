@@ -0,0 +1,298 @@
+﻿#include "tac.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "format.h"
+
+#define TEMP_PREFIX "LF@%t"
+#define TEMP_NAME_MAX (sizeof TEMP_PREFIX + FORMAT_NUMBER_MAX)
+
+typedef struct StackForm {
+    Opcode opcode; // three-address variant, OP_NOP if there is none
+    unsigned operands;
+} StackForm;
+
+static const StackForm STACK_FORMS[OP_COUNT] = {
+    [OP_ADDS] = {OP_ADD, 2},
+    [OP_SUBS] = {OP_SUB, 2},
+    [OP_MULS] = {OP_MUL, 2},
+    [OP_DIVS] = {OP_DIV, 2},
+    [OP_IDIVS] = {OP_IDIV, 2},
+    [OP_LTS] = {OP_LT, 2},
+    [OP_GTS] = {OP_GT, 2},
+    [OP_EQS] = {OP_EQ, 2},
+    [OP_ANDS] = {OP_AND, 2},
+    [OP_ORS] = {OP_OR, 2},
+    [OP_STRI2INTS] = {OP_STRI2INT, 2},
+    [OP_NOTS] = {OP_NOT, 1},
+    [OP_INT2FLOATS] = {OP_INT2FLOAT, 1},
+    [OP_FLOAT2INTS] = {OP_FLOAT2INT, 1},
+    [OP_INT2CHARS] = {OP_INT2CHAR, 1},
+    [OP_INT2STRS] = {OP_INT2STR, 1},
+    [OP_FLOAT2STRS] = {OP_FLOAT2STR, 1},
+    [OP_ISINTS] = {OP_ISINT, 1},
+    [OP_JUMPIFEQS] = {OP_JUMPIFEQ, 2},
+    [OP_JUMPIFNEQS] = {OP_JUMPIFNEQ, 2},
+};
+
+typedef struct Converter {
+    InstrList *out;
+
+    // operands pushed but not yet written, bottom first; they point into the
+    // input list or at a temporary's name
+    const char **held;
+    size_t heldCount;
+    size_t heldCapacity;
+
+    char **temps;
+    size_t tempCount;
+    size_t tempCapacity;
+    bool canAllocate;
+} Converter;
+
+static bool reserve(void **data, size_t *capacity, const size_t count, const size_t size) {
+    if (count < *capacity) return true;
+    const size_t newCapacity = *capacity ? *capacity * 2 : 16;
+    void *grown = realloc(*data, newCapacity * size);
+    if (grown == nullptr) return false;
+    *data = grown;
+    *capacity = newCapacity;
+    return true;
+}
+
+static ErrorType append(const Converter *conv, const Opcode opcode, const char *first, const char *second,
+                        const char *third) {
+    return InstrList_Insert(conv->out, conv->out->count, opcode, first, second, third);
+}
+
+static const char *temporaryName(char name[static TEMP_NAME_MAX], const size_t index) {
+    memcpy(name, TEMP_PREFIX, sizeof TEMP_PREFIX - 1);
+    Format_Unsigned(name + sizeof TEMP_PREFIX - 1, index + 1);
+    return name;
+}
+
+// Every result gets a new temporary so value numbering can still find it, Tac_PackTemporaries shares them
+static ErrorType allocate(Converter *conv, const char **temp) {
+    if (!reserve((void **) &conv->temps, &conv->tempCapacity, conv->tempCount, sizeof(char *))) return ERROR_OTHER;
+    char name[TEMP_NAME_MAX];
+    conv->temps[conv->tempCount] = strdup(temporaryName(name, conv->tempCount));
+    if (conv->temps[conv->tempCount] == nullptr) return ERROR_OTHER;
+    *temp = conv->temps[conv->tempCount++];
+    return ERROR_OK;
+}
+
+static ErrorType hold(Converter *conv, const char *operand) {
+    if (!reserve((void **) &conv->held, &conv->heldCapacity, conv->heldCount, sizeof(char *))) return ERROR_OTHER;
+    conv->held[conv->heldCount++] = operand;
+    return ERROR_OK;
+}
+
+// Pushes everything held back, in order
+static ErrorType flush(Converter *conv) {
+    for (size_t i = 0; i < conv->heldCount; i++) {
+        const ErrorType error = append(conv, OP_PUSHS, conv->held[i], nullptr, nullptr);
+        if (error != ERROR_OK) return error;
+    }
+    conv->heldCount = 0;
+    return ERROR_OK;
+}
+
+static bool holds(const Converter *conv, const char *operand) {
+    for (size_t i = 0; i < conv->heldCount; i++) {
+        if (strcmp(conv->held[i], operand) == 0) return true;
+    }
+    return false;
+}
+
+static bool holdsFrame(const Converter *conv, const char *frame) {
+    for (size_t i = 0; i < conv->heldCount; i++) {
+        if (strncmp(conv->held[i], frame, 3) == 0) return true;
+    }
+    return false;
+}
+
+static ErrorType copy(const Converter *conv, const Instr *instr) {
+    return append(conv, instr->opcode, instr->operands[0], instr->operands[1], instr->operands[2]);
+}
+
+static ErrorType convertPop(Converter *conv, const Instr *instr) {
+    if (conv->heldCount == 0) return copy(conv, instr);
+    const char *top = conv->held[--conv->heldCount];
+    const char *target = instr->operands[0];
+    ErrorType error;
+    if (holds(conv, target) && (error = flush(conv)) != ERROR_OK) return error;
+    if (strcmp(top, target) == 0) return ERROR_OK;
+    return append(conv, OP_MOVE, target, top, nullptr);
+}
+
+static ErrorType convertStackOperation(Converter *conv, const Instr *instr) {
+    const StackForm form = STACK_FORMS[instr->opcode];
+    const bool jump = instr->opcode == OP_JUMPIFEQS || instr->opcode == OP_JUMPIFNEQS;
+    ErrorType error;
+    if (conv->heldCount < form.operands || (!jump && !conv->canAllocate)) {
+        if ((error = flush(conv)) != ERROR_OK) return error;
+        return copy(conv, instr);
+    }
+
+    const char *operands[2] = {};
+    for (unsigned i = form.operands; i-- > 0;) operands[i] = conv->held[--conv->heldCount];
+    if (jump) {
+        if ((error = flush(conv)) != ERROR_OK) return error;
+        return append(conv, form.opcode, instr->operands[0], operands[0], operands[1]);
+    }
+
+    const char *temp;
+    if ((error = allocate(conv, &temp)) != ERROR_OK) return error;
+    if ((error = append(conv, form.opcode, temp, operands[0], operands[1])) != ERROR_OK) return error;
+    return hold(conv, temp);
+}
+
+static ErrorType convert(Converter *conv, const Instr *instr) {
+    ErrorType error;
+    switch (instr->opcode) {
+        case OP_PUSHS:
+            return hold(conv, instr->operands[0]);
+        case OP_POPS:
+            return convertPop(conv, instr);
+        case OP_CREATEFRAME:
+            // arguments are usually held across it until they are popped into the new frame
+            if (holdsFrame(conv, "TF@") && (error = flush(conv)) != ERROR_OK) return error;
+            return copy(conv, instr);
+        case OP_PUSHFRAME:
+        case OP_POPFRAME:
+        case OP_CALL:
+        case OP_RETURN:
+        case OP_CLEARS:
+        case OP_LABEL:
+        case OP_JUMP:
+        case OP_JUMPIFEQ:
+        case OP_JUMPIFNEQ:
+        case OP_EXIT:
+        case OP_BREAK:
+        case OP_DPRINT:
+            if ((error = flush(conv)) != ERROR_OK) return error;
+            return copy(conv, instr);
+        default:
+            if (STACK_FORMS[instr->opcode].opcode != OP_NOP) return convertStackOperation(conv, instr);
+            if (Opcode_WritesFirst(instr->opcode) && holds(conv, instr->operands[0]) && (error = flush(conv)) != ERROR_OK) {
+                return error;
+            }
+            return copy(conv, instr);
+    }
+}
+
+static ErrorType convertBlocks(Converter *conv, const InstrList *code, const Cfg *cfg) {
+    ErrorType error;
+    for (size_t b = 0; b < cfg->blockCount; b++) {
+        const BasicBlock *block = &cfg->blocks[b];
+        for (size_t i = block->first; i < block->first + block->count; i++) {
+            if ((error = convert(conv, &code->items[i])) != ERROR_OK) return error;
+        }
+        if ((error = flush(conv)) != ERROR_OK) return error;
+    }
+    return ERROR_OK;
+}
+
+ErrorType Tac_Convert(InstrList *code, const Cfg *cfg, unsigned long *saved) {
+    Converter conv = {
+        .out = InstrList_ctor(code->count),
+        .canAllocate = code->count >= 2 && code->items[0].opcode == OP_LABEL &&
+                       code->items[1].opcode == OP_PUSHFRAME,
+    };
+    if (conv.out == nullptr) return ERROR_OTHER;
+
+    const ErrorType error = convertBlocks(&conv, code, cfg);
+    if (error == ERROR_OK) {
+        if (conv.out->count < code->count) *saved += code->count - conv.out->count;
+        const InstrList converted = *conv.out;
+        *conv.out = *code;
+        *code = converted;
+    }
+
+    InstrList_dtor(conv.out);
+    for (size_t i = 0; i < conv.tempCount; i++) free(conv.temps[i]);
+    free(conv.temps);
+    free(conv.held);
+    return error;
+}
+
+static bool temporaryIndex(const char *operand, size_t *index) {
+    const size_t prefix = strlen(TEMP_PREFIX);
+    if (operand == nullptr || strncmp(operand, TEMP_PREFIX, prefix) != 0) return false;
+    if (operand[prefix] < '0' || operand[prefix] > '9') return false;
+    *index = strtoull(operand + prefix, nullptr, 10) - 1;
+    return true;
+}
+
+typedef struct Packing {
+    size_t *lastUse;  // per temporary, index of the last instruction using it
+    size_t *physical; // per temporary, the one it is renamed to
+    bool *busy;       // per physical temporary
+    size_t count;     // temporaries before packing
+    size_t used;      // and after
+} Packing;
+
+static ErrorType renameOperand(InstrList *code, const size_t index, const size_t operand, const size_t physical) {
+    char name[TEMP_NAME_MAX];
+    return InstrList_SetOperand(code, index, operand, temporaryName(name, physical));
+}
+
+static ErrorType pack(Packing *packing, InstrList *code) {
+    size_t temp;
+    for (size_t i = 0; i < code->count; i++) {
+        for (size_t j = 0; j < INSTR_MAX_OPERANDS; j++) {
+            if (temporaryIndex(code->items[i].operands[j], &temp)) packing->lastUse[temp] = i;
+        }
+    }
+
+    ErrorType error;
+    for (size_t i = 0; i < code->count; i++) {
+        Instr *instr = &code->items[i];
+        const size_t firstRead = Opcode_WritesFirst(instr->opcode) ? 1 : 0;
+        // the instruction reads its operands before writing, so the result may take an operand's place
+        for (size_t j = firstRead; j < INSTR_MAX_OPERANDS; j++) {
+            if (!temporaryIndex(instr->operands[j], &temp)) continue;
+            if ((error = renameOperand(code, i, j, packing->physical[temp])) != ERROR_OK) return error;
+            if (packing->lastUse[temp] == i) packing->busy[packing->physical[temp]] = false;
+        }
+        if (firstRead == 0 || !temporaryIndex(instr->operands[0], &temp)) continue;
+        size_t physical = 0;
+        while (packing->busy[physical]) physical++;
+        packing->physical[temp] = physical;
+        packing->busy[physical] = packing->lastUse[temp] != i;
+        if (physical + 1 > packing->used) packing->used = physical + 1;
+        if ((error = renameOperand(code, i, 0, physical)) != ERROR_OK) return error;
+    }
+
+    // defined right after the PUSHFRAME, temporaries exist only when Tac_Convert found one
+    for (size_t physical = packing->used; physical-- > 0;) {
+        char name[TEMP_NAME_MAX];
+        error = InstrList_Insert(code, 2, OP_DEFVAR, temporaryName(name, physical), nullptr, nullptr);
+        if (error != ERROR_OK) return error;
+    }
+    return ERROR_OK;
+}
+
+ErrorType Tac_PackTemporaries(InstrList *code) {
+    Packing packing = {};
+    size_t temp;
+    for (size_t i = 0; i < code->count; i++) {
+        for (size_t j = 0; j < INSTR_MAX_OPERANDS; j++) {
+            if (temporaryIndex(code->items[i].operands[j], &temp) && temp + 1 > packing.count) packing.count = temp + 1;
+        }
+    }
+    if (packing.count == 0) return ERROR_OK;
+
+    packing.lastUse = calloc(packing.count, sizeof(size_t));
+    packing.physical = calloc(packing.count, sizeof(size_t));
+    packing.busy = calloc(packing.count, sizeof(bool));
+    ErrorType error = ERROR_OTHER;
+    if (packing.lastUse != nullptr && packing.physical != nullptr && packing.busy != nullptr) {
+        error = pack(&packing, code);
+    }
+    free(packing.lastUse);
+    free(packing.physical);
+    free(packing.busy);
+    return error;
+}
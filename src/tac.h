@@ -0,0 +1,26 @@
+﻿#ifndef IFJCODE25_TAC_H
+#define IFJCODE25_TAC_H
+
+#include "cfg.h"
+#include "error.h"
+#include "instr.h"
+
+/*
+ * Three-address form of the lowered stack code. Within each basic block the
+ * operands of PUSHS are held back instead of pushed; a stack operation whose
+ * operands are all held back becomes its three-address variant writing a
+ * new LF@%tN temporary, POPS becomes MOVE and JUMPIFEQS becomes JUMPIFEQ.
+ * Whatever is still held back is pushed before anything that could change its
+ * value, at the end of the block and before frames change. Temporaries are
+ * only used where a PUSHFRAME follows the entry label; code without one (the
+ * entry point) only gets its moves forwarded.
+ */
+ErrorType Tac_Convert(InstrList *code, const Cfg *cfg, unsigned long *saved);
+
+/*
+ * Lets temporaries whose uses do not overlap share one variable and defines
+ * them after the PUSHFRAME. None of them lives across the end of a block.
+ */
+ErrorType Tac_PackTemporaries(InstrList *code);
+
+#endif
@@ -0,0 +1,71 @@
+﻿#include "tailcall.h"
+
+#include <string.h>
+
+#include "callgraph.h"
+#include "semantic.h"
+
+bool TailCall_IsSelf(const ASTNode *function, const ASTNode *expression) {
+    const Token *token = &expression->token;
+    if (token->type != TKTYPE_PUNCTUATION || token->punctuation_type != PTTYPE_OPENPARENTHESIS) return false;
+    unsigned arity;
+    if (Semantic_FunctionKind(function, &arity) != FNKIND_FUNCTION) return false;
+    const ASTNode *callee = ASTNode_child(expression, 0);
+    return callee->token.type == TKTYPE_IDENTIFIER &&
+           strcmp(callee->token.identifier, ASTNode_child(function, 0)->token.identifier) == 0 &&
+           ASTNode_childCount(expression) - 1 == arity;
+}
+
+static size_t countSelfCalls(const ASTNode *function, const ASTNode *node) {
+    size_t count = TailCall_IsSelf(function, node) ? 1 : 0;
+    for (size_t i = CallGraph_IsNamed(node) ? 1 : 0; i < ASTNode_childCount(node); i++) {
+        count += countSelfCalls(function, ASTNode_child(node, i));
+    }
+    return count;
+}
+
+bool TailCall_IsAccumulating(const ASTNode *function, const ASTNode *expression, const OPERATOR_TYPE operator) {
+    return expression->token.type == TKTYPE_OPERATOR && expression->token.operator_type == operator &&
+           TailCall_IsSelf(function, ASTNode_child(expression, 1)) &&
+           countSelfCalls(function, ASTNode_child(expression, 0)) == 0;
+}
+
+typedef struct Recursion {
+    size_t handled; // self calls in returns the loop form covers
+    size_t accumulating;
+    OPERATOR_TYPE operator;
+    bool mixed; // accumulating returns with different operators
+} Recursion;
+
+static void findReturns(const ASTNode *function, const ASTNode *node, Recursion *recursion) {
+    const Token *token = &node->token;
+    // a return in an inlined body only leaves that copy
+    if (token->type == TKTYPE_KEYWORD && token->keyword_type == KWTYPE_STATIC) return;
+    if (token->type == TKTYPE_KEYWORD && token->keyword_type == KWTYPE_RETURN) {
+        if (ASTNode_childCount(node) == 0) return;
+        const ASTNode *value = ASTNode_child(node, 0);
+        if (TailCall_IsSelf(function, value)) {
+            recursion->handled++;
+        } else if (TailCall_IsAccumulating(function, value, OPTYPE_PLUS) ||
+                   TailCall_IsAccumulating(function, value, OPTYPE_MULTIPLY)) {
+            if (recursion->accumulating > 0 && recursion->operator != value->token.operator_type) {
+                recursion->mixed = true;
+            }
+            recursion->operator = value->token.operator_type;
+            recursion->accumulating++;
+            recursion->handled++;
+        }
+        return;
+    }
+    for (size_t i = 0; i < ASTNode_childCount(node); i++) findReturns(function, ASTNode_child(node, i), recursion);
+}
+
+bool TailCall_Accumulator(const ASTNode *function, OPERATOR_TYPE *operator) {
+    const ASTNode *body = ASTNode_child(function, ASTNode_childCount(function) - 1);
+    Recursion recursion = {};
+    findReturns(function, body, &recursion);
+    if (recursion.accumulating == 0 || recursion.mixed) return false;
+    if (recursion.handled != countSelfCalls(function, body)) return false;
+    *operator = recursion.operator;
+    return true;
+}
@@ -0,0 +1,28 @@
+﻿#ifndef IFJCODE25_TAILCALL_H
+#define IFJCODE25_TAILCALL_H
+
+#include "parser.h"
+#include "token.h"
+
+/*
+ * Self recursion that codegen turns into a loop. In `return f(...)` inside f
+ * the arguments go into the parameters and control jumps back to the start of
+ * the body instead of calling. A linear recursion such as `return n * f(n - 1)`
+ * keeps the pending left operands in an accumulator instead: the function then
+ * returns `acc op value` for every other return value, so it may compute a
+ * different float rounding than the nested calls would.
+ */
+
+// Whether expression is a call of function itself
+bool TailCall_IsSelf(const ASTNode *function, const ASTNode *expression);
+
+// Whether expression is `x op f(...)` with no call of function f in x
+bool TailCall_IsAccumulating(const ASTNode *function, const ASTNode *expression, OPERATOR_TYPE operator);
+
+/*
+ * Whether every call of function to itself is `return f(...)` or
+ * `return x op f(...)` with the same op, + or *, and at least one of the latter
+ */
+bool TailCall_Accumulator(const ASTNode *function, OPERATOR_TYPE *operator);
+
+#endif
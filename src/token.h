@@ -88,8 +88,8 @@ typedef struct Token {
         const char *identifier;
         PUNCTUATION_TYPE punctuation_type;
         OPERATOR_TYPE operator_type;
-        int int_value;
-        float float_value;
+        long long int_value;
+        double float_value;
         const char *string_value;
         bool bool_value;
     };
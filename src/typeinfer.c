@@ -0,0 +1,514 @@
+﻿#include "typeinfer.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "format.h"
+#include "symtable.h"
+
+// Largest loop (in AST nodes) that gets an int copy
+#define VERSION_MAX_NODES 400
+
+typedef struct Inference {
+    Symtable *slots; // frame name of a local -> slot index + 1
+    size_t slotCount;
+    ValueType *state; // current type of every local
+    unsigned versions; // int copies of loops made so far
+} Inference;
+
+static bool isLocal(const ASTNode *node) {
+    return node->token.type == TKTYPE_VARIABLE && strncmp(node->token.identifier, "LF@", 3) == 0;
+}
+
+static ValueType *localType(const Inference *inference, const ASTNode *variable) {
+    unsigned id;
+    if (!isLocal(variable) || Symtable_Lookup(inference->slots, variable->token.identifier, &id) != ERROR_OK) {
+        return nullptr;
+    }
+    return &inference->state[id - 1];
+}
+
+// Gives every local declared in the subtree its own slot
+static ErrorType collectLocals(Inference *inference, const ASTNode *node) {
+    if (node->token.type == TKTYPE_KEYWORD && node->token.keyword_type == KWTYPE_VAR) {
+        const ErrorType error = Symtable_Declare(inference->slots, ASTNode_child(node, 0)->token.identifier, nullptr);
+        if (error != ERROR_OK) return error;
+        inference->slotCount++;
+    }
+    for (size_t i = 0; i < ASTNode_childCount(node); i++) {
+        const ErrorType error = collectLocals(inference, ASTNode_child(node, i));
+        if (error != ERROR_OK) return error;
+    }
+    return ERROR_OK;
+}
+
+// Result of + - * on numbers: an int only if both sides can be ints, a float if either side can be one
+static ValueType numericResult(const ValueType left, const ValueType right) {
+    ValueType result = VT_NONE;
+    if ((left & VT_INT) && (right & VT_INT)) result |= VT_INT;
+    if ((left & VT_NUM) && (right & VT_NUM) && ((left | right) & VT_FLOAT)) result |= VT_FLOAT;
+    return result;
+}
+
+static ValueType inferExpression(const Inference *inference, ASTNode *expression);
+
+static ValueType inferCall(const Inference *inference, const ASTNode *call) {
+    for (size_t i = 1; i < ASTNode_childCount(call); i++) {
+        inferExpression(inference, ASTNode_child(call, i));
+    }
+    const ASTNode *callee = ASTNode_child(call, 0);
+    if (callee->token.type != TKTYPE_INBUILTFUNCTION) return VT_ANY;
+    switch (callee->token.inbuilt_function_type) {
+        case INBUILT_STRING:
+            return VT_STRING;
+        case INBUILT_WRITE:
+            return VT_NIL;
+        case INBUILT_READNUM:
+            return VT_FLOAT | VT_NIL;
+        case INBUILT_FLOOR:
+            return VT_INT;
+        default:
+            return VT_ANY;
+    }
+}
+
+static ValueType inferOperator(const Inference *inference, const ASTNode *operator) {
+    const ValueType left = inferExpression(inference, ASTNode_child(operator, 0));
+    if (operator->token.operator_type == OPTYPE_NOT) return VT_BOOL;
+    const ValueType right = inferExpression(inference, ASTNode_child(operator, 1));
+
+    switch (operator->token.operator_type) {
+        case OPTYPE_PLUS: {
+            ValueType result = numericResult(left, right);
+            if ((left & VT_STRING) && (right & VT_STRING)) result |= VT_STRING;
+            return result;
+        }
+        case OPTYPE_MINUS:
+            return numericResult(left, right);
+        case OPTYPE_MULTIPLY: {
+            ValueType result = numericResult(left, right);
+            if ((left & VT_STRING) && (right & VT_NUM)) result |= VT_STRING;
+            return result;
+        }
+        case OPTYPE_DIVIDE:
+            return (left & VT_NUM) && (right & VT_NUM) ? VT_FLOAT : VT_NONE;
+        default:
+            return VT_BOOL;
+    }
+}
+
+static ValueType inferExpression(const Inference *inference, ASTNode *expression) {
+    ValueType type;
+    switch (expression->token.type) {
+        case TKTYPE_LITERAL_INT:
+            type = VT_INT;
+            break;
+        case TKTYPE_LITERAL_FLOAT:
+            type = VT_FLOAT;
+            break;
+        case TKTYPE_LITERAL_STRING:
+            type = VT_STRING;
+            break;
+        case TKTYPE_LITERAL_NIL:
+            type = VT_NIL;
+            break;
+        case TKTYPE_LITERAL_BOOL:
+            type = VT_BOOL;
+            break;
+        case TKTYPE_VARIABLE: {
+            const ValueType *local = localType(inference, expression);
+            type = local ? *local : VT_ANY;
+            break;
+        }
+        case TKTYPE_PUNCTUATION:
+            type = inferCall(inference, expression);
+            break;
+        case TKTYPE_OPERATOR:
+            type = inferOperator(inference, expression);
+            break;
+        case TKTYPE_KEYWORD:
+            if (expression->token.keyword_type == KWTYPE_IS) {
+                inferExpression(inference, ASTNode_child(expression, 0));
+                type = VT_BOOL;
+            } else {
+                type = VT_ANY;
+            }
+            break;
+        default:
+            type = VT_ANY;
+            break;
+    }
+    expression->type = type;
+    return type;
+}
+
+static ErrorType inferBlock(Inference *inference, const ASTNode *block);
+
+static void join(ValueType *into, const ValueType *from, const size_t count) {
+    for (size_t i = 0; i < count; i++) into[i] |= from[i];
+}
+
+static ErrorType inferIf(Inference *inference, const ASTNode *statement) {
+    const size_t size = inference->slotCount * sizeof(ValueType);
+    ValueType *otherwise = malloc(size ? size : 1);
+    if (otherwise == nullptr) return ERROR_OTHER;
+    memcpy(otherwise, inference->state, size);
+
+    ErrorType error = inferBlock(inference, ASTNode_child(statement, 1));
+    if (error == ERROR_OK && ASTNode_childCount(statement) > 2) {
+        ValueType *then = inference->state;
+        inference->state = otherwise;
+        error = inferBlock(inference, ASTNode_child(statement, 2));
+        inference->state = then;
+    }
+    join(inference->state, otherwise, inference->slotCount);
+    free(otherwise);
+    return error;
+}
+
+// The body is walked again until the types at the loop head stop growing
+static ErrorType inferWhile(Inference *inference, const ASTNode *statement) {
+    const size_t size = inference->slotCount * sizeof(ValueType);
+    ValueType *head = malloc(size ? size : 1);
+    if (head == nullptr) return ERROR_OTHER;
+
+    ErrorType error = ERROR_OK;
+    for (;;) {
+        memcpy(head, inference->state, size);
+        inferExpression(inference, ASTNode_child(statement, 0));
+        if ((error = inferBlock(inference, ASTNode_child(statement, 1))) != ERROR_OK) break;
+        join(inference->state, head, inference->slotCount);
+        if (memcmp(inference->state, head, size) == 0) break;
+    }
+    free(head);
+    return error;
+}
+
+static ErrorType inferStatement(Inference *inference, const ASTNode *statement) {
+    const Token *token = &statement->token;
+
+    if (token->type == TKTYPE_PUNCTUATION) {
+        if (token->punctuation_type == PTTYPE_OPENBRACE) return inferBlock(inference, statement);
+        inferExpression(inference, (ASTNode *) statement);
+        return ERROR_OK;
+    }
+
+    if (token->type == TKTYPE_OPERATOR) {
+        const ValueType type = inferExpression(inference, ASTNode_child(statement, 1));
+        ValueType *local = localType(inference, ASTNode_child(statement, 0));
+        if (local != nullptr) *local = type;
+        return ERROR_OK;
+    }
+
+    switch (token->keyword_type) {
+        case KWTYPE_VAR: {
+            const ValueType type = ASTNode_childCount(statement) > 1
+                                       ? inferExpression(inference, ASTNode_child(statement, 1))
+                                       : VT_NIL;
+            ValueType *local = localType(inference, ASTNode_child(statement, 0));
+            if (local != nullptr) *local = type;
+            return ERROR_OK;
+        }
+        case KWTYPE_IF:
+            inferExpression(inference, ASTNode_child(statement, 0));
+            return inferIf(inference, statement);
+        case KWTYPE_WHILE:
+            return inferWhile(inference, statement);
+        case KWTYPE_RETURN:
+            if (ASTNode_childCount(statement) > 0) inferExpression(inference, ASTNode_child(statement, 0));
+            // nothing after a return is reachable, it must not widen the joins
+            memset(inference->state, 0, inference->slotCount * sizeof(ValueType));
+            return ERROR_OK;
+        default:
+            return ERROR_OK;
+    }
+}
+
+static ErrorType inferBlock(Inference *inference, const ASTNode *block) {
+    for (size_t i = 0; i < ASTNode_childCount(block); i++) {
+        const ErrorType error = inferStatement(inference, ASTNode_child(block, i));
+        if (error != ERROR_OK) return error;
+    }
+    return ERROR_OK;
+}
+
+// ---------------------------------------------------------------------------
+// Loop versioning
+
+typedef struct Names {
+    const char **items;
+    size_t count;
+    size_t capacity;
+} Names;
+
+static bool reserve(void **data, size_t *capacity, const size_t count, const size_t size) {
+    if (count < *capacity) return true;
+    const size_t newCapacity = *capacity ? *capacity * 2 : 16;
+    void *grown = realloc(*data, newCapacity * size);
+    if (grown == nullptr) return false;
+    *data = grown;
+    *capacity = newCapacity;
+    return true;
+}
+
+static bool contains(const Names *names, const char *name) {
+    for (size_t i = 0; i < names->count; i++) {
+        if (strcmp(names->items[i], name) == 0) return true;
+    }
+    return false;
+}
+
+static ErrorType addName(Names *names, const char *name) {
+    if (contains(names, name)) return ERROR_OK;
+    if (!reserve((void **) &names->items, &names->capacity, names->count, sizeof(char *))) return ERROR_OTHER;
+    names->items[names->count++] = name;
+    return ERROR_OK;
+}
+
+static size_t countNodes(const ASTNode *node) {
+    size_t count = 1;
+    for (size_t i = 0; i < ASTNode_childCount(node); i++) count += countNodes(ASTNode_child(node, i));
+    return count;
+}
+
+static bool isAssignment(const ASTNode *node) {
+    return (node->token.type == TKTYPE_OPERATOR && node->token.operator_type == OPTYPE_ASSIGN) ||
+           (node->token.type == TKTYPE_KEYWORD && node->token.keyword_type == KWTYPE_VAR);
+}
+
+static bool isNumericOperator(const ASTNode *node) {
+    if (node->token.type != TKTYPE_OPERATOR) return false;
+    switch (node->token.operator_type) {
+        case OPTYPE_PLUS:
+        case OPTYPE_MINUS:
+        case OPTYPE_MULTIPLY:
+        case OPTYPE_LESS:
+        case OPTYPE_GREATER:
+        case OPTYPE_LESSEQUAL:
+        case OPTYPE_GREATEREQUAL:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool isSingleNumber(const ValueType type) {
+    return type == VT_INT || type == VT_FLOAT;
+}
+
+static ErrorType collectDeclared(Names *declared, const ASTNode *node) {
+    if (node->token.type == TKTYPE_KEYWORD && node->token.keyword_type == KWTYPE_VAR) {
+        const ErrorType error = addName(declared, ASTNode_child(node, 0)->token.identifier);
+        if (error != ERROR_OK) return error;
+    }
+    for (size_t i = 0; i < ASTNode_childCount(node); i++) {
+        const ErrorType error = collectDeclared(declared, ASTNode_child(node, i));
+        if (error != ERROR_OK) return error;
+    }
+    return ERROR_OK;
+}
+
+/*
+ * Locals from outside the loop that are operands of arithmetic or comparisons
+ * and may be ints, but are not proven to be one
+ */
+static ErrorType collectCandidates(Names *candidates, const Names *declared, const ASTNode *node) {
+    if (isNumericOperator(node)) {
+        for (size_t i = 0; i < ASTNode_childCount(node); i++) {
+            const ASTNode *operand = ASTNode_child(node, i);
+            if (!isLocal(operand) || !(operand->type & VT_INT) || operand->type == VT_INT) continue;
+            if (contains(declared, operand->token.identifier)) continue;
+            const ErrorType error = addName(candidates, operand->token.identifier);
+            if (error != ERROR_OK) return error;
+        }
+    }
+    for (size_t i = 0; i < ASTNode_childCount(node); i++) {
+        const ErrorType error = collectCandidates(candidates, declared, ASTNode_child(node, i));
+        if (error != ERROR_OK) return error;
+    }
+    return ERROR_OK;
+}
+
+// Types every local was read with inside the loop, the ones a read can see at the loop head included
+static void joinReads(const Inference *inference, ValueType *entry, const ASTNode *node) {
+    ValueType *local;
+    if (node->token.type == TKTYPE_VARIABLE && (local = localType(inference, node)) != nullptr) {
+        entry[local - inference->state] |= node->type;
+    }
+    for (size_t i = isAssignment(node) ? 1 : 0; i < ASTNode_childCount(node); i++) {
+        joinReads(inference, entry, ASTNode_child(node, i));
+    }
+}
+
+// Operators whose operand types are proven single numbers, so they need no dispatch
+static size_t countDirect(const ASTNode *node) {
+    size_t count = 0;
+    if (isNumericOperator(node) && isSingleNumber(ASTNode_child(node, 0)->type) &&
+        isSingleNumber(ASTNode_child(node, 1)->type)) {
+        count++;
+    }
+    for (size_t i = 0; i < ASTNode_childCount(node); i++) count += countDirect(ASTNode_child(node, i));
+    return count;
+}
+
+// Locals declared in the copy get their own frame names: LF@x$3 -> LF@x$3%v<version>
+static ErrorType renameDeclared(ASTNode *node, const Names *declared, const unsigned version) {
+    if (node->token.type == TKTYPE_VARIABLE && contains(declared, node->token.identifier)) {
+        const char *name = node->token.identifier;
+        char *renamed = Format_Numbered(name, "%v", version);
+        if (renamed == nullptr) return ERROR_OTHER;
+        free((char *) name);
+        node->token.identifier = renamed;
+    }
+    for (size_t i = 0; i < ASTNode_childCount(node); i++) {
+        const ErrorType error = renameDeclared(ASTNode_child(node, i), declared, version);
+        if (error != ERROR_OK) return error;
+    }
+    return ERROR_OK;
+}
+
+// Slots for the renamed locals of a copy
+static ErrorType addSlots(Inference *inference, const ASTNode *copy) {
+    const size_t before = inference->slotCount;
+    ErrorType error = collectLocals(inference, copy);
+    if (error != ERROR_OK || inference->slotCount == before) return error;
+    ValueType *grown = realloc(inference->state, inference->slotCount * sizeof(ValueType));
+    if (grown == nullptr) return ERROR_OTHER;
+    inference->state = grown;
+    for (size_t i = before; i < inference->slotCount; i++) grown[i] = VT_ANY;
+    return ERROR_OK;
+}
+
+static ErrorType addGuards(ASTNode *loop, const Names *candidates) {
+    for (size_t i = 0; i < candidates->count; i++) {
+        char *name = strdup(candidates->items[i]);
+        if (name == nullptr) return ERROR_OTHER;
+        ASTNode *guard = ASTNode_ctor((Token){.type = TKTYPE_VARIABLE, .identifier = name});
+        if (guard == nullptr) {
+            free(name);
+            return ERROR_OTHER;
+        }
+        if (ASTNode_addChild(loop, guard) == nullptr) {
+            ASTNode_dtor(guard);
+            return ERROR_OTHER;
+        }
+    }
+    return ERROR_OK;
+}
+
+/*
+ * Infers a copy of the loop assuming the candidates hold ints when it is
+ * entered. It is kept when they stay ints through the loop and the copy
+ * has more operations without dispatch than the loop itself.
+ */
+static ErrorType versionLoop(Inference *inference, ASTNode *loop, const Names *candidates, const Names *declared,
+                             bool *versioned) {
+    ASTNode *copy = ASTNode_clone(loop);
+    ValueType *entry = calloc(inference->slotCount ? inference->slotCount : 1, sizeof(ValueType));
+    if (copy == nullptr || entry == nullptr) {
+        ASTNode_dtor(copy);
+        free(entry);
+        return ERROR_OTHER;
+    }
+    joinReads(inference, entry, loop);
+    const size_t outerCount = inference->slotCount;
+    const unsigned version = ++inference->versions;
+    ErrorType error = renameDeclared(copy, declared, version);
+    if (error == ERROR_OK) error = addSlots(inference, copy);
+
+    if (error == ERROR_OK) {
+        for (size_t i = 0; i < outerCount; i++) inference->state[i] = entry[i] ? entry[i] : VT_ANY;
+        bool stable = true;
+        for (size_t i = 0; i < candidates->count; i++) {
+            unsigned id;
+            if (Symtable_Lookup(inference->slots, candidates->items[i], &id) == ERROR_OK) {
+                inference->state[id - 1] = VT_INT;
+            }
+        }
+        error = inferWhile(inference, copy);
+        for (size_t i = 0; i < candidates->count && error == ERROR_OK; i++) {
+            unsigned id;
+            if (Symtable_Lookup(inference->slots, candidates->items[i], &id) == ERROR_OK) {
+                stable = stable && inference->state[id - 1] == VT_INT;
+            }
+        }
+        if (error == ERROR_OK && stable && countDirect(copy) > countDirect(loop)) {
+            if (ASTNode_addChild(loop, copy) == nullptr) {
+                error = ERROR_OTHER;
+            } else {
+                copy = nullptr;
+                *versioned = true;
+                error = addGuards(loop, candidates);
+            }
+        }
+    }
+    ASTNode_dtor(copy);
+    free(entry);
+    return error;
+}
+
+static ErrorType versionLoops(Inference *inference, const ASTNode *node);
+
+static ErrorType versionWhile(Inference *inference, ASTNode *loop) {
+    Names declared = {};
+    Names candidates = {};
+    bool versioned = false;
+    ErrorType error = ERROR_OK;
+    if (countNodes(loop) <= VERSION_MAX_NODES) {
+        error = collectDeclared(&declared, loop);
+        if (error == ERROR_OK) error = collectCandidates(&candidates, &declared, loop);
+        if (error == ERROR_OK && candidates.count > 0) {
+            error = versionLoop(inference, loop, &candidates, &declared, &versioned);
+        }
+    }
+    free(declared.items);
+    free(candidates.items);
+    // loops inside a versioned one are specialized with it, they are not copied again
+    if (error != ERROR_OK || versioned) return error;
+    return versionLoops(inference, ASTNode_child(loop, 1));
+}
+
+static ErrorType versionLoops(Inference *inference, const ASTNode *node) {
+    for (size_t i = 0; i < ASTNode_childCount(node); i++) {
+        ASTNode *child = ASTNode_child(node, i);
+        const ErrorType error = child->token.type == TKTYPE_KEYWORD && child->token.keyword_type == KWTYPE_WHILE
+                                    ? versionWhile(inference, child)
+                                    : versionLoops(inference, child);
+        if (error != ERROR_OK) return error;
+    }
+    return ERROR_OK;
+}
+
+ErrorType TypeInfer_Function(ASTNode *function) {
+    Inference inference = {.slots = Symtable_ctor(0)};
+    if (inference.slots == nullptr) return ERROR_OTHER;
+
+    // parameters come first, they may hold anything
+    const size_t childCount = ASTNode_childCount(function);
+    size_t paramCount = 0;
+    ErrorType error = ERROR_OK;
+    if (childCount > 2) {
+        const ASTNode *params = ASTNode_child(function, 1);
+        paramCount = ASTNode_childCount(params);
+        for (size_t i = 0; i < paramCount && error == ERROR_OK; i++) {
+            error = Symtable_Declare(inference.slots, ASTNode_child(params, i)->token.identifier, nullptr);
+        }
+        inference.slotCount = paramCount;
+    }
+    const ASTNode *body = ASTNode_child(function, childCount - 1);
+    if (error == ERROR_OK) error = collectLocals(&inference, body);
+
+    if (error == ERROR_OK) {
+        inference.state = calloc(inference.slotCount ? inference.slotCount : 1, sizeof(ValueType));
+        if (inference.state == nullptr) error = ERROR_OTHER;
+    }
+    if (error == ERROR_OK) {
+        for (size_t i = 0; i < paramCount; i++) inference.state[i] = VT_ANY;
+        error = inferBlock(&inference, body);
+    }
+    if (error == ERROR_OK) error = versionLoops(&inference, body);
+
+    free(inference.state);
+    Symtable_dtor(inference.slots);
+    return error;
+}
@@ -0,0 +1,21 @@
+﻿#ifndef IFJCODE25_TYPEINFER_H
+#define IFJCODE25_TYPEINFER_H
+
+#include "error.h"
+#include "parser.h"
+
+/*
+ * Flow-sensitive type inference over one checked function. Every expression
+ * node gets the set of types it can evaluate to (ASTNode.type), so codegen can
+ * drop the runtime TYPE dispatch where the operand types are proven. Locals are
+ * tracked through assignments, branches are joined and loops iterated to a
+ * fixed point; globals, parameters and results of user calls stay VT_ANY.
+ *
+ * A loop using locals that may be ints (parameters, say) in arithmetic or
+ * comparisons then gets a copy inferred as if they were ints on entry, kept
+ * when they stay ints and it saves dispatch. The locals are listed after it
+ * as guards and codegen runs the copy when all of them hold an int.
+ */
+ErrorType TypeInfer_Function(ASTNode *function);
+
+#endif
@@ -0,0 +1,1263 @@
+﻿#include "vm.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "format.h"
+#include "instr.h"
+#include "symtable.h"
+
+// Labels as values are a GNU extension, other compilers get a switch
+#if defined(__GNUC__) && !defined(VM_NO_COMPUTED_GOTO)
+#define VM_COMPUTED_GOTO
+#endif
+
+typedef enum ValueType {
+    VALUE_UNDEFINED, // no DEFVAR in the frame
+    VALUE_UNSET,     // defined, nothing assigned yet
+    VALUE_NIL,
+    VALUE_INT,
+    VALUE_FLOAT,
+    VALUE_BOOL,
+    VALUE_STRING,
+    VALUE_TYPE_COUNT
+} ValueType;
+
+// Strings are immutable and shared by counting their references
+typedef struct VmString {
+    size_t references;
+    size_t length;
+    char bytes[]; // followed by a '\0'
+} VmString;
+
+typedef struct Value {
+    ValueType type;
+
+    union {
+        long long integer;
+        double real;
+        bool boolean;
+        VmString *string;
+    };
+} Value;
+
+typedef enum OperandKind {
+    OPERAND_NONE,
+    OPERAND_GF, // index is the variable's name id - 1
+    OPERAND_LF,
+    OPERAND_TF,
+    OPERAND_CONSTANT, // index into constants
+    OPERAND_LABEL,    // index of the instruction it jumps to
+    OPERAND_TYPE,     // index is a ValueType
+} OperandKind;
+
+typedef struct Operand {
+    OperandKind kind;
+    size_t index;
+} Operand;
+
+// Opcodes handled by the same code of the dispatch loop
+typedef enum Handler {
+    HANDLER_INVALID,
+    HANDLER_MOVE,
+    HANDLER_CREATEFRAME,
+    HANDLER_PUSHFRAME,
+    HANDLER_POPFRAME,
+    HANDLER_DEFVAR,
+    HANDLER_CALL,
+    HANDLER_RETURN,
+    HANDLER_PUSHS,
+    HANDLER_POPS,
+    HANDLER_CLEARS,
+    HANDLER_BINARY,
+    HANDLER_BINARY_STACK,
+    HANDLER_UNARY,
+    HANDLER_UNARY_STACK,
+    HANDLER_TYPE,
+    HANDLER_READ,
+    HANDLER_WRITE,
+    HANDLER_SETCHAR,
+    HANDLER_JUMP,
+    HANDLER_JUMPIF,
+    HANDLER_JUMPIF_STACK,
+    HANDLER_EXIT,
+    HANDLER_BREAK,
+    HANDLER_DPRINT,
+    HANDLER_COUNT
+} Handler;
+
+typedef struct Code {
+    Opcode opcode;
+    Handler handler;
+    Operand operands[INSTR_MAX_OPERANDS];
+    size_t line; // in the program text
+} Code;
+
+typedef struct Frame {
+    Value *values;   // by name id - 1, VALUE_UNDEFINED unless the frame has it
+    size_t *defined; // indices of the values it has, to reset them when it is dropped
+    size_t definedCount;
+    size_t definedCapacity;
+    struct Frame *next; // on the list of frames to reuse
+} Frame;
+
+struct Vm {
+    Code *code;
+    size_t count;
+    size_t capacity;
+    unsigned long long *executed; // per instruction
+
+    Value *constants;
+    size_t constantCount;
+    size_t constantCapacity;
+
+    Symtable *names;      // variable name -> id, the same in every frame
+    Symtable *labels;     // label -> id, index + 1 into labelTargets
+    size_t *labelTargets; // instruction each label is at, SIZE_MAX until it is defined
+    size_t labelCount;
+    size_t labelCapacity;
+
+    Value typeNames[VALUE_TYPE_COUNT]; // the strings TYPE gives
+
+    Frame *global;
+    Frame **locals;
+    size_t localCount;
+    size_t localCapacity;
+    Frame *temporary;
+    Frame *unused;
+
+    Value *stack;
+    size_t stackCount;
+    size_t stackCapacity;
+
+    size_t *calls; // instruction after each CALL not yet returned from
+    size_t callCount;
+    size_t callCapacity;
+};
+
+// Operands per opcode: v variable, s variable or constant, l label, t type
+static const char *const SIGNATURES[OP_COUNT] = {
+    [OP_MOVE] = "vs",       [OP_CREATEFRAME] = "",   [OP_PUSHFRAME] = "",     [OP_POPFRAME] = "",
+    [OP_DEFVAR] = "v",      [OP_CALL] = "l",         [OP_RETURN] = "",        [OP_PUSHS] = "s",
+    [OP_POPS] = "v",        [OP_CLEARS] = "",        [OP_ADD] = "vss",        [OP_SUB] = "vss",
+    [OP_MUL] = "vss",       [OP_DIV] = "vss",        [OP_IDIV] = "vss",       [OP_ADDS] = "",
+    [OP_SUBS] = "",         [OP_MULS] = "",          [OP_DIVS] = "",          [OP_IDIVS] = "",
+    [OP_LT] = "vss",        [OP_GT] = "vss",         [OP_EQ] = "vss",         [OP_LTS] = "",
+    [OP_GTS] = "",          [OP_EQS] = "",           [OP_AND] = "vss",        [OP_OR] = "vss",
+    [OP_NOT] = "vs",        [OP_ANDS] = "",          [OP_ORS] = "",           [OP_NOTS] = "",
+    [OP_INT2FLOAT] = "vs",  [OP_FLOAT2INT] = "vs",   [OP_INT2CHAR] = "vs",    [OP_STRI2INT] = "vss",
+    [OP_INT2STR] = "vs",    [OP_FLOAT2STR] = "vs",   [OP_INT2FLOATS] = "",    [OP_FLOAT2INTS] = "",
+    [OP_INT2CHARS] = "",    [OP_STRI2INTS] = "",     [OP_INT2STRS] = "",      [OP_FLOAT2STRS] = "",
+    [OP_ISINT] = "vs",      [OP_ISINTS] = "",        [OP_READ] = "vt",        [OP_WRITE] = "s",
+    [OP_CONCAT] = "vss",    [OP_STRLEN] = "vs",      [OP_GETCHAR] = "vss",    [OP_SETCHAR] = "vss",
+    [OP_TYPE] = "vs",       [OP_TYPES] = "",         [OP_LABEL] = "l",        [OP_JUMP] = "l",
+    [OP_JUMPIFEQ] = "lss",  [OP_JUMPIFNEQ] = "lss",  [OP_JUMPIFEQS] = "l",    [OP_JUMPIFNEQS] = "l",
+    [OP_EXIT] = "s",        [OP_BREAK] = "",         [OP_DPRINT] = "s",
+};
+
+static const Handler HANDLERS[OP_COUNT] = {
+    [OP_MOVE] = HANDLER_MOVE,
+    [OP_CREATEFRAME] = HANDLER_CREATEFRAME,
+    [OP_PUSHFRAME] = HANDLER_PUSHFRAME,
+    [OP_POPFRAME] = HANDLER_POPFRAME,
+    [OP_DEFVAR] = HANDLER_DEFVAR,
+    [OP_CALL] = HANDLER_CALL,
+    [OP_RETURN] = HANDLER_RETURN,
+    [OP_PUSHS] = HANDLER_PUSHS,
+    [OP_POPS] = HANDLER_POPS,
+    [OP_CLEARS] = HANDLER_CLEARS,
+    [OP_ADD] = HANDLER_BINARY,
+    [OP_SUB] = HANDLER_BINARY,
+    [OP_MUL] = HANDLER_BINARY,
+    [OP_DIV] = HANDLER_BINARY,
+    [OP_IDIV] = HANDLER_BINARY,
+    [OP_LT] = HANDLER_BINARY,
+    [OP_GT] = HANDLER_BINARY,
+    [OP_EQ] = HANDLER_BINARY,
+    [OP_AND] = HANDLER_BINARY,
+    [OP_OR] = HANDLER_BINARY,
+    [OP_STRI2INT] = HANDLER_BINARY,
+    [OP_CONCAT] = HANDLER_BINARY,
+    [OP_GETCHAR] = HANDLER_BINARY,
+    [OP_ADDS] = HANDLER_BINARY_STACK,
+    [OP_SUBS] = HANDLER_BINARY_STACK,
+    [OP_MULS] = HANDLER_BINARY_STACK,
+    [OP_DIVS] = HANDLER_BINARY_STACK,
+    [OP_IDIVS] = HANDLER_BINARY_STACK,
+    [OP_LTS] = HANDLER_BINARY_STACK,
+    [OP_GTS] = HANDLER_BINARY_STACK,
+    [OP_EQS] = HANDLER_BINARY_STACK,
+    [OP_ANDS] = HANDLER_BINARY_STACK,
+    [OP_ORS] = HANDLER_BINARY_STACK,
+    [OP_STRI2INTS] = HANDLER_BINARY_STACK,
+    [OP_NOT] = HANDLER_UNARY,
+    [OP_INT2FLOAT] = HANDLER_UNARY,
+    [OP_FLOAT2INT] = HANDLER_UNARY,
+    [OP_INT2CHAR] = HANDLER_UNARY,
+    [OP_INT2STR] = HANDLER_UNARY,
+    [OP_FLOAT2STR] = HANDLER_UNARY,
+    [OP_ISINT] = HANDLER_UNARY,
+    [OP_STRLEN] = HANDLER_UNARY,
+    [OP_NOTS] = HANDLER_UNARY_STACK,
+    [OP_INT2FLOATS] = HANDLER_UNARY_STACK,
+    [OP_FLOAT2INTS] = HANDLER_UNARY_STACK,
+    [OP_INT2CHARS] = HANDLER_UNARY_STACK,
+    [OP_INT2STRS] = HANDLER_UNARY_STACK,
+    [OP_FLOAT2STRS] = HANDLER_UNARY_STACK,
+    [OP_ISINTS] = HANDLER_UNARY_STACK,
+    [OP_TYPES] = HANDLER_UNARY_STACK,
+    [OP_TYPE] = HANDLER_TYPE,
+    [OP_READ] = HANDLER_READ,
+    [OP_WRITE] = HANDLER_WRITE,
+    [OP_SETCHAR] = HANDLER_SETCHAR,
+    [OP_JUMP] = HANDLER_JUMP,
+    [OP_JUMPIFEQ] = HANDLER_JUMPIF,
+    [OP_JUMPIFNEQ] = HANDLER_JUMPIF,
+    [OP_JUMPIFEQS] = HANDLER_JUMPIF_STACK,
+    [OP_JUMPIFNEQS] = HANDLER_JUMPIF_STACK,
+    [OP_EXIT] = HANDLER_EXIT,
+    [OP_BREAK] = HANDLER_BREAK,
+    [OP_DPRINT] = HANDLER_DPRINT,
+};
+
+// What a stack instruction computes, as its three-address variant
+static const Opcode THREE_ADDRESS[OP_COUNT] = {
+    [OP_ADDS] = OP_ADD,
+    [OP_SUBS] = OP_SUB,
+    [OP_MULS] = OP_MUL,
+    [OP_DIVS] = OP_DIV,
+    [OP_IDIVS] = OP_IDIV,
+    [OP_LTS] = OP_LT,
+    [OP_GTS] = OP_GT,
+    [OP_EQS] = OP_EQ,
+    [OP_ANDS] = OP_AND,
+    [OP_ORS] = OP_OR,
+    [OP_STRI2INTS] = OP_STRI2INT,
+    [OP_NOTS] = OP_NOT,
+    [OP_INT2FLOATS] = OP_INT2FLOAT,
+    [OP_FLOAT2INTS] = OP_FLOAT2INT,
+    [OP_INT2CHARS] = OP_INT2CHAR,
+    [OP_INT2STRS] = OP_INT2STR,
+    [OP_FLOAT2STRS] = OP_FLOAT2STR,
+    [OP_ISINTS] = OP_ISINT,
+    [OP_TYPES] = OP_TYPE,
+    [OP_JUMPIFEQS] = OP_JUMPIFEQ,
+    [OP_JUMPIFNEQS] = OP_JUMPIFNEQ,
+};
+
+static const char *const TYPE_NAMES[VALUE_TYPE_COUNT] = {
+    [VALUE_UNSET] = "",        [VALUE_NIL] = "nil",   [VALUE_INT] = "int",
+    [VALUE_FLOAT] = "float",   [VALUE_BOOL] = "bool", [VALUE_STRING] = "string",
+};
+
+static bool reserve(void **data, size_t *capacity, const size_t count, const size_t size) {
+    if (count < *capacity) return true;
+    const size_t newCapacity = *capacity ? *capacity * 2 : 16;
+    void *grown = realloc(*data, newCapacity * size);
+    if (grown == nullptr) return false;
+    *data = grown;
+    *capacity = newCapacity;
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Values
+
+static VmString *newString(const size_t length) {
+    VmString *string = malloc(sizeof(VmString) + length + 1);
+    if (string == nullptr) return nullptr;
+    string->references = 1;
+    string->length = length;
+    string->bytes[length] = '\0';
+    return string;
+}
+
+static void retain(const Value value) {
+    if (value.type == VALUE_STRING) value.string->references++;
+}
+
+static void release(const Value value) {
+    if (value.type == VALUE_STRING && --value.string->references == 0) free(value.string);
+}
+
+static VmStatus stringValue(const char *bytes, const size_t length, Value *value) {
+    VmString *string = newString(length);
+    if (string == nullptr) return VM_ERROR_INTERNAL;
+    memcpy(string->bytes, bytes, length);
+    *value = (Value){.type = VALUE_STRING, .string = string};
+    return VM_OK;
+}
+
+static Value boolValue(const bool boolean) {
+    return (Value){.type = VALUE_BOOL, .boolean = boolean};
+}
+
+// ---------------------------------------------------------------------------
+// Loading
+
+static bool equalsIgnoringCase(const char *a, const char *b) {
+    for (; *a && *b; a++, b++) {
+        if (tolower((unsigned char) *a) != tolower((unsigned char) *b)) return false;
+    }
+    return *a == *b;
+}
+
+static bool parseOpcode(const char *name, Opcode *opcode) {
+    for (Opcode op = OP_NOP + 1; op < OP_COUNT; op++) {
+        if (equalsIgnoringCase(Opcode_Name(op), name)) {
+            *opcode = op;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Id of name in table, declared on its first use
+static VmStatus intern(Symtable *table, const char *name, unsigned *id) {
+    if (Symtable_Lookup(table, name, id) == ERROR_OK) return VM_OK;
+    return Symtable_Declare(table, name, id) == ERROR_OK ? VM_OK : VM_ERROR_INTERNAL;
+}
+
+static VmStatus parseVariable(Vm *vm, const char *text, Operand *operand) {
+    static const char *const FRAMES[] = {"GF@", "LF@", "TF@"};
+    static const OperandKind KINDS[] = {OPERAND_GF, OPERAND_LF, OPERAND_TF};
+    for (size_t i = 0; i < 3; i++) {
+        if (strncmp(text, FRAMES[i], 3) != 0 || text[3] == '\0') continue;
+        unsigned id;
+        const VmStatus status = intern(vm->names, text + 3, &id);
+        if (status != VM_OK) return status;
+        *operand = (Operand){.kind = KINDS[i], .index = id - 1};
+        return VM_OK;
+    }
+    return VM_ERROR_SYNTAX;
+}
+
+static VmStatus parseInt(const char *text, long long *value) {
+    const char *digits = text + (*text == '-' || *text == '+');
+    int base = 10;
+    if (digits[0] == '0' && (digits[1] == 'x' || digits[1] == 'X')) base = 16;
+    if (digits[0] == '0' && (digits[1] == 'o' || digits[1] == 'O')) base = 8;
+    if (base != 10) digits += 2;
+    if (!isxdigit((unsigned char) *digits)) return VM_ERROR_SYNTAX;
+
+    char *end;
+    errno = 0;
+    const unsigned long long magnitude = strtoull(digits, &end, base);
+    if (*end != '\0' || errno == ERANGE) return VM_ERROR_SYNTAX;
+    *value = (long long) (*text == '-' ? 0ull - magnitude : magnitude);
+    return VM_OK;
+}
+
+// Escapes are \ddd with exactly three decimal digits
+static VmStatus parseString(const char *text, Value *value) {
+    const size_t size = strlen(text);
+    VmString *string = newString(size);
+    if (string == nullptr) return VM_ERROR_INTERNAL;
+    size_t length = 0;
+    for (const char *p = text; *p; p++) {
+        if (*p != '\\') {
+            string->bytes[length++] = *p;
+            continue;
+        }
+        if (!isdigit((unsigned char) p[1]) || !isdigit((unsigned char) p[2]) || !isdigit((unsigned char) p[3])) {
+            free(string);
+            return VM_ERROR_SYNTAX;
+        }
+        const int code = (p[1] - '0') * 100 + (p[2] - '0') * 10 + (p[3] - '0');
+        if (code > 255) {
+            free(string);
+            return VM_ERROR_SYNTAX;
+        }
+        string->bytes[length++] = (char) code;
+        p += 3;
+    }
+    string->length = length;
+    string->bytes[length] = '\0';
+    *value = (Value){.type = VALUE_STRING, .string = string};
+    return VM_OK;
+}
+
+static VmStatus parseConstant(const char *text, Value *value) {
+    const char *at = strchr(text, '@');
+    if (at == nullptr) return VM_ERROR_SYNTAX;
+    const size_t type = (size_t) (at - text);
+    const char *literal = at + 1;
+    if (type == 3 && strncmp(text, "int", 3) == 0) {
+        *value = (Value){.type = VALUE_INT};
+        return parseInt(literal, &value->integer);
+    }
+    if (type == 5 && strncmp(text, "float", 5) == 0) {
+        char *end;
+        *value = (Value){.type = VALUE_FLOAT, .real = strtod(literal, &end)};
+        return *literal != '\0' && *end == '\0' ? VM_OK : VM_ERROR_SYNTAX;
+    }
+    if (type == 6 && strncmp(text, "string", 6) == 0) return parseString(literal, value);
+    if (type == 4 && strncmp(text, "bool", 4) == 0) {
+        *value = boolValue(strcmp(literal, "true") == 0);
+        return strcmp(literal, "true") == 0 || strcmp(literal, "false") == 0 ? VM_OK : VM_ERROR_SYNTAX;
+    }
+    if (type == 3 && strncmp(text, "nil", 3) == 0) {
+        *value = (Value){.type = VALUE_NIL};
+        return strcmp(literal, "nil") == 0 ? VM_OK : VM_ERROR_SYNTAX;
+    }
+    return VM_ERROR_SYNTAX;
+}
+
+static VmStatus parseSymbol(Vm *vm, const char *text, Operand *operand) {
+    if (parseVariable(vm, text, operand) == VM_OK) return VM_OK;
+    if (!reserve((void **) &vm->constants, &vm->constantCapacity, vm->constantCount, sizeof(Value))) {
+        return VM_ERROR_INTERNAL;
+    }
+    const VmStatus status = parseConstant(text, &vm->constants[vm->constantCount]);
+    if (status != VM_OK) return status;
+    *operand = (Operand){.kind = OPERAND_CONSTANT, .index = vm->constantCount++};
+    return VM_OK;
+}
+
+static VmStatus parseLabel(Vm *vm, const char *text, Operand *operand) {
+    unsigned id;
+    const VmStatus status = intern(vm->labels, text, &id);
+    if (status != VM_OK) return status;
+    if (id > vm->labelCount) {
+        if (!reserve((void **) &vm->labelTargets, &vm->labelCapacity, vm->labelCount, sizeof(size_t))) {
+            return VM_ERROR_INTERNAL;
+        }
+        // not defined until its LABEL
+        vm->labelTargets[vm->labelCount++] = SIZE_MAX;
+    }
+    *operand = (Operand){.kind = OPERAND_LABEL, .index = id - 1};
+    return VM_OK;
+}
+
+static VmStatus parseType(const char *text, Operand *operand) {
+    for (ValueType type = VALUE_NIL; type < VALUE_TYPE_COUNT; type++) {
+        if (type != VALUE_NIL && strcmp(text, TYPE_NAMES[type]) == 0) {
+            *operand = (Operand){.kind = OPERAND_TYPE, .index = type};
+            return VM_OK;
+        }
+    }
+    return VM_ERROR_SYNTAX;
+}
+
+static VmStatus parseOperand(Vm *vm, const char kind, const char *text, Operand *operand) {
+    switch (kind) {
+        case 'v':
+            return parseVariable(vm, text, operand);
+        case 's':
+            return parseSymbol(vm, text, operand);
+        case 'l':
+            return parseLabel(vm, text, operand);
+        default:
+            return parseType(text, operand);
+    }
+}
+
+static VmStatus defineLabel(Vm *vm, const Operand *label) {
+    if (vm->labelTargets[label->index] != SIZE_MAX) return VM_ERROR_SEMANTIC;
+    vm->labelTargets[label->index] = vm->count;
+    return VM_OK;
+}
+
+// One line without its comment, split at whitespace
+static VmStatus parseLine(Vm *vm, char *line, const size_t number) {
+    char *words[INSTR_MAX_OPERANDS + 2];
+    size_t count = 0;
+    for (char *word = strtok(line, " \t\r\n"); word != nullptr; word = strtok(nullptr, " \t\r\n")) {
+        if (count == INSTR_MAX_OPERANDS + 1) return VM_ERROR_SYNTAX;
+        words[count++] = word;
+    }
+    if (count == 0) return VM_OK;
+
+    Opcode opcode;
+    if (!parseOpcode(words[0], &opcode)) return VM_ERROR_SYNTAX;
+    const char *signature = SIGNATURES[opcode];
+    if (strlen(signature) != count - 1) return VM_ERROR_SYNTAX;
+    Code code = {.opcode = opcode, .handler = HANDLERS[opcode], .line = number};
+    for (size_t i = 0; signature[i]; i++) {
+        const VmStatus status = parseOperand(vm, signature[i], words[i + 1], &code.operands[i]);
+        if (status != VM_OK) return status;
+    }
+    // labels are only jump targets, they do not get an instruction
+    if (opcode == OP_LABEL) return defineLabel(vm, &code.operands[0]);
+    if (!reserve((void **) &vm->code, &vm->capacity, vm->count, sizeof(Code))) return VM_ERROR_INTERNAL;
+    vm->code[vm->count++] = code;
+    return VM_OK;
+}
+
+static VmStatus resolveLabels(const Vm *vm, size_t *line) {
+    for (size_t i = 0; i < vm->count; i++) {
+        Operand *operand = &vm->code[i].operands[0];
+        if (operand->kind != OPERAND_LABEL) continue;
+        if (vm->labelTargets[operand->index] == SIZE_MAX) {
+            *line = vm->code[i].line;
+            return VM_ERROR_SEMANTIC;
+        }
+        operand->index = vm->labelTargets[operand->index];
+    }
+    return VM_OK;
+}
+
+static VmStatus parseProgram(Vm *vm, FILE *program, size_t *line) {
+    char *text = nullptr;
+    size_t size = 0;
+    bool header = false;
+    VmStatus status = VM_OK;
+    *line = 0;
+    while (status == VM_OK && getline(&text, &size, program) != -1) {
+        ++*line;
+        char *comment = strchr(text, '#');
+        if (comment != nullptr) *comment = '\0';
+        if (header) {
+            status = parseLine(vm, text, *line);
+            continue;
+        }
+        const char *word = strtok(text, " \t\r\n");
+        if (word == nullptr) continue;
+        header = true;
+        if (!equalsIgnoringCase(word, ".IFJcode25") || strtok(nullptr, " \t\r\n") != nullptr) status = VM_ERROR_SYNTAX;
+    }
+    free(text);
+    if (status == VM_OK && !header) status = VM_ERROR_SYNTAX;
+    if (status == VM_OK) status = resolveLabels(vm, line);
+    return status;
+}
+
+static VmStatus createTypeNames(Vm *vm) {
+    for (ValueType type = VALUE_UNSET; type < VALUE_TYPE_COUNT; type++) {
+        const VmStatus status = stringValue(TYPE_NAMES[type], strlen(TYPE_NAMES[type]), &vm->typeNames[type]);
+        if (status != VM_OK) return status;
+    }
+    return VM_OK;
+}
+
+VmStatus Vm_Load(Vm **vm, FILE *program, size_t *line) {
+    *line = 0;
+    Vm *loaded = calloc(1, sizeof(Vm));
+    if (loaded == nullptr) return VM_ERROR_INTERNAL;
+    loaded->names = Symtable_ctor(0);
+    loaded->labels = Symtable_ctor(0);
+    VmStatus status = loaded->names && loaded->labels ? createTypeNames(loaded) : VM_ERROR_INTERNAL;
+    if (status == VM_OK) status = parseProgram(loaded, program, line);
+    if (status == VM_OK && (loaded->executed = calloc(loaded->count + 1, sizeof(unsigned long long))) == nullptr) {
+        status = VM_ERROR_INTERNAL;
+    }
+    if (status != VM_OK) {
+        Vm_dtor(loaded);
+        return status;
+    }
+    *vm = loaded;
+    return VM_OK;
+}
+
+// ---------------------------------------------------------------------------
+// Frames and stacks
+
+static Frame *newFrame(Vm *vm) {
+    if (vm->unused != nullptr) {
+        Frame *frame = vm->unused;
+        vm->unused = frame->next;
+        return frame;
+    }
+    Frame *frame = calloc(1, sizeof(Frame));
+    if (frame == nullptr) return nullptr;
+    // every name has its place in every frame, one more so there is always one
+    frame->values = calloc(vm->names->declarationCount + 1, sizeof(Value));
+    if (frame->values == nullptr) {
+        free(frame);
+        return nullptr;
+    }
+    return frame;
+}
+
+// Empties frame and keeps it for the next newFrame
+static void dropFrame(Vm *vm, Frame *frame) {
+    if (frame == nullptr) return;
+    for (size_t i = 0; i < frame->definedCount; i++) {
+        Value *value = &frame->values[frame->defined[i]];
+        release(*value);
+        value->type = VALUE_UNDEFINED;
+    }
+    frame->definedCount = 0;
+    frame->next = vm->unused;
+    vm->unused = frame;
+}
+
+static void freeFrame(Frame *frame) {
+    free(frame->values);
+    free(frame->defined);
+    free(frame);
+}
+
+static Frame *frameOf(const Vm *vm, const OperandKind kind) {
+    switch (kind) {
+        case OPERAND_GF:
+            return vm->global;
+        case OPERAND_LF:
+            return vm->localCount > 0 ? vm->locals[vm->localCount - 1] : nullptr;
+        default:
+            return vm->temporary;
+    }
+}
+
+static VmStatus variable(const Vm *vm, const Operand *operand, Value **slot) {
+    const Frame *frame = frameOf(vm, operand->kind);
+    if (frame == nullptr) return VM_ERROR_FRAME;
+    *slot = &frame->values[operand->index];
+    return (*slot)->type == VALUE_UNDEFINED ? VM_ERROR_VARIABLE : VM_OK;
+}
+
+// The value of a variable or constant, borrowed
+static VmStatus symbol(const Vm *vm, const Operand *operand, Value *value) {
+    if (operand->kind == OPERAND_CONSTANT) {
+        *value = vm->constants[operand->index];
+        return VM_OK;
+    }
+    Value *slot;
+    const VmStatus status = variable(vm, operand, &slot);
+    if (status != VM_OK) return status;
+    if (slot->type == VALUE_UNSET) return VM_ERROR_MISSING;
+    *value = *slot;
+    return VM_OK;
+}
+
+// Stores value into the variable, which takes over its reference
+static VmStatus assign(const Vm *vm, const Operand *operand, const Value value) {
+    Value *slot;
+    const VmStatus status = variable(vm, operand, &slot);
+    if (status != VM_OK) {
+        release(value);
+        return status;
+    }
+    release(*slot);
+    *slot = value;
+    return VM_OK;
+}
+
+static VmStatus defineVariable(const Vm *vm, const Operand *operand) {
+    Frame *frame = frameOf(vm, operand->kind);
+    if (frame == nullptr) return VM_ERROR_FRAME;
+    Value *slot = &frame->values[operand->index];
+    if (slot->type != VALUE_UNDEFINED) return VM_ERROR_SEMANTIC;
+    if (!reserve((void **) &frame->defined, &frame->definedCapacity, frame->definedCount, sizeof(size_t))) {
+        return VM_ERROR_INTERNAL;
+    }
+    frame->defined[frame->definedCount++] = operand->index;
+    slot->type = VALUE_UNSET;
+    return VM_OK;
+}
+
+// Takes over the reference of value
+static VmStatus push(Vm *vm, const Value value) {
+    if (!reserve((void **) &vm->stack, &vm->stackCapacity, vm->stackCount, sizeof(Value))) {
+        release(value);
+        return VM_ERROR_INTERNAL;
+    }
+    vm->stack[vm->stackCount++] = value;
+    return VM_OK;
+}
+
+// Hands over the reference of the value
+static VmStatus pop(Vm *vm, Value *value) {
+    if (vm->stackCount == 0) return VM_ERROR_MISSING;
+    *value = vm->stack[--vm->stackCount];
+    return VM_OK;
+}
+
+// ---------------------------------------------------------------------------
+// Operations, on borrowed operands giving a result of their own
+
+static bool sameBytes(const VmString *a, const VmString *b) {
+    return a->length == b->length && memcmp(a->bytes, b->bytes, a->length) == 0;
+}
+
+static int compareBytes(const VmString *a, const VmString *b) {
+    const size_t shorter = a->length < b->length ? a->length : b->length;
+    const int order = memcmp(a->bytes, b->bytes, shorter);
+    if (order != 0) return order;
+    return (a->length > b->length) - (a->length < b->length);
+}
+
+// nil equals only nil, any other operands have to be of the same type
+static VmStatus equal(const Value left, const Value right, bool *result) {
+    if (left.type == VALUE_NIL || right.type == VALUE_NIL) {
+        *result = left.type == right.type;
+        return VM_OK;
+    }
+    if (left.type != right.type) return VM_ERROR_TYPES;
+    switch (left.type) {
+        case VALUE_INT:
+            *result = left.integer == right.integer;
+            break;
+        case VALUE_FLOAT:
+            *result = left.real == right.real;
+            break;
+        case VALUE_BOOL:
+            *result = left.boolean == right.boolean;
+            break;
+        default:
+            *result = sameBytes(left.string, right.string);
+            break;
+    }
+    return VM_OK;
+}
+
+static VmStatus order(const Opcode opcode, const Value left, const Value right, Value *result) {
+    if (left.type != right.type || left.type == VALUE_NIL) return VM_ERROR_TYPES;
+    int sign;
+    switch (left.type) {
+        case VALUE_INT:
+            sign = (left.integer > right.integer) - (left.integer < right.integer);
+            break;
+        case VALUE_FLOAT:
+            sign = (left.real > right.real) - (left.real < right.real);
+            break;
+        case VALUE_BOOL:
+            sign = left.boolean - right.boolean;
+            break;
+        default:
+            sign = compareBytes(left.string, right.string);
+            break;
+    }
+    *result = boolValue(opcode == OP_LT ? sign < 0 : sign > 0);
+    return VM_OK;
+}
+
+// Overflowing ints wrap around, the operations are done on unsigned values
+static VmStatus arithmetic(const Opcode opcode, const Value left, const Value right, Value *result) {
+    if (left.type != right.type || (left.type != VALUE_INT && left.type != VALUE_FLOAT)) return VM_ERROR_TYPES;
+    if ((opcode == OP_DIV && left.type != VALUE_FLOAT) || (opcode == OP_IDIV && left.type != VALUE_INT)) {
+        return VM_ERROR_TYPES;
+    }
+    if (left.type == VALUE_FLOAT) {
+        const double a = left.real;
+        const double b = right.real;
+        if (opcode == OP_DIV && b == 0.0) return VM_ERROR_VALUE;
+        const double value = opcode == OP_ADD ? a + b : opcode == OP_SUB ? a - b : opcode == OP_MUL ? a * b : a / b;
+        *result = (Value){.type = VALUE_FLOAT, .real = value};
+        return VM_OK;
+    }
+
+    const long long a = left.integer;
+    const long long b = right.integer;
+    long long value;
+    switch (opcode) {
+        case OP_ADD:
+            value = (long long) ((unsigned long long) a + (unsigned long long) b);
+            break;
+        case OP_SUB:
+            value = (long long) ((unsigned long long) a - (unsigned long long) b);
+            break;
+        case OP_MUL:
+            value = (long long) ((unsigned long long) a * (unsigned long long) b);
+            break;
+        default:
+            if (b == 0) return VM_ERROR_VALUE;
+            if (b == -1) {
+                value = (long long) (0ull - (unsigned long long) a);
+                break;
+            }
+            // rounded towards minus infinity
+            value = a / b - (a % b != 0 && (a < 0) != (b < 0));
+            break;
+    }
+    *result = (Value){.type = VALUE_INT, .integer = value};
+    return VM_OK;
+}
+
+static VmStatus strings(const Opcode opcode, const Value left, const Value right, Value *result) {
+    if (opcode == OP_CONCAT) {
+        if (left.type != VALUE_STRING || right.type != VALUE_STRING) return VM_ERROR_TYPES;
+        VmString *string = newString(left.string->length + right.string->length);
+        if (string == nullptr) return VM_ERROR_INTERNAL;
+        memcpy(string->bytes, left.string->bytes, left.string->length);
+        memcpy(string->bytes + left.string->length, right.string->bytes, right.string->length);
+        *result = (Value){.type = VALUE_STRING, .string = string};
+        return VM_OK;
+    }
+    if (left.type != VALUE_STRING || right.type != VALUE_INT) return VM_ERROR_TYPES;
+    if (right.integer < 0 || (unsigned long long) right.integer >= left.string->length) return VM_ERROR_STRING;
+    const char character = left.string->bytes[right.integer];
+    if (opcode == OP_STRI2INT) {
+        *result = (Value){.type = VALUE_INT, .integer = (unsigned char) character};
+        return VM_OK;
+    }
+    return stringValue(&character, 1, result);
+}
+
+static VmStatus binary(const Opcode opcode, const Value left, const Value right, Value *result) {
+    switch (opcode) {
+        case OP_LT:
+        case OP_GT:
+            return order(opcode, left, right, result);
+        case OP_EQ: {
+            bool same;
+            const VmStatus status = equal(left, right, &same);
+            *result = boolValue(same);
+            return status;
+        }
+        case OP_AND:
+        case OP_OR:
+            if (left.type != VALUE_BOOL || right.type != VALUE_BOOL) return VM_ERROR_TYPES;
+            *result = boolValue(opcode == OP_AND ? left.boolean && right.boolean : left.boolean || right.boolean);
+            return VM_OK;
+        case OP_CONCAT:
+        case OP_STRI2INT:
+        case OP_GETCHAR:
+            return strings(opcode, left, right, result);
+        default:
+            return arithmetic(opcode, left, right, result);
+    }
+}
+
+// As Ifj.str does, shared with constant folding
+static VmStatus floatText(const double value, Value *result) {
+    char text[FORMAT_FLOAT_TEXT_MAX];
+    const char *end = Format_FloatText(text, value);
+    return stringValue(text, (size_t) (end - text), result);
+}
+
+static VmStatus unary(const Vm *vm, const Opcode opcode, const Value operand, Value *result) {
+    switch (opcode) {
+        case OP_NOT:
+            if (operand.type != VALUE_BOOL) return VM_ERROR_TYPES;
+            *result = boolValue(!operand.boolean);
+            return VM_OK;
+        case OP_INT2FLOAT:
+            if (operand.type != VALUE_INT) return VM_ERROR_TYPES;
+            *result = (Value){.type = VALUE_FLOAT, .real = (double) operand.integer};
+            return VM_OK;
+        case OP_FLOAT2INT:
+            if (operand.type != VALUE_FLOAT) return VM_ERROR_TYPES;
+            if (!Format_FitsInt(operand.real)) return VM_ERROR_VALUE;
+            *result = (Value){.type = VALUE_INT, .integer = (long long) operand.real};
+            return VM_OK;
+        case OP_INT2CHAR: {
+            if (operand.type != VALUE_INT) return VM_ERROR_TYPES;
+            if (operand.integer < 0 || operand.integer > 255) return VM_ERROR_STRING;
+            const char character = (char) operand.integer;
+            return stringValue(&character, 1, result);
+        }
+        case OP_INT2STR: {
+            if (operand.type != VALUE_INT) return VM_ERROR_TYPES;
+            char text[32];
+            snprintf(text, sizeof text, "%lld", operand.integer);
+            return stringValue(text, strlen(text), result);
+        }
+        case OP_FLOAT2STR:
+            if (operand.type != VALUE_FLOAT) return VM_ERROR_TYPES;
+            return floatText(operand.real, result);
+        case OP_ISINT:
+            if (operand.type == VALUE_INT) {
+                *result = boolValue(true);
+                return VM_OK;
+            }
+            if (operand.type != VALUE_FLOAT) return VM_ERROR_TYPES;
+            *result = boolValue(Format_IsIntegral(operand.real));
+            return VM_OK;
+        case OP_STRLEN:
+            if (operand.type != VALUE_STRING) return VM_ERROR_TYPES;
+            *result = (Value){.type = VALUE_INT, .integer = (long long) operand.string->length};
+            return VM_OK;
+        default:
+            // TYPE, with VALUE_UNSET for an uninitialized variable
+            *result = vm->typeNames[operand.type];
+            retain(*result);
+            return VM_OK;
+    }
+}
+
+static VmStatus setChar(const Vm *vm, const Operand *operands) {
+    Value *target;
+    Value index;
+    Value source;
+    VmStatus status = variable(vm, &operands[0], &target);
+    if (status == VM_OK && target->type == VALUE_UNSET) status = VM_ERROR_MISSING;
+    if (status == VM_OK) status = symbol(vm, &operands[1], &index);
+    if (status == VM_OK) status = symbol(vm, &operands[2], &source);
+    if (status != VM_OK) return status;
+    if (target->type != VALUE_STRING || index.type != VALUE_INT || source.type != VALUE_STRING) return VM_ERROR_TYPES;
+    const VmString *string = target->string;
+    if (index.integer < 0 || (unsigned long long) index.integer >= string->length || source.string->length == 0) {
+        return VM_ERROR_STRING;
+    }
+    Value changed;
+    if ((status = stringValue(string->bytes, string->length, &changed)) != VM_OK) return status;
+    changed.string->bytes[index.integer] = source.string->bytes[0];
+    release(*target);
+    *target = changed;
+    return VM_OK;
+}
+
+// One line of input as type, nil at the end of the input or if the line is not one
+static VmStatus readValue(FILE *input, const ValueType type, Value *result) {
+    char *line = nullptr;
+    size_t size = 0;
+    ssize_t length = getline(&line, &size, input);
+    *result = (Value){.type = VALUE_NIL};
+    if (length == -1) {
+        free(line);
+        return VM_OK;
+    }
+    if (length > 0 && line[length - 1] == '\n') line[--length] = '\0';
+
+    VmStatus status = VM_OK;
+    char *end = line;
+    switch (type) {
+        case VALUE_STRING:
+            status = stringValue(line, (size_t) length, result);
+            break;
+        case VALUE_BOOL:
+            *result = boolValue(equalsIgnoringCase(line, "true"));
+            break;
+        case VALUE_INT: {
+            long long value;
+            // surrounding whitespace makes it no number
+            if (length > 0 && !isspace((unsigned char) line[0]) && parseInt(line, &value) == VM_OK) {
+                *result = (Value){.type = VALUE_INT, .integer = value};
+            }
+            break;
+        }
+        default: {
+            const double value = length > 0 && !isspace((unsigned char) line[0]) ? strtod(line, &end) : 0.0;
+            if (end != line && *end == '\0' && isfinite(value)) {
+                *result = (Value){.type = VALUE_FLOAT, .real = value};
+            }
+            break;
+        }
+    }
+    free(line);
+    return status;
+}
+
+static void writeValue(const Value value, FILE *output) {
+    switch (value.type) {
+        case VALUE_INT:
+            fprintf(output, "%lld", value.integer);
+            break;
+        case VALUE_FLOAT:
+            fprintf(output, "%a", value.real);
+            break;
+        case VALUE_BOOL:
+            fputs(value.boolean ? "true" : "false", output);
+            break;
+        case VALUE_STRING:
+            fwrite(value.string->bytes, 1, value.string->length, output);
+            break;
+        default:
+            fputs("null", output);
+            break;
+    }
+}
+
+static void printState(const Vm *vm, const size_t ip) {
+    unsigned long long executed = 0;
+    for (size_t i = 0; i < vm->count; i++) executed += vm->executed[i];
+    fprintf(stderr, "BREAK at line %zu after %llu instructions\n", vm->code[ip].line, executed);
+    fprintf(stderr, "  global frame: %zu variables\n", vm->global->definedCount);
+    fprintf(stderr, "  local frames: %zu, the current with %zu variables\n", vm->localCount,
+            vm->localCount > 0 ? vm->locals[vm->localCount - 1]->definedCount : 0);
+    if (vm->temporary != nullptr) {
+        fprintf(stderr, "  temporary frame: %zu variables\n", vm->temporary->definedCount);
+    } else {
+        fputs("  temporary frame: undefined\n", stderr);
+    }
+    fprintf(stderr, "  data stack: %zu values, call stack: %zu returns\n", vm->stackCount, vm->callCount);
+}
+
+// ---------------------------------------------------------------------------
+// Dispatch
+
+#ifdef VM_COMPUTED_GOTO
+#define HANDLER(handler) target_##handler:
+#define DISPATCH()                                                                                                   \
+    do {                                                                                                             \
+        if (ip == vm->count) goto finished;                                                                          \
+        instr = &vm->code[ip];                                                                                       \
+        vm->executed[ip++]++;                                                                                        \
+        goto *TARGETS[instr->handler];                                                                               \
+    } while (0)
+#else
+#define HANDLER(handler) case handler:
+#define DISPATCH() continue
+#endif
+
+#define CHECK(expression)                                                                                            \
+    do {                                                                                                             \
+        if ((status = (expression)) != VM_OK) goto failed;                                                           \
+    } while (0)
+
+static int execute(Vm *vm, FILE *input, FILE *output, size_t *line) {
+    size_t ip = 0;
+    const Code *instr = nullptr;
+    VmStatus status = VM_OK;
+    Value left;
+    Value right;
+    Value result;
+    bool same;
+
+#ifdef VM_COMPUTED_GOTO
+    static const void *const TARGETS[HANDLER_COUNT] = {
+        [HANDLER_INVALID] = &&target_HANDLER_INVALID,
+        [HANDLER_MOVE] = &&target_HANDLER_MOVE,
+        [HANDLER_CREATEFRAME] = &&target_HANDLER_CREATEFRAME,
+        [HANDLER_PUSHFRAME] = &&target_HANDLER_PUSHFRAME,
+        [HANDLER_POPFRAME] = &&target_HANDLER_POPFRAME,
+        [HANDLER_DEFVAR] = &&target_HANDLER_DEFVAR,
+        [HANDLER_CALL] = &&target_HANDLER_CALL,
+        [HANDLER_RETURN] = &&target_HANDLER_RETURN,
+        [HANDLER_PUSHS] = &&target_HANDLER_PUSHS,
+        [HANDLER_POPS] = &&target_HANDLER_POPS,
+        [HANDLER_CLEARS] = &&target_HANDLER_CLEARS,
+        [HANDLER_BINARY] = &&target_HANDLER_BINARY,
+        [HANDLER_BINARY_STACK] = &&target_HANDLER_BINARY_STACK,
+        [HANDLER_UNARY] = &&target_HANDLER_UNARY,
+        [HANDLER_UNARY_STACK] = &&target_HANDLER_UNARY_STACK,
+        [HANDLER_TYPE] = &&target_HANDLER_TYPE,
+        [HANDLER_READ] = &&target_HANDLER_READ,
+        [HANDLER_WRITE] = &&target_HANDLER_WRITE,
+        [HANDLER_SETCHAR] = &&target_HANDLER_SETCHAR,
+        [HANDLER_JUMP] = &&target_HANDLER_JUMP,
+        [HANDLER_JUMPIF] = &&target_HANDLER_JUMPIF,
+        [HANDLER_JUMPIF_STACK] = &&target_HANDLER_JUMPIF_STACK,
+        [HANDLER_EXIT] = &&target_HANDLER_EXIT,
+        [HANDLER_BREAK] = &&target_HANDLER_BREAK,
+        [HANDLER_DPRINT] = &&target_HANDLER_DPRINT,
+    };
+    DISPATCH();
+#else
+    for (;;) {
+        if (ip == vm->count) goto finished;
+        instr = &vm->code[ip];
+        vm->executed[ip++]++;
+        switch (instr->handler) {
+#endif
+
+    HANDLER(HANDLER_MOVE) {
+        CHECK(symbol(vm, &instr->operands[1], &result));
+        retain(result);
+        CHECK(assign(vm, &instr->operands[0], result));
+        DISPATCH();
+    }
+    HANDLER(HANDLER_CREATEFRAME) {
+        dropFrame(vm, vm->temporary);
+        if ((vm->temporary = newFrame(vm)) == nullptr) CHECK(VM_ERROR_INTERNAL);
+        DISPATCH();
+    }
+    HANDLER(HANDLER_PUSHFRAME) {
+        if (vm->temporary == nullptr) CHECK(VM_ERROR_FRAME);
+        if (!reserve((void **) &vm->locals, &vm->localCapacity, vm->localCount, sizeof(Frame *))) {
+            CHECK(VM_ERROR_INTERNAL);
+        }
+        vm->locals[vm->localCount++] = vm->temporary;
+        vm->temporary = nullptr;
+        DISPATCH();
+    }
+    HANDLER(HANDLER_POPFRAME) {
+        if (vm->localCount == 0) CHECK(VM_ERROR_FRAME);
+        dropFrame(vm, vm->temporary);
+        vm->temporary = vm->locals[--vm->localCount];
+        DISPATCH();
+    }
+    HANDLER(HANDLER_DEFVAR) {
+        CHECK(defineVariable(vm, &instr->operands[0]));
+        DISPATCH();
+    }
+    HANDLER(HANDLER_CALL) {
+        if (!reserve((void **) &vm->calls, &vm->callCapacity, vm->callCount, sizeof(size_t))) {
+            CHECK(VM_ERROR_INTERNAL);
+        }
+        vm->calls[vm->callCount++] = ip;
+        ip = instr->operands[0].index;
+        DISPATCH();
+    }
+    HANDLER(HANDLER_RETURN) {
+        if (vm->callCount == 0) CHECK(VM_ERROR_MISSING);
+        ip = vm->calls[--vm->callCount];
+        DISPATCH();
+    }
+    HANDLER(HANDLER_PUSHS) {
+        CHECK(symbol(vm, &instr->operands[0], &result));
+        retain(result);
+        CHECK(push(vm, result));
+        DISPATCH();
+    }
+    HANDLER(HANDLER_POPS) {
+        CHECK(pop(vm, &result));
+        CHECK(assign(vm, &instr->operands[0], result));
+        DISPATCH();
+    }
+    HANDLER(HANDLER_CLEARS) {
+        while (vm->stackCount > 0) release(vm->stack[--vm->stackCount]);
+        DISPATCH();
+    }
+    HANDLER(HANDLER_BINARY) {
+        CHECK(symbol(vm, &instr->operands[1], &left));
+        CHECK(symbol(vm, &instr->operands[2], &right));
+        CHECK(binary(instr->opcode, left, right, &result));
+        CHECK(assign(vm, &instr->operands[0], result));
+        DISPATCH();
+    }
+    HANDLER(HANDLER_BINARY_STACK) {
+        if (vm->stackCount < 2) CHECK(VM_ERROR_MISSING);
+        right = vm->stack[--vm->stackCount];
+        left = vm->stack[--vm->stackCount];
+        status = binary(THREE_ADDRESS[instr->opcode], left, right, &result);
+        release(left);
+        release(right);
+        if (status != VM_OK) goto failed;
+        CHECK(push(vm, result));
+        DISPATCH();
+    }
+    HANDLER(HANDLER_UNARY) {
+        CHECK(symbol(vm, &instr->operands[1], &left));
+        CHECK(unary(vm, instr->opcode, left, &result));
+        CHECK(assign(vm, &instr->operands[0], result));
+        DISPATCH();
+    }
+    HANDLER(HANDLER_UNARY_STACK) {
+        CHECK(pop(vm, &left));
+        status = unary(vm, THREE_ADDRESS[instr->opcode], left, &result);
+        release(left);
+        if (status != VM_OK) goto failed;
+        CHECK(push(vm, result));
+        DISPATCH();
+    }
+    HANDLER(HANDLER_TYPE) {
+        // an uninitialized variable has the empty type instead of no value
+        if (instr->operands[1].kind == OPERAND_CONSTANT) {
+            left = vm->constants[instr->operands[1].index];
+        } else {
+            Value *slot;
+            CHECK(variable(vm, &instr->operands[1], &slot));
+            left = *slot;
+        }
+        CHECK(unary(vm, OP_TYPE, left, &result));
+        CHECK(assign(vm, &instr->operands[0], result));
+        DISPATCH();
+    }
+    HANDLER(HANDLER_READ) {
+        fflush(output);
+        CHECK(readValue(input, (ValueType) instr->operands[1].index, &result));
+        CHECK(assign(vm, &instr->operands[0], result));
+        DISPATCH();
+    }
+    HANDLER(HANDLER_WRITE) {
+        CHECK(symbol(vm, &instr->operands[0], &result));
+        writeValue(result, output);
+        DISPATCH();
+    }
+    HANDLER(HANDLER_SETCHAR) {
+        CHECK(setChar(vm, instr->operands));
+        DISPATCH();
+    }
+    HANDLER(HANDLER_JUMP) {
+        ip = instr->operands[0].index;
+        DISPATCH();
+    }
+    HANDLER(HANDLER_JUMPIF) {
+        CHECK(symbol(vm, &instr->operands[1], &left));
+        CHECK(symbol(vm, &instr->operands[2], &right));
+        CHECK(equal(left, right, &same));
+        if (same == (instr->opcode == OP_JUMPIFEQ)) ip = instr->operands[0].index;
+        DISPATCH();
+    }
+    HANDLER(HANDLER_JUMPIF_STACK) {
+        if (vm->stackCount < 2) CHECK(VM_ERROR_MISSING);
+        right = vm->stack[--vm->stackCount];
+        left = vm->stack[--vm->stackCount];
+        status = equal(left, right, &same);
+        release(left);
+        release(right);
+        if (status != VM_OK) goto failed;
+        if (same == (instr->opcode == OP_JUMPIFEQS)) ip = instr->operands[0].index;
+        DISPATCH();
+    }
+    HANDLER(HANDLER_EXIT) {
+        CHECK(symbol(vm, &instr->operands[0], &result));
+        if (result.type != VALUE_INT) CHECK(VM_ERROR_TYPES);
+        if (result.integer < 0 || result.integer > 49) CHECK(VM_ERROR_VALUE);
+        return (int) result.integer;
+    }
+    HANDLER(HANDLER_BREAK) {
+        printState(vm, ip - 1);
+        DISPATCH();
+    }
+    HANDLER(HANDLER_DPRINT) {
+        CHECK(symbol(vm, &instr->operands[0], &result));
+        writeValue(result, stderr);
+        DISPATCH();
+    }
+    HANDLER(HANDLER_INVALID) {
+        CHECK(VM_ERROR_INTERNAL);
+    }
+
+#ifndef VM_COMPUTED_GOTO
+            default:
+                CHECK(VM_ERROR_INTERNAL);
+        }
+    }
+#endif
+
+finished:
+    return VM_OK;
+failed:
+    *line = instr->line;
+    return status;
+}
+
+int Vm_Run(Vm *vm, FILE *input, FILE *output, size_t *line) {
+    *line = 0;
+    if (vm->global == nullptr && (vm->global = newFrame(vm)) == nullptr) return VM_ERROR_INTERNAL;
+    const int code = execute(vm, input, output, line);
+    fflush(output);
+    return code;
+}
+
+unsigned long long Vm_Executed(const Vm *vm) {
+    unsigned long long executed = 0;
+    for (size_t i = 0; i < vm->count; i++) executed += vm->executed[i];
+    return executed;
+}
+
+void Vm_PrintOpcodes(const Vm *vm, FILE *output) {
+    unsigned long long executed[OP_COUNT] = {};
+    for (size_t i = 0; i < vm->count; i++) executed[vm->code[i].opcode] += vm->executed[i];
+    for (Opcode opcode = OP_NOP + 1; opcode < OP_COUNT; opcode++) {
+        if (executed[opcode] > 0) fprintf(output, "%-12s %llu\n", Opcode_Name(opcode), executed[opcode]);
+    }
+}
+
+void Vm_PrintInstructions(const Vm *vm, FILE *output) {
+    for (size_t i = 0; i < vm->count; i++) {
+        fprintf(output, "%zu\t%s\t%llu\n", vm->code[i].line, Opcode_Name(vm->code[i].opcode), vm->executed[i]);
+    }
+}
+
+void Vm_dtor(Vm *vm) {
+    if (vm == nullptr) return;
+    while (vm->stackCount > 0) release(vm->stack[--vm->stackCount]);
+    if (vm->temporary != nullptr) dropFrame(vm, vm->temporary);
+    while (vm->localCount > 0) dropFrame(vm, vm->locals[--vm->localCount]);
+    if (vm->global != nullptr) dropFrame(vm, vm->global);
+    while (vm->unused != nullptr) {
+        Frame *next = vm->unused->next;
+        freeFrame(vm->unused);
+        vm->unused = next;
+    }
+    for (size_t i = 0; i < vm->constantCount; i++) release(vm->constants[i]);
+    for (ValueType type = VALUE_UNSET; type < VALUE_TYPE_COUNT; type++) release(vm->typeNames[type]);
+    Symtable_dtor(vm->names);
+    Symtable_dtor(vm->labels);
+    free(vm->labelTargets);
+    free(vm->constants);
+    free(vm->code);
+    free(vm->executed);
+    free(vm->locals);
+    free(vm->stack);
+    free(vm->calls);
+    free(vm);
+}
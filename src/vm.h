@@ -0,0 +1,45 @@
+﻿#ifndef IFJCODE25_VM_H
+#define IFJCODE25_VM_H
+
+#include <stdio.h>
+
+// Exit codes of the interpreter besides the program's own EXIT
+typedef enum VmStatus {
+    VM_OK = 0,
+    VM_ERROR_USAGE = 50,       // wrong command line
+    VM_ERROR_SYNTAX = 51,      // the program text is malformed
+    VM_ERROR_SEMANTIC = 52,    // undefined or repeated label, redefined variable
+    VM_ERROR_TYPES = 53,       // operands of the wrong types
+    VM_ERROR_VARIABLE = 54,    // variable that was not defined in an existing frame
+    VM_ERROR_FRAME = 55,       // frame that does not exist
+    VM_ERROR_MISSING = 56,     // no value in a variable, on the data stack or the call stack
+    VM_ERROR_VALUE = 57,       // division by zero, EXIT outside 0..49
+    VM_ERROR_STRING = 58,      // index outside a string, character code out of range
+    VM_ERROR_INTERNAL = 60,
+} VmStatus;
+
+/*
+ * Reference interpreter of IFJcode25. Vm_Load decodes the program text once
+ * into an array of instructions whose operands are already frame slots,
+ * constants and resolved jump targets, with the labels left out. Vm_Run
+ * dispatches on it with computed goto (a switch where the compiler has no
+ * labels as values), keeps the global frame, the local frame stack, the
+ * temporary frame, the data stack and the call stack, and counts how many
+ * times every instruction was executed.
+ */
+typedef struct Vm Vm;
+
+// On an error *line is the line of the program text at fault
+VmStatus Vm_Load(Vm **vm, FILE *program, size_t *line);
+
+// Exit code of the program, or the error that stopped it at *line
+int Vm_Run(Vm *vm, FILE *input, FILE *output, size_t *line);
+
+// Instructions executed in total, and per opcode / per instruction on the lines of output
+unsigned long long Vm_Executed(const Vm *vm);
+void Vm_PrintOpcodes(const Vm *vm, FILE *output);
+void Vm_PrintInstructions(const Vm *vm, FILE *output);
+
+void Vm_dtor(Vm *vm);
+
+#endif